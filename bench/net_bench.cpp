@@ -0,0 +1,509 @@
+/************************************************************************/
+/*  Loopback benchmark of the net interface                             */
+/*  links against the library only, every run is one json line         */
+/************************************************************************/
+
+#include "net.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace net;
+
+namespace {
+
+// every message starts with the time it was sent, replies carry it back
+const int kStampSize = 16;
+const int kAckSize = kStampSize;
+const int kMaxUdpBenchSize = 65507;
+// a udp flow without a reply for this long lost its window, it is sent again
+const long long kUdpLossTimeout = 500 * 1000 * 1000LL;
+
+const int kModeEcho = 0;     // clients send, the server echoes every message back
+const int kModeFanIn = 1;    // clients send, the server answers with a short ack
+const int kModeFanOut = 2;   // the server sends to every client, clients answer with a short ack
+const char* const kModeName[] = {"echo", "fanin", "fanout"};
+
+struct BenchConfig {
+  bool udp;
+  int mode;
+  int connections;
+  int size;
+  int depth;
+  int threads;
+  bool per_core;
+  double warmup;
+  double duration;
+  int port;
+};
+
+long long NowNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// a run that could not start is a json line too, with the reason in error
+void PrintError(const BenchConfig& config, const char* format, ...) {
+  char error[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(error, sizeof(error), format, args);
+  va_end(args);
+  fprintf(stderr, "%s\n", error);
+  printf("{\"proto\":\"%s\",\"mode\":\"%s\",\"connections\":%d,\"size\":%d,\"depth\":%d,\"threads\":%d,\"per_core\":%s,"
+    "\"error\":\"%s\"}\n", config.udp ? "udp" : "tcp", kModeName[config.mode], config.connections, config.size, config.depth,
+    config.threads, config.per_core ? "true" : "false", error);
+  fflush(stdout);
+}
+
+// log linear buckets, 32 per power of two, enough for round trips of microseconds to seconds
+class LatencyHistogram {
+ public:
+  static const int kSubBits = 5;
+  static const int kSubCount = 1 << kSubBits;
+  static const int kBucketCount = (48 - kSubBits) * kSubCount;
+
+  LatencyHistogram() { Reset(); }
+  void Reset() {
+    for (auto& i : bucket_) {
+      i = 0;
+    }
+  }
+  void Record(long long value) {
+    if (value < 0) {
+      value = 0;
+    }
+    ++bucket_[BucketOf(static_cast<unsigned long long>(value))];
+  }
+  // the upper end of the bucket holding the quantile
+  long long Quantile(double quantile) const {
+    unsigned long long total = 0;
+    for (const auto& i : bucket_) {
+      total += i.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+      return 0;
+    }
+    auto rank = static_cast<unsigned long long>(quantile * total);
+    unsigned long long seen = 0;
+    for (auto i = 0; i < kBucketCount; ++i) {
+      seen += bucket_[i].load(std::memory_order_relaxed);
+      if (seen > rank) {
+        return BucketTop(i);
+      }
+    }
+    return BucketTop(kBucketCount - 1);
+  }
+
+ private:
+  static int BucketOf(unsigned long long value) {
+    if (value < 2 * kSubCount) {
+      return static_cast<int>(value);
+    }
+    auto top_bit = 0;
+    while ((value >> (top_bit + 1)) != 0) {
+      ++top_bit;
+    }
+    auto shift = top_bit - kSubBits;
+    auto bucket = (shift + 1) * kSubCount + static_cast<int>((value >> shift) - kSubCount);
+    return std::min(bucket, kBucketCount - 1);
+  }
+  static long long BucketTop(int bucket) {
+    if (bucket < 2 * kSubCount) {
+      return bucket;
+    }
+    auto shift = bucket / kSubCount - 1;
+    auto sub = static_cast<long long>(bucket % kSubCount + kSubCount);
+    return ((sub + 1) << shift) - 1;
+  }
+
+ private:
+  std::atomic<unsigned long long> bucket_[kBucketCount];
+};
+
+// one stream of requests kept depth deep. the side sending the requests owns the flows
+struct Flow {
+  TcpHandle tcp;
+  UdpHandle udp;
+  UdpEndpoint peer;
+  std::atomic<int> inflight;
+  std::atomic<long long> last_reply;
+};
+
+class Bench : public NetInterface {
+ public:
+  explicit Bench(const BenchConfig& config) : config_(config), running_(false), measuring_(false), accepted_(0),
+    messages_(0), bytes_(0), lost_(0), errors_(0), listen_(kInvalidTcpHandle), server_udp_(kInvalidUdpHandle) {}
+
+  bool Run();
+
+  bool OnTcpDisconnected(TcpHandle /*handle*/) override { return true; }
+  bool OnTcpAccepted(TcpHandle /*handle*/, TcpHandle accept_handle) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    accepted_handle_.push_back(accept_handle);
+    ++accepted_;
+    return true;
+  }
+  bool OnTcpReceived(TcpHandle handle, const char* packet, int size) override {
+    auto flow = FindTcpFlow(handle);
+    if (flow == nullptr) {
+      // the responder side
+      Reply(handle, kInvalidUdpHandle, nullptr, packet, size);
+    } else {
+      OnReply(flow, packet, size);
+    }
+    return true;
+  }
+  bool OnTcpError(TcpHandle /*handle*/, int /*error*/) override {
+    ++errors_;
+    return true;
+  }
+  bool OnUdpReceived(UdpHandle /*handle*/, const char* /*packet*/, int /*size*/, const std::string& /*ip*/, int /*port*/) override { return true; }
+  bool OnUdpReceivedFrom(UdpHandle handle, const char* packet, int size, const UdpEndpoint& from) override {
+    auto flow = FindUdpFlow(handle, from);
+    if (flow == nullptr) {
+      Reply(kInvalidTcpHandle, handle, &from, packet, size);
+    } else {
+      OnReply(flow, packet, size);
+    }
+    return true;
+  }
+  bool OnUdpError(UdpHandle /*handle*/, int /*error*/) override {
+    ++errors_;
+    return true;
+  }
+
+ private:
+  bool SetupTcp();
+  bool SetupUdp();
+  void Print(double seconds);
+  Flow* FindTcpFlow(TcpHandle handle) {
+    auto i = tcp_flow_.find(handle);
+    return i == tcp_flow_.end() ? nullptr : i->second;
+  }
+  Flow* FindUdpFlow(UdpHandle handle, const UdpEndpoint& from) {
+    if (config_.mode == kModeFanOut) {
+      if (handle != server_udp_) {
+        return nullptr;
+      }
+      auto i = udp_peer_flow_.find(from);
+      return i == udp_peer_flow_.end() ? nullptr : i->second;
+    }
+    auto i = udp_flow_.find(handle);
+    return i == udp_flow_.end() ? nullptr : i->second;
+  }
+  void Send(Flow* flow) {
+    std::unique_ptr<char[]> packet(new char[config_.size]);
+    auto now = NowNanoseconds();
+    memcpy(packet.get(), &now, sizeof(now));
+    auto sent = config_.udp ? UdpSendTo(flow->udp, std::move(packet), config_.size, flow->peer) :
+      TcpSend(flow->tcp, std::move(packet), config_.size);
+    if (!sent) {
+      --flow->inflight;
+      ++errors_;
+    }
+  }
+  void Fill(Flow* flow) {
+    while (running_ && flow->inflight.fetch_add(1) < config_.depth) {
+      Send(flow);
+    }
+    --flow->inflight;
+  }
+  void Reply(TcpHandle tcp, UdpHandle udp, const UdpEndpoint* to, const char* packet, int size) {
+    auto reply_size = config_.mode == kModeEcho ? size : kAckSize;
+    if (measuring_) {
+      ++messages_;
+      bytes_ += size;
+    }
+    std::unique_ptr<char[]> reply(new char[reply_size]);
+    memcpy(reply.get(), packet, std::min(size, reply_size));
+    if (udp != kInvalidUdpHandle) {
+      UdpSendTo(udp, std::move(reply), reply_size, *to);
+    } else {
+      TcpSend(tcp, std::move(reply), reply_size);
+    }
+  }
+  void OnReply(Flow* flow, const char* packet, int size) {
+    auto now = NowNanoseconds();
+    if (size >= static_cast<int>(sizeof(long long)) && measuring_) {
+      long long sent = 0;
+      memcpy(&sent, packet, sizeof(sent));
+      latency_.Record(now - sent);
+    }
+    flow->last_reply = now;
+    --flow->inflight;
+    Fill(flow);
+  }
+
+ private:
+  BenchConfig config_;
+  std::atomic<bool> running_;
+  std::atomic<bool> measuring_;
+  std::mutex lock_;
+  std::vector<TcpHandle> accepted_handle_;
+  std::atomic<int> accepted_;
+  std::atomic<unsigned long long> messages_;
+  std::atomic<unsigned long long> bytes_;
+  std::atomic<unsigned long long> lost_;
+  std::atomic<unsigned long long> errors_;
+  TcpHandle listen_;
+  std::vector<TcpHandle> client_tcp_;
+  UdpHandle server_udp_;
+  std::vector<UdpHandle> client_udp_;
+  std::vector<std::unique_ptr<Flow>> flow_;
+  // built before the first request, read only afterwards
+  std::unordered_map<TcpHandle, Flow*> tcp_flow_;
+  std::unordered_map<UdpHandle, Flow*> udp_flow_;
+  std::unordered_map<UdpEndpoint, Flow*> udp_peer_flow_;
+  LatencyHistogram latency_;
+};
+
+Flow* NewFlow(std::vector<std::unique_ptr<Flow>>& all_flow) {
+  std::unique_ptr<Flow> flow(new Flow);
+  flow->tcp = kInvalidTcpHandle;
+  flow->udp = kInvalidUdpHandle;
+  memset(&flow->peer, 0, sizeof(flow->peer));
+  flow->inflight = 0;
+  flow->last_reply = NowNanoseconds();
+  all_flow.push_back(std::move(flow));
+  return all_flow.back().get();
+}
+
+bool Bench::SetupTcp() {
+  if (!TcpCreate(this, "127.0.0.1", config_.port, listen_) || !TcpListen(listen_)) {
+    PrintError(config_, "listen on %d failed", config_.port);
+    return false;
+  }
+  for (auto i = 0; i < config_.connections; ++i) {
+    TcpHandle handle = kInvalidTcpHandle;
+    if (!TcpCreate(this, "0.0.0.0", 0, handle) || !TcpConnect(handle, "127.0.0.1", config_.port)) {
+      PrintError(config_, "connect %d failed", i);
+      return false;
+    }
+    client_tcp_.push_back(handle);
+  }
+  for (auto i = 0; i < 500 && accepted_ < config_.connections; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (accepted_ < config_.connections) {
+    PrintError(config_, "only %d of %d connections accepted", accepted_.load(), config_.connections);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto& sender = config_.mode == kModeFanOut ? accepted_handle_ : client_tcp_;
+  for (auto handle : sender) {
+    auto flow = NewFlow(flow_);
+    flow->tcp = handle;
+    tcp_flow_[handle] = flow;
+  }
+  return true;
+}
+
+bool Bench::SetupUdp() {
+  if (!UdpCreate(this, "127.0.0.1", config_.port, server_udp_)) {
+    PrintError(config_, "bind udp %d failed", config_.port);
+    return false;
+  }
+  UdpEndpoint server;
+  UdpMakeEndpoint("127.0.0.1", config_.port, server);
+  for (auto i = 0; i < config_.connections; ++i) {
+    UdpHandle handle = kInvalidUdpHandle;
+    auto port = config_.port + 1 + i;
+    if (!UdpCreate(this, "127.0.0.1", port, handle)) {
+      PrintError(config_, "bind udp %d failed", port);
+      return false;
+    }
+    client_udp_.push_back(handle);
+    auto flow = NewFlow(flow_);
+    if (config_.mode == kModeFanOut) {
+      flow->udp = server_udp_;
+      UdpMakeEndpoint("127.0.0.1", port, flow->peer);
+      udp_peer_flow_[flow->peer] = flow;
+    } else {
+      flow->udp = handle;
+      flow->peer = server;
+      udp_flow_[handle] = flow;
+    }
+  }
+  return true;
+}
+
+bool Bench::Run() {
+  if (!(config_.udp ? SetupUdp() : SetupTcp())) {
+    return false;
+  }
+  running_ = true;
+  for (const auto& i : flow_) {
+    Fill(i.get());
+  }
+  auto start = NowNanoseconds();
+  auto measure_start = start + static_cast<long long>(config_.warmup * 1e9);
+  auto stop = measure_start + static_cast<long long>(config_.duration * 1e9);
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    auto now = NowNanoseconds();
+    if (!measuring_ && now >= measure_start) {
+      measuring_ = true;
+    }
+    if (now >= stop) {
+      break;
+    }
+    if (!config_.udp) {
+      continue;
+    }
+    // a datagram lost on the way stalls its flow, the window is counted lost and refilled
+    for (const auto& i : flow_) {
+      auto flow = i.get();
+      if (flow->inflight > 0 && now - flow->last_reply > kUdpLossTimeout) {
+        lost_ += flow->inflight.exchange(0);
+        flow->last_reply = now;
+        Fill(flow);
+      }
+    }
+  }
+  measuring_ = false;
+  running_ = false;
+  Print(config_.duration);
+  return true;
+}
+
+void Bench::Print(double seconds) {
+  printf("{\"proto\":\"%s\",\"mode\":\"%s\",\"connections\":%d,\"size\":%d,\"depth\":%d,\"threads\":%d,\"per_core\":%s,"
+    "\"seconds\":%.3f,\"messages\":%llu,\"msgs_per_sec\":%.1f,\"gbit_per_sec\":%.4f,"
+    "\"p50_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f,\"lost\":%llu,\"errors\":%llu}\n",
+    config_.udp ? "udp" : "tcp", kModeName[config_.mode], config_.connections, config_.size, config_.depth,
+    config_.threads, config_.per_core ? "true" : "false", seconds, messages_.load(), messages_ / seconds,
+    bytes_ * 8.0 / seconds / 1e9, latency_.Quantile(0.5) / 1e3, latency_.Quantile(0.99) / 1e3,
+    latency_.Quantile(0.999) / 1e3, lost_.load(), errors_.load());
+  fflush(stdout);
+}
+
+std::vector<int> ParseList(const char* text) {
+  std::vector<int> all_value;
+  std::string list = text;
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    auto end = list.find(',', begin);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    auto item = list.substr(begin, end - begin);
+    if (!item.empty()) {
+      auto value = atoll(item.c_str());
+      auto unit = item.back();
+      if (unit == 'k' || unit == 'K') {
+        value *= 1024;
+      } else if (unit == 'm' || unit == 'M') {
+        value *= 1024 * 1024;
+      }
+      all_value.push_back(static_cast<int>(value));
+    }
+    begin = end + 1;
+  }
+  return all_value;
+}
+
+void Usage() {
+  fprintf(stderr,
+    "usage: net_bench [options], list options take comma separated values and every combination runs\n"
+    "  --proto=tcp|udp         default tcp\n"
+    "  --mode=echo|fanin|fanout default echo\n"
+    "  --connections=LIST      clients, default 1\n"
+    "  --size=LIST             message bytes, k and m suffixes, 16 to 16m (udp 65507), default 64\n"
+    "  --depth=LIST            requests in flight per client, default 1\n"
+    "  --threads=LIST          io threads, 0 keeps the library default\n"
+    "  --per-core              one pinned io loop per processor\n"
+    "  --warmup=SECONDS        default 1\n"
+    "  --duration=SECONDS      measured time, default 5\n"
+    "  --port=PORT             first port, udp clients take the ones after it, default 19500\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  BenchConfig config = {false, kModeEcho, 1, 64, 1, 0, false, 1.0, 5.0, 19500};
+  std::vector<int> all_connections(1, 1);
+  std::vector<int> all_size(1, 64);
+  std::vector<int> all_depth(1, 1);
+  std::vector<int> all_threads(1, 0);
+  for (auto i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto equal = arg.find('=');
+    auto name = arg.substr(0, equal);
+    auto value = equal == std::string::npos ? std::string() : arg.substr(equal + 1);
+    if (name == "--proto" && (value == "tcp" || value == "udp")) {
+      config.udp = value == "udp";
+    } else if (name == "--mode" && (value == "echo" || value == "fanin" || value == "fanout")) {
+      config.mode = value == "echo" ? kModeEcho : (value == "fanin" ? kModeFanIn : kModeFanOut);
+    } else if (name == "--connections") {
+      all_connections = ParseList(value.c_str());
+    } else if (name == "--size") {
+      all_size = ParseList(value.c_str());
+    } else if (name == "--depth") {
+      all_depth = ParseList(value.c_str());
+    } else if (name == "--threads") {
+      all_threads = ParseList(value.c_str());
+    } else if (name == "--per-core") {
+      config.per_core = true;
+    } else if (name == "--warmup") {
+      config.warmup = atof(value.c_str());
+    } else if (name == "--duration") {
+      config.duration = atof(value.c_str());
+    } else if (name == "--port") {
+      config.port = atoi(value.c_str());
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  auto largest = *std::max_element(all_size.begin(), all_size.end());
+  auto smallest = *std::min_element(all_size.begin(), all_size.end());
+  if (all_connections.empty() || all_depth.empty() || all_threads.empty() || smallest < kStampSize ||
+    largest > (config.udp ? kMaxUdpBenchSize : kMaxTcpPacketSize) || config.duration <= 0) {
+    Usage();
+    return 1;
+  }
+  // the buffer sizes can not change between startups, they are sized for the largest run
+  NetOptions options = NetOptions();
+  options.udp_buffer_size = config.udp ? std::max(largest, kMaxUdpPacketSize) : 0;
+  // every client connects at once, keep an accept posted for each of them
+  options.accept_count = *std::max_element(all_connections.begin(), all_connections.end());
+  for (auto threads : all_threads) {
+    for (auto connections : all_connections) {
+      for (auto size : all_size) {
+        for (auto depth : all_depth) {
+          config.threads = threads;
+          config.connections = connections;
+          config.size = size;
+          config.depth = depth;
+          options.thread_count = threads;
+          options.per_core = config.per_core;
+          if (!StartupNet(options)) {
+            PrintError(config, "startup net failed");
+            return 1;
+          }
+          {
+            Bench bench(config);
+            auto ok = bench.Run();
+            CleanupNet();
+            if (!ok) {
+              return 1;
+            }
+          }
+          // ports of the last run may linger a moment
+          ++config.port;
+          config.port += config.udp ? connections : 0;
+        }
+      }
+    }
+  }
+  return 0;
+}
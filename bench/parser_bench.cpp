@@ -0,0 +1,359 @@
+/************************************************************************/
+/*  Receive parser benchmark                                            */
+/*  feeds TcpSocket::OnRecv in process, no sockets, one json line each  */
+/************************************************************************/
+
+#include "buffer_pool.h"
+#include "crc32c.h"
+#include "tcp_buffer.h"
+#include "tcp_header.h"
+#include "tcp_socket.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace net;
+
+namespace {
+
+std::atomic<unsigned long long> g_allocation(0);
+
+} // namespace
+
+// every allocation of the process is counted, the parser's included. gcc takes the
+// replaced operators for the library ones and warns about free on their memory
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(size_t size) {
+  g_allocation.fetch_add(1, std::memory_order_relaxed);
+  auto memory = malloc(size == 0 ? 1 : size);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+void operator delete(void* memory) noexcept {
+  free(memory);
+}
+void operator delete[](void* memory) noexcept {
+  free(memory);
+}
+void operator delete(void* memory, size_t) noexcept {
+  free(memory);
+}
+void operator delete[](void* memory, size_t) noexcept {
+  free(memory);
+}
+
+namespace {
+
+// a stream of framed packets and the receive sizes it is cut into
+struct Corpus {
+  std::string name;
+  std::vector<int> packet_size;
+  std::vector<std::vector<int>> all_read;   // one read plan per pass, each covers the whole stream
+  std::vector<char> stream;
+};
+
+char PayloadByte(int packet, int offset) {
+  return static_cast<char>((packet * 131 + offset * 7) & 0xff);
+}
+
+void BuildStream(Corpus& corpus, bool checksum) {
+  size_t total = 0;
+  for (auto size : corpus.packet_size) {
+    total += kTcpHeaderSize + size;
+  }
+  corpus.stream.resize(total);
+  auto data = corpus.stream.data();
+  for (auto i = 0; i < static_cast<int>(corpus.packet_size.size()); ++i) {
+    auto size = corpus.packet_size[i];
+    auto payload = data + kTcpHeaderSize;
+    for (auto j = 0; j < size; ++j) {
+      payload[j] = PayloadByte(i, j);
+    }
+    TcpHeader header;
+    if (checksum) {
+      header.Init(size, Crc32c(payload, size));
+    } else {
+      header.Init(size);
+    }
+    memcpy(data, &header, kTcpHeaderSize);
+    data = payload + size;
+  }
+}
+
+std::vector<int> EvenReads(size_t total, int read) {
+  std::vector<int> all_read(total / read, read);
+  if (total % read != 0) {
+    all_read.push_back(static_cast<int>(total % read));
+  }
+  return all_read;
+}
+
+// fixed seed, every run sees the same corpus
+unsigned int NextRandom(unsigned int& seed) {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) & 0xffffff;
+}
+
+size_t StreamSize(const std::vector<int>& packet_size) {
+  size_t total = 0;
+  for (auto size : packet_size) {
+    total += kTcpHeaderSize + size;
+  }
+  return total;
+}
+
+std::vector<Corpus> MakeCorpus(int ring) {
+  std::vector<Corpus> all_corpus;
+  unsigned int seed = 20240601;
+  {
+    // two packets cut in two at every byte, headers and payloads split everywhere
+    Corpus corpus;
+    corpus.name = "split_points";
+    corpus.packet_size = {200, 300};
+    auto total = static_cast<int>(StreamSize(corpus.packet_size));
+    for (auto split = 1; split < total; ++split) {
+      corpus.all_read.push_back({split, total - split});
+    }
+    all_corpus.push_back(corpus);
+  }
+  {
+    Corpus corpus;
+    corpus.name = "dribble_1b";
+    for (auto i = 0; i < 64; ++i) {
+      corpus.packet_size.push_back(1 + NextRandom(seed) % 300);
+    }
+    corpus.all_read.push_back(std::vector<int>(StreamSize(corpus.packet_size), 1));
+    all_corpus.push_back(corpus);
+  }
+  {
+    // odd read sizes walk headers and packets across the end of the ring
+    Corpus corpus;
+    corpus.name = "odd_reads";
+    for (auto i = 0; i < 4096; ++i) {
+      corpus.packet_size.push_back(1 + NextRandom(seed) % 2048);
+    }
+    auto total = StreamSize(corpus.packet_size);
+    std::vector<int> all_read;
+    for (size_t done = 0; done < total;) {
+      auto read = std::min<size_t>(1 + NextRandom(seed) % 4096, total - done);
+      all_read.push_back(static_cast<int>(read));
+      done += read;
+    }
+    corpus.all_read.push_back(all_read);
+    all_corpus.push_back(corpus);
+  }
+  {
+    // full ring reads, packets straddle every read and wrap the ring
+    Corpus corpus;
+    corpus.name = "straddle_64k";
+    for (auto i = 0; i < 4096; ++i) {
+      corpus.packet_size.push_back(1500 + NextRandom(seed) % 7500);
+    }
+    corpus.all_read.push_back(EvenReads(StreamSize(corpus.packet_size), 64 * 1024));
+    all_corpus.push_back(corpus);
+  }
+  {
+    Corpus corpus;
+    corpus.name = "small_bulk";
+    corpus.packet_size.assign(16384, 64);
+    corpus.all_read.push_back(EvenReads(StreamSize(corpus.packet_size), ring));
+    all_corpus.push_back(corpus);
+  }
+  {
+    // larger than the ring, collected in a buffer of their own
+    Corpus corpus;
+    corpus.name = "large_16m";
+    corpus.packet_size.assign(4, 16 * 1024 * 1024 - kTcpHeaderSize);
+    corpus.all_read.push_back(EvenReads(StreamSize(corpus.packet_size), 64 * 1024));
+    all_corpus.push_back(corpus);
+  }
+  return all_corpus;
+}
+
+// hands the reads to OnRecv the way a receive completion does: a read never exceeds the
+// free ring space and lands at the write position, wrapping around the end
+class Feeder {
+ public:
+  Feeder(TcpSocket& socket, TcpRecvBuffer* ring) : socket_(socket), ring_(ring) {}
+
+  // returns the packets parsed, -1 on a parse failure or a packet differing from the stream
+  long long Feed(const Corpus& corpus, const std::vector<int>& all_read, bool verify) {
+    auto data = corpus.stream.data();
+    long long packet_count = 0;
+    next_packet_ = 0;
+    next_offset_ = 0;
+    for (auto read : all_read) {
+      while (read > 0) {
+        auto size = std::min(read, ring_->free_size());
+        auto first = std::min(size, ring_->write_contiguous());
+        memcpy(ring_->write_pos(), data, first);
+        memcpy(ring_->buffer(), data + first, size - first);
+        if (!socket_.OnRecv(ring_, size)) {
+          return -1;
+        }
+        const auto& all_packet = socket_.all_packets();
+        const auto& all_chunk = socket_.all_chunks();
+        if (verify && !Verify(corpus, all_packet, all_chunk)) {
+          return -1;
+        }
+        packet_count += all_packet.size();
+        for (const auto& chunk : all_chunk) {
+          packet_count += chunk.last ? 1 : 0;
+        }
+        socket_.OnRecvDone();
+        data += size;
+        read -= size;
+      }
+    }
+    return packet_count;
+  }
+
+ private:
+  // in the order OnTcpRecv hands them out: the whole packets before each chunk, then the chunk
+  bool Verify(const Corpus& corpus, const std::vector<PacketView>& all_packet, const std::vector<TcpChunk>& all_chunk) {
+    size_t done = 0;
+    for (const auto& chunk : all_chunk) {
+      for (; done < chunk.packet_index; ++done) {
+        if (!VerifyPiece(corpus, 0, all_packet[done].packet, all_packet[done].size, true)) {
+          return false;
+        }
+      }
+      if (!VerifyPiece(corpus, chunk.offset, chunk.data, chunk.size, chunk.last)) {
+        return false;
+      }
+    }
+    for (; done < all_packet.size(); ++done) {
+      if (!VerifyPiece(corpus, 0, all_packet[done].packet, all_packet[done].size, true)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool VerifyPiece(const Corpus& corpus, int offset, const char* data, int size, bool last) {
+    if (next_packet_ >= static_cast<int>(corpus.packet_size.size()) || offset != next_offset_ ||
+      (last && offset + size != corpus.packet_size[next_packet_]) || (!last && offset + size >= corpus.packet_size[next_packet_])) {
+      return false;
+    }
+    for (auto j = 0; j < size; ++j) {
+      if (data[j] != PayloadByte(next_packet_, offset + j)) {
+        return false;
+      }
+    }
+    next_offset_ = last ? 0 : offset + size;
+    next_packet_ += last ? 1 : 0;
+    return true;
+  }
+
+ private:
+  TcpSocket& socket_;
+  TcpRecvBuffer* ring_;
+  int next_packet_;
+  int next_offset_;
+};
+
+long long NowNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool RunCorpus(const Corpus& corpus, bool checksum, int chunk, double seconds) {
+  TcpSocket socket;
+  socket.set_max_packet_size(kMaxTcpPacketSize);
+  auto options = socket.options();
+  options.chunk_threshold = chunk;
+  socket.set_options(options);
+  auto ring = BufferPool<TcpRecvBuffer>::Instance()->Get();
+  Feeder feeder(socket, ring);
+  // one verified pass first, then timed passes without the payload compare
+  auto ok = true;
+  for (const auto& all_read : corpus.all_read) {
+    if (feeder.Feed(corpus, all_read, true) != static_cast<long long>(corpus.packet_size.size())) {
+      ok = false;
+      break;
+    }
+  }
+  unsigned long long packet_count = 0;
+  unsigned long long pass_count = 0;
+  auto allocation = g_allocation.load();
+  auto start = NowNanoseconds();
+  auto stop = start + static_cast<long long>(seconds * 1e9);
+  auto now = start;
+  while (ok && (pass_count == 0 || now < stop)) {
+    for (const auto& all_read : corpus.all_read) {
+      auto parsed = feeder.Feed(corpus, all_read, false);
+      if (parsed < 0) {
+        ok = false;
+        break;
+      }
+      packet_count += parsed;
+    }
+    ++pass_count;
+    now = NowNanoseconds();
+  }
+  allocation = g_allocation.load() - allocation;
+  BufferPool<TcpRecvBuffer>::Instance()->Return(ring);
+  auto per_packet = packet_count > 0 ? 1.0 / packet_count : 0.0;
+  printf("{\"corpus\":\"%s\",\"checksum\":%s,\"chunk\":%d,\"ok\":%s,\"passes\":%llu,\"packets\":%llu,\"bytes\":%llu,"
+    "\"ns_per_packet\":%.2f,\"allocs_per_packet\":%.4f,\"gbit_per_sec\":%.3f}\n",
+    corpus.name.c_str(), checksum ? "true" : "false", chunk, ok ? "true" : "false", pass_count, packet_count,
+    static_cast<unsigned long long>(corpus.stream.size()) * corpus.all_read.size() * pass_count,
+    (now - start) * per_packet, allocation * per_packet,
+    (now - start) > 0 ? corpus.stream.size() * corpus.all_read.size() * pass_count * 8.0 / (now - start) : 0.0);
+  fflush(stdout);
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto checksum = false;
+  auto chunk = 0;
+  auto seconds = 1.0;
+  auto ring = kTcpBufferSize;
+  std::string only;
+  for (auto i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--checksum") {
+      checksum = true;
+    } else if (arg.compare(0, 8, "--chunk=") == 0) {
+      chunk = atoi(arg.c_str() + 8);
+    } else if (arg.compare(0, 10, "--seconds=") == 0) {
+      seconds = atof(arg.c_str() + 10);
+    } else if (arg.compare(0, 7, "--ring=") == 0) {
+      ring = atoi(arg.c_str() + 7);
+    } else if (arg.compare(0, 9, "--corpus=") == 0) {
+      only = arg.substr(9);
+    } else {
+      fprintf(stderr, "usage: parser_bench [--checksum] [--chunk=BYTES] [--seconds=S] [--ring=BYTES] [--corpus=NAME]\n");
+      return 1;
+    }
+  }
+  if (ring <= 0 || (ring & (ring - 1)) != 0) {
+    fprintf(stderr, "the ring size has to be a power of two\n");
+    return 1;
+  }
+  BufferPool<TcpRecvBuffer>::Instance()->SetTailSize(ring);
+  BufferPool<TcpStitchBuffer>::Instance()->SetTailSize(ring);
+  auto ok = true;
+  for (auto& corpus : MakeCorpus(ring)) {
+    if (!only.empty() && corpus.name != only) {
+      continue;
+    }
+    BuildStream(corpus, checksum);
+    ok = RunCorpus(corpus, checksum, chunk, seconds) && ok;
+  }
+  return ok ? 0 : 1;
+}
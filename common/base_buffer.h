@@ -1,8 +1,8 @@
 #ifndef NET_BASE_BUFFER_H_
 #define NET_BASE_BUFFER_H_
 
+#include "platform.h"
 #include "uncopyable.h"
-#include <WinSock2.h>
 
 namespace net {
 
@@ -11,6 +11,9 @@ const int kAsyncTypeTcpSend = 2;
 const int kAsyncTypeTcpRecv = 3;
 const int kAsyncTypeUdpSend = 4;
 const int kAsyncTypeUdpRecv = 5;
+const int kAsyncTypeTcpFlush = 6;
+const int kAsyncTypeTcpConnect = 7;
+const int kAsyncTypeUdpRecvBatch = 8;
 
 class BaseBuffer : public utility::Uncopyable {
  public:
@@ -0,0 +1,261 @@
+#ifndef NET_BUFFER_POOL_H_
+#define NET_BUFFER_POOL_H_
+
+#include "net.h"
+#include "uncopyable.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+namespace net {
+
+const int kPoolSlabBytes = 256 * 1024;
+const int kMaxPoolSlabSize = 256;
+
+// fixed size object pool: every thread keeps a private free list, objects are carved
+// out of slabs and never given back to the system while the process lives.
+// a pool may place a run time sized tail behind every object, the object reaches it
+// through tail(this) and learns its size from tail_size()
+// a thread cache above the high watermark hands a batch down to the low watermark
+// to a lock free overflow list, an empty cache takes a whole batch back from it
+template <class T>
+class BufferPool : public utility::Uncopyable {
+ public:
+  static BufferPool* Instance() {
+    static BufferPool pool;
+    return &pool;
+  }
+
+  T* Get() {
+    auto& cache = ThreadCache::Local();
+    Increase(cache.get_count);
+    if (cache.head != nullptr) {
+      Increase(cache.cache_hit);
+    } else if (!Refill(cache)) {
+      return nullptr;
+    }
+    auto node = cache.head;
+    cache.head = node->link.next;
+    --cache.count;
+    return new (&node->storage) T;
+  }
+  void Return(T* object) {
+    if (object == nullptr) {
+      return;
+    }
+    object->~T();
+    auto node = reinterpret_cast<Node*>(object);
+    auto& cache = ThreadCache::Local();
+    Increase(cache.return_count);
+    node->link.next = cache.head;
+    cache.head = node;
+    ++cache.count;
+    if (cache.count > high_.load(std::memory_order_relaxed)) {
+      Trim(cache, low_.load(std::memory_order_relaxed));
+    }
+  }
+
+  bool SetOptions(const NetPoolOptions& options) {
+    if (options.slab_size <= 0 || options.cache_low < 0 || options.cache_high < options.cache_low) {
+      return false;
+    }
+    slab_size_ = options.slab_size;
+    low_ = options.cache_low;
+    high_ = options.cache_high;
+    options_set_ = true;
+    return true;
+  }
+  // only before the first slab is carved, objects handed out keep the tail they were carved with
+  bool SetTailSize(int size) {
+    std::lock_guard<std::mutex> lock(slab_lock_);
+    if (size < 0 || !slab_.empty()) {
+      return size == tail_size_;
+    }
+    tail_size_ = size;
+    node_unit_ = static_cast<int>((sizeof(T) + size + sizeof(Node) - 1) / sizeof(Node));
+    if (!options_set_) {
+      SetDefaultOptions();
+    }
+    return true;
+  }
+  int tail_size() { return tail_size_; }
+  static char* tail(T* object) { return reinterpret_cast<char*>(object) + sizeof(T); }
+  void GetStats(NetPoolStats& stats) {
+    std::lock_guard<std::mutex> lock(cache_lock_);
+    stats.get_count = retired_get_;
+    stats.cache_hit = retired_hit_;
+    auto return_count = retired_return_;
+    for (const auto& i : cache_) {
+      stats.get_count += i->get_count.load(std::memory_order_relaxed);
+      stats.cache_hit += i->cache_hit.load(std::memory_order_relaxed);
+      return_count += i->return_count.load(std::memory_order_relaxed);
+    }
+    stats.global_hit = global_hit_;
+    stats.slab_count = slab_count_;
+    stats.capacity = capacity_;
+    stats.in_use = stats.get_count > return_count ? stats.get_count - return_count : 0;
+  }
+
+ private:
+  union Node;
+  struct Link {
+    Node* next;
+    Node* next_batch;
+  };
+  union Node {
+    Link link;
+    typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+  };
+
+  struct ThreadCache {
+    Node* head;
+    int count;
+    // written by the owner thread only, read by GetStats
+    std::atomic<unsigned long long> get_count;
+    std::atomic<unsigned long long> cache_hit;
+    std::atomic<unsigned long long> return_count;
+
+    static ThreadCache& Local() {
+      static thread_local ThreadCache cache;
+      return cache;
+    }
+    ThreadCache() : head(nullptr), count(0), get_count(0), cache_hit(0), return_count(0) {
+      Instance()->Register(this);
+    }
+    ~ThreadCache() {
+      auto pool = Instance();
+      pool->Trim(*this, 0);
+      pool->Unregister(this);
+    }
+  };
+
+  static const int kPointerBits = sizeof(void*) == 8 ? 48 : 32;
+  static const uint64_t kPointerMask = (static_cast<uint64_t>(1) << kPointerBits) - 1;
+
+  BufferPool() : global_(0), global_hit_(0), slab_count_(0), capacity_(0), options_set_(false),
+    tail_size_(0), node_unit_(1), retired_get_(0), retired_hit_(0), retired_return_(0) {
+    SetDefaultOptions();
+  }
+  ~BufferPool() {
+    for (const auto& i : slab_) {
+      delete[] i;
+    }
+  }
+
+  void SetDefaultOptions() {
+    auto slab_size = std::max(4, std::min(kMaxPoolSlabSize, static_cast<int>(kPoolSlabBytes / (sizeof(Node) * node_unit_))));
+    slab_size_ = slab_size;
+    low_ = slab_size;
+    high_ = slab_size * 2;
+  }
+  static void Increase(std::atomic<unsigned long long>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  static uint64_t Pack(Node* node, uint64_t tag) {
+    return (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(node)) & kPointerMask) | (tag << kPointerBits);
+  }
+  static Node* Unpack(uint64_t value) {
+    return reinterpret_cast<Node*>(static_cast<uintptr_t>(value & kPointerMask));
+  }
+
+  // the tag bumped on every exchange keeps a recycled batch head from passing the compare
+  void PushBatch(Node* batch) {
+    auto top = global_.load(std::memory_order_relaxed);
+    do {
+      batch->link.next_batch = Unpack(top);
+    } while (!global_.compare_exchange_weak(top, Pack(batch, (top >> kPointerBits) + 1), std::memory_order_release, std::memory_order_relaxed));
+  }
+  Node* PopBatch() {
+    auto top = global_.load(std::memory_order_acquire);
+    while (Unpack(top) != nullptr) {
+      auto next = Unpack(top)->link.next_batch;
+      if (global_.compare_exchange_weak(top, Pack(next, (top >> kPointerBits) + 1), std::memory_order_acquire, std::memory_order_acquire)) {
+        return Unpack(top);
+      }
+    }
+    return nullptr;
+  }
+
+  bool Refill(ThreadCache& cache) {
+    auto batch = PopBatch();
+    if (batch != nullptr) {
+      ++global_hit_;
+      cache.head = batch;
+      for (auto node = batch; node != nullptr; node = node->link.next) {
+        ++cache.count;
+      }
+      return true;
+    }
+    auto slab_size = slab_size_.load(std::memory_order_relaxed);
+    // an object with its tail spans node_unit_ nodes, only the first one is linked
+    auto slab = new (std::nothrow) Node[slab_size * node_unit_];
+    if (slab == nullptr) {
+      return false;
+    }
+    for (auto i = 0; i < slab_size; ++i) {
+      slab[i * node_unit_].link.next = i + 1 < slab_size ? &slab[(i + 1) * node_unit_] : cache.head;
+    }
+    cache.head = slab;
+    cache.count += slab_size;
+    {
+      std::lock_guard<std::mutex> lock(slab_lock_);
+      slab_.push_back(slab);
+    }
+    ++slab_count_;
+    capacity_ += slab_size;
+    return true;
+  }
+  void Trim(ThreadCache& cache, int keep) {
+    if (cache.count <= keep) {
+      return;
+    }
+    auto batch = cache.head;
+    auto tail = batch;
+    for (auto i = cache.count - keep; i > 1; --i) {
+      tail = tail->link.next;
+    }
+    cache.head = tail->link.next;
+    cache.count = keep;
+    tail->link.next = nullptr;
+    PushBatch(batch);
+  }
+
+  void Register(ThreadCache* cache) {
+    std::lock_guard<std::mutex> lock(cache_lock_);
+    cache_.push_back(cache);
+  }
+  void Unregister(ThreadCache* cache) {
+    std::lock_guard<std::mutex> lock(cache_lock_);
+    retired_get_ += cache->get_count;
+    retired_hit_ += cache->cache_hit;
+    retired_return_ += cache->return_count;
+    cache_.erase(std::remove(cache_.begin(), cache_.end(), cache), cache_.end());
+  }
+
+ private:
+  std::atomic<uint64_t> global_;
+  std::atomic<int> slab_size_;
+  std::atomic<int> low_;
+  std::atomic<int> high_;
+  std::atomic<unsigned long long> global_hit_;
+  std::atomic<unsigned long long> slab_count_;
+  std::atomic<unsigned long long> capacity_;
+  bool options_set_;
+  int tail_size_;
+  int node_unit_;
+  std::mutex slab_lock_;
+  std::vector<Node*> slab_;
+  std::mutex cache_lock_;
+  std::vector<ThreadCache*> cache_;
+  unsigned long long retired_get_;
+  unsigned long long retired_hit_;
+  unsigned long long retired_return_;
+};
+
+} // namespace net
+
+#endif	// NET_BUFFER_POOL_H_
@@ -0,0 +1,55 @@
+#ifndef NET_CHANNEL_TABLE_H_
+#define NET_CHANNEL_TABLE_H_
+
+#include "platform.h"
+#include "uncopyable.h"
+#include <atomic>
+
+namespace net {
+
+// per socket state of the linux completion emulation, indexed by descriptor number.
+// channels are never freed while the table lives, so a stale completion or event
+// can always be checked against the channel generation safely
+template <class Channel>
+class ChannelTable : public utility::Uncopyable {
+ public:
+  static const int kChunkSize = 1024;
+  static const int kMaxChunk = 1024;
+
+  ChannelTable() {
+    for (auto i = 0; i < kMaxChunk; ++i) {
+      chunk_[i] = nullptr;
+    }
+  }
+  ~ChannelTable() {
+    for (auto i = 0; i < kMaxChunk; ++i) {
+      delete[] chunk_[i].load();
+    }
+  }
+  Channel* Get(SOCKET socket, bool create) {
+    if (socket < 0 || socket >= kChunkSize * kMaxChunk) {
+      return nullptr;
+    }
+    auto& chunk = chunk_[socket / kChunkSize];
+    auto channels = chunk.load(std::memory_order_acquire);
+    if (channels == nullptr) {
+      if (!create) {
+        return nullptr;
+      }
+      auto new_channels = new Channel[kChunkSize];
+      if (chunk.compare_exchange_strong(channels, new_channels, std::memory_order_acq_rel)) {
+        channels = new_channels;
+      } else {
+        delete[] new_channels;
+      }
+    }
+    return &channels[socket % kChunkSize];
+  }
+
+ private:
+  std::atomic<Channel*> chunk_[kMaxChunk];
+};
+
+} // namespace net
+
+#endif	// NET_CHANNEL_TABLE_H_
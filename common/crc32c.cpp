@@ -0,0 +1,138 @@
+#include "crc32c.h"
+#include <stdint.h>
+#include <string.h>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NET_CRC32C_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace net {
+
+namespace {
+
+const uint32_t kCrc32cPolynomial = 0x82f63b78;
+
+class SliceTable {
+ public:
+  SliceTable() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      auto crc = i;
+      for (auto bit = 0; bit < 8; ++bit) {
+        crc = (crc & 1) ? (crc >> 1) ^ kCrc32cPolynomial : crc >> 1;
+      }
+      table_[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (auto slice = 1; slice < 8; ++slice) {
+        table_[slice][i] = (table_[slice - 1][i] >> 8) ^ table_[0][table_[slice - 1][i] & 0xff];
+      }
+    }
+  }
+  uint32_t Update(uint32_t crc, const unsigned char* data, size_t size) const {
+    while (size >= 8) {
+      uint32_t low = 0;
+      uint32_t high = 0;
+      memcpy(&low, data, 4);
+      memcpy(&high, data + 4, 4);
+      low = LittleEndian(low) ^ crc;
+      high = LittleEndian(high);
+      crc = table_[7][low & 0xff] ^ table_[6][(low >> 8) & 0xff] ^ table_[5][(low >> 16) & 0xff] ^ table_[4][low >> 24] ^
+        table_[3][high & 0xff] ^ table_[2][(high >> 8) & 0xff] ^ table_[1][(high >> 16) & 0xff] ^ table_[0][high >> 24];
+      data += 8;
+      size -= 8;
+    }
+    while (size > 0) {
+      crc = (crc >> 8) ^ table_[0][(crc ^ *data) & 0xff];
+      ++data;
+      --size;
+    }
+    return crc;
+  }
+
+ private:
+  static uint32_t LittleEndian(uint32_t value) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+  }
+
+  uint32_t table_[8][256];
+};
+
+const SliceTable g_slice_table;
+
+uint32_t UpdateSoftware(uint32_t crc, const unsigned char* data, size_t size) {
+  return g_slice_table.Update(crc, data, size);
+}
+
+#ifdef NET_CRC32C_X86
+
+#ifndef _MSC_VER
+__attribute__((target("sse4.2")))
+#endif
+uint32_t UpdateHardware(uint32_t crc, const unsigned char* data, size_t size) {
+#if defined(_M_X64) || defined(__x86_64__)
+  uint64_t crc64 = crc;
+  while (size >= 8) {
+    uint64_t value = 0;
+    memcpy(&value, data, 8);
+    crc64 = _mm_crc32_u64(crc64, value);
+    data += 8;
+    size -= 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+#endif
+  while (size >= 4) {
+    uint32_t value = 0;
+    memcpy(&value, data, 4);
+    crc = _mm_crc32_u32(crc, value);
+    data += 4;
+    size -= 4;
+  }
+  while (size > 0) {
+    crc = _mm_crc32_u8(crc, *data);
+    ++data;
+    --size;
+  }
+  return crc;
+}
+
+bool HasSse42() {
+#ifdef _MSC_VER
+  int info[4] = {0};
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+
+#endif // NET_CRC32C_X86
+
+typedef uint32_t (*UpdateFunction)(uint32_t crc, const unsigned char* data, size_t size);
+
+UpdateFunction SelectUpdate() {
+#ifdef NET_CRC32C_X86
+  if (HasSse42()) {
+    return UpdateHardware;
+  }
+#endif
+  return UpdateSoftware;
+}
+
+const UpdateFunction g_update = SelectUpdate();
+
+} // namespace
+
+unsigned int Crc32c(const char* data, size_t size) {
+  return g_update(0xffffffff, reinterpret_cast<const unsigned char*>(data), size) ^ 0xffffffff;
+}
+
+unsigned int Crc32cExtend(unsigned int crc, const char* data, size_t size) {
+  return g_update(crc ^ 0xffffffff, reinterpret_cast<const unsigned char*>(data), size) ^ 0xffffffff;
+}
+
+} // namespace net
@@ -0,0 +1,15 @@
+#ifndef NET_CRC32C_H_
+#define NET_CRC32C_H_
+
+#include <stddef.h>
+
+namespace net {
+
+// crc32c (castagnoli) of a buffer, the sse4.2 crc32 instruction when the cpu has it, slice-by-8 otherwise
+unsigned int Crc32c(const char* data, size_t size);
+// the crc32c of the bytes crc was computed over followed by data, Crc32cExtend(0, ...) is Crc32c
+unsigned int Crc32cExtend(unsigned int crc, const char* data, size_t size);
+
+} // namespace net
+
+#endif	// NET_CRC32C_H_
@@ -0,0 +1,198 @@
+#include "flight_recorder.h"
+#include "log.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace net {
+
+namespace {
+
+unsigned long long SteadyNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifndef _WIN32
+// the handler only writes a byte here, write is async signal safe
+int g_signal_pipe[2] = {-1, -1};
+
+void OnDumpSignal(int) {
+  auto saved_errno = errno;
+  char wake = 1;
+  auto written = write(g_signal_pipe[1], &wake, 1);
+  (void)written;
+  errno = saved_errno;
+}
+#endif // _WIN32
+
+} // namespace
+
+FlightRecorder::Ring::Ring() : next(0), thread(0) {
+  for (auto& i : slot) {
+    for (auto& j : i) {
+      j = 0;
+    }
+  }
+  Instance()->Register(this);
+}
+
+FlightRecorder::Ring::~Ring() {
+  Instance()->Unregister(this);
+}
+
+FlightRecorder::FlightRecorder() : start_tick_(FlightTick()), start_ns_(SteadyNs()), next_thread_(0),
+  signal_(0), dump_count_(0), dump_thread_(false) {
+}
+
+void FlightRecorder::Register(Ring* ring) {
+  std::lock_guard<std::mutex> lock(ring_lock_);
+  ring->thread = next_thread_++;
+  ring_.push_back(ring);
+}
+
+// the events of an exited thread go with it
+void FlightRecorder::Unregister(Ring* ring) {
+  std::lock_guard<std::mutex> lock(ring_lock_);
+  ring_.erase(std::remove(ring_.begin(), ring_.end(), ring), ring_.end());
+}
+
+bool FlightRecorder::Dump(const std::string& path) {
+  FlightDumpHeader header;
+  memcpy(header.magic, kFlightMagic, sizeof(header.magic));
+  header.version = kFlightVersion;
+  std::vector<FlightThreadHeader> all_thread;
+  std::vector<std::vector<FlightEvent>> all_event;
+  {
+    std::lock_guard<std::mutex> lock(ring_lock_);
+    for (auto ring : ring_) {
+      auto before = ring->next.load(std::memory_order_acquire);
+      std::vector<FlightEvent> copy(kFlightRingEvents);
+      for (auto i = 0; i < kFlightRingEvents; ++i) {
+        auto slot = ring->slot[i];
+        auto size = slot[2].load(std::memory_order_relaxed);
+        copy[i].tsc = slot[0].load(std::memory_order_relaxed);
+        copy[i].handle = slot[1].load(std::memory_order_relaxed);
+        copy[i].bytes = static_cast<unsigned int>(size);
+        copy[i].duration = static_cast<unsigned int>(size >> 32);
+        copy[i].type = static_cast<unsigned int>(slot[3].load(std::memory_order_relaxed));
+        copy[i].reserved = 0;
+      }
+      // orders the relaxed slot loads before the load of after, or a slot overwritten
+      // during the copy could pass for one written before it
+      std::atomic_thread_fence(std::memory_order_acquire);
+      auto after = ring->next.load(std::memory_order_acquire);
+      // a slot written during the copy, or being written now, no longer holds its old event
+      const unsigned long long kCount = kFlightRingEvents;
+      auto first = std::max(before > kCount ? before - kCount : 0, after + 1 > kCount ? after + 1 - kCount : 0);
+      std::vector<FlightEvent> event;
+      for (auto i = first; i < before; ++i) {
+        event.push_back(copy[i & (kFlightRingEvents - 1)]);
+      }
+      FlightThreadHeader thread = {ring->thread, static_cast<unsigned int>(event.size())};
+      all_thread.push_back(thread);
+      all_event.push_back(event);
+    }
+  }
+  header.thread_count = static_cast<unsigned int>(all_thread.size());
+  header.dump_tick = FlightTick();
+#ifdef NET_FLIGHT_TSC
+  auto elapsed_ns = SteadyNs() - start_ns_;
+  header.tick_hz = elapsed_ns > 0 ? static_cast<unsigned long long>((header.dump_tick - start_tick_) * 1e9 / elapsed_ns) : 0;
+#else
+  header.tick_hz = 1000000000ULL;
+#endif
+  header.dump_unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  auto file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    LOG(kError, "flight recorder dump failed: can not open %s.", path.c_str());
+    return false;
+  }
+  auto ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (size_t i = 0; ok && i < all_thread.size(); ++i) {
+    ok = fwrite(&all_thread[i], sizeof(all_thread[i]), 1, file) == 1;
+    if (ok && !all_event[i].empty()) {
+      ok = fwrite(all_event[i].data(), sizeof(FlightEvent), all_event[i].size(), file) == all_event[i].size();
+    }
+  }
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    LOG(kError, "flight recorder dump failed: can not write %s.", path.c_str());
+  }
+  return ok;
+}
+
+#ifdef _WIN32
+bool FlightRecorder::SetSignal(int, const std::string&) {
+  LOG(kError, "set flight recorder signal failed: no signals on windows.");
+  return false;
+}
+
+void FlightRecorder::DumpLoop() {
+}
+#else
+bool FlightRecorder::SetSignal(int signal, const std::string& path) {
+  std::lock_guard<std::mutex> lock(signal_lock_);
+  if (signal != 0 && path.empty()) {
+    LOG(kError, "set flight recorder signal failed: invalid parameter.");
+    return false;
+  }
+  if (!dump_thread_) {
+    if (pipe(g_signal_pipe) != 0) {
+      LOG(kError, "set flight recorder signal failed: pipe error %d.", errno);
+      return false;
+    }
+    std::thread(&FlightRecorder::DumpLoop, this).detach();
+    dump_thread_ = true;
+  }
+  if (signal_ != 0) {
+    ::signal(signal_, SIG_DFL);
+  }
+  signal_ = 0;
+  if (signal == 0) {
+    return true;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = OnDumpSignal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  if (sigaction(signal, &action, nullptr) != 0) {
+    LOG(kError, "set flight recorder signal failed: sigaction error %d.", errno);
+    return false;
+  }
+  signal_ = signal;
+  signal_path_ = path;
+  return true;
+}
+
+// lives as long as the process, one dump per byte the handler wrote
+void FlightRecorder::DumpLoop() {
+  char wake = 0;
+  for (;;) {
+    auto size = read(g_signal_pipe[0], &wake, 1);
+    if (size < 0 && errno == EINTR) {
+      continue;
+    }
+    if (size <= 0) {
+      return;
+    }
+    std::string path;
+    {
+      std::lock_guard<std::mutex> lock(signal_lock_);
+      if (signal_ == 0) {
+        continue;
+      }
+      path = signal_path_ + "." + std::to_string(++dump_count_);
+    }
+    Dump(path);
+  }
+}
+#endif // _WIN32
+
+} // namespace net
@@ -0,0 +1,139 @@
+#ifndef NET_FLIGHT_RECORDER_H_
+#define NET_FLIGHT_RECORDER_H_
+
+#include "uncopyable.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NET_FLIGHT_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace net {
+
+// event types: the async types of base_buffer.h, timers are kFlightTimerBase + their timer type
+const unsigned int kFlightTimerBase = 16;
+const int kFlightRingEvents = 4096;
+const char kFlightMagic[8] = {'N', 'E', 'T', 'F', 'L', 'I', 'T', 'E'};
+const unsigned int kFlightVersion = 1;
+
+// the dump file: a FlightDumpHeader, then per thread a FlightThreadHeader followed by its
+// events oldest first. native byte order, read back by tools/flight_decode.cpp
+struct FlightEvent {
+  unsigned long long tsc;       // when the completion was picked up
+  unsigned long long handle;
+  unsigned int bytes;
+  unsigned int duration;        // ticks spent handling it, callbacks included, saturated
+  unsigned int type;
+  unsigned int reserved;
+};
+
+struct FlightDumpHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int thread_count;
+  unsigned long long tick_hz;   // ticks per second, 1e9 when ticks are steady clock nanoseconds
+  unsigned long long dump_tick;
+  unsigned long long dump_unix_ms;
+};
+
+struct FlightThreadHeader {
+  unsigned int thread;          // in the order the threads recorded their first event
+  unsigned int event_count;
+};
+
+inline unsigned long long FlightTick() {
+#ifdef NET_FLIGHT_TSC
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// always on: every io thread keeps its last kFlightRingEvents completions in a ring of its own.
+// the owner writes a slot and publishes it with one release store, a dump copies the rings and
+// drops the slots overwritten while it copied them
+class FlightRecorder : public utility::Uncopyable {
+ public:
+  static FlightRecorder* Instance() {
+    static FlightRecorder recorder;
+    return &recorder;
+  }
+
+  static void Record(unsigned int type, unsigned long long handle, unsigned int bytes, unsigned long long start) {
+    auto duration = FlightTick() - start;
+    auto& ring = Ring::Local();
+    auto next = ring.next.load(std::memory_order_relaxed);
+    auto slot = ring.slot[next & (kFlightRingEvents - 1)];
+    auto clamped = duration > 0xffffffffULL ? 0xffffffffULL : duration;
+    slot[0].store(start, std::memory_order_relaxed);
+    slot[1].store(handle, std::memory_order_relaxed);
+    slot[2].store(bytes | clamped << 32, std::memory_order_relaxed);
+    slot[3].store(type, std::memory_order_relaxed);
+    ring.next.store(next + 1, std::memory_order_release);
+  }
+  bool Dump(const std::string& path);
+  // posix only: every time signal arrives the rings go to path.1, path.2 and so on.
+  // the handler just wakes a dump thread, 0 restores the default action
+  bool SetSignal(int signal, const std::string& path);
+
+ private:
+  struct Ring {
+    // a FlightEvent as four words, relaxed atomics so a dump may read a slot being written
+    std::atomic<unsigned long long> slot[kFlightRingEvents][4];
+    std::atomic<unsigned long long> next;
+    unsigned int thread;
+
+    static Ring& Local() {
+      static thread_local Ring ring;
+      return ring;
+    }
+    Ring();
+    ~Ring();
+  };
+
+  FlightRecorder();
+
+  void Register(Ring* ring);
+  void Unregister(Ring* ring);
+  void DumpLoop();
+
+ private:
+  unsigned long long start_tick_;
+  unsigned long long start_ns_;
+  std::mutex ring_lock_;
+  std::vector<Ring*> ring_;
+  unsigned int next_thread_;
+  std::mutex signal_lock_;
+  std::string signal_path_;
+  int signal_;
+  int dump_count_;
+  bool dump_thread_;
+};
+
+// records the completion or timer it spans
+class FlightScope {
+ public:
+  FlightScope(unsigned int type, unsigned long long handle, unsigned int bytes)
+    : type_(type), handle_(handle), bytes_(bytes), start_(FlightTick()) {}
+  ~FlightScope() {
+    FlightRecorder::Record(type_, handle_, bytes_, start_);
+  }
+
+ private:
+  unsigned int type_;
+  unsigned long long handle_;
+  unsigned int bytes_;
+  unsigned long long start_;
+};
+
+} // namespace net
+
+#endif	// NET_FLIGHT_RECORDER_H_
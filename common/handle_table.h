@@ -0,0 +1,165 @@
+#ifndef NET_HANDLE_TABLE_H_
+#define NET_HANDLE_TABLE_H_
+
+#include "uncopyable.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace net {
+
+// slot map behind the tcp and udp handles: a handle packs a slot index and the slot
+// generation, so a lookup is one array access plus a per slot spin lock, and a
+// handle whose slot was reused since is rejected by the generation compare.
+// freed slots are reused oldest first to keep generations from wrapping early
+template <class T>
+class HandleTable : public utility::Uncopyable {
+ public:
+  static const int kIndexBits = 20;
+  static const unsigned long kIndexMask = (1UL << kIndexBits) - 1;
+  static const unsigned long kGenerationMask = 0xFFF;
+  static const int kChunkSize = 4096;
+  static const int kMaxChunk = (1 << kIndexBits) / kChunkSize;
+
+  HandleTable() : slot_count_(1), size_(0) {
+    for (auto i = 0; i < kMaxChunk; ++i) {
+      chunk_[i] = nullptr;
+    }
+  }
+  ~HandleTable() {
+    Clear();
+    for (auto i = 0; i < kMaxChunk; ++i) {
+      delete[] chunk_[i].load();
+    }
+  }
+
+  // index 0 is never handed out, so a valid handle is never 0
+  bool Insert(const std::shared_ptr<T>& value, unsigned long& handle) {
+    unsigned long index = 0;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (!free_index_.empty()) {
+        index = free_index_.front();
+        free_index_.pop_front();
+      } else if (slot_count_ <= kIndexMask) {
+        index = slot_count_;
+        auto& chunk = chunk_[index / kChunkSize];
+        if (chunk.load(std::memory_order_relaxed) == nullptr) {
+          chunk.store(new Slot[kChunkSize], std::memory_order_release);
+        }
+        ++slot_count_;
+      } else {
+        return false;
+      }
+      ++size_;
+    }
+    auto& slot = GetSlot(index);
+    SpinLock lock(slot.lock);
+    slot.value = value;
+    handle = (slot.generation << kIndexBits) | index;
+    return true;
+  }
+  std::shared_ptr<T> Get(unsigned long handle) {
+    auto slot = FindSlot(handle);
+    if (slot == nullptr) {
+      return nullptr;
+    }
+    SpinLock lock(slot->lock);
+    if (slot->generation != (handle >> kIndexBits & kGenerationMask)) {
+      return nullptr;
+    }
+    return slot->value;
+  }
+  // the removed value is handed back so its destructor runs outside every lock
+  std::shared_ptr<T> Remove(unsigned long handle) {
+    auto slot = FindSlot(handle);
+    if (slot == nullptr) {
+      return nullptr;
+    }
+    std::shared_ptr<T> value;
+    {
+      SpinLock lock(slot->lock);
+      if (slot->generation != (handle >> kIndexBits & kGenerationMask) || !slot->value) {
+        return nullptr;
+      }
+      value.swap(slot->value);
+      slot->generation = (slot->generation + 1) & kGenerationMask;
+    }
+    std::lock_guard<std::mutex> lock(lock_);
+    free_index_.push_back(handle & kIndexMask);
+    --size_;
+    return value;
+  }
+  void Clear() {
+    std::vector<std::shared_ptr<T>> all_value;
+    unsigned long slot_count = 0;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      slot_count = slot_count_;
+    }
+    for (unsigned long index = 1; index < slot_count; ++index) {
+      auto& slot = GetSlot(index);
+      SpinLock slot_lock(slot.lock);
+      if (slot.value) {
+        all_value.push_back(nullptr);
+        all_value.back().swap(slot.value);
+        slot.generation = (slot.generation + 1) & kGenerationMask;
+        std::lock_guard<std::mutex> lock(lock_);
+        free_index_.push_back(index);
+        --size_;
+      }
+    }
+  }
+  unsigned long size() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return size_;
+  }
+
+ private:
+  struct Slot {
+    std::atomic_flag lock;
+    unsigned long generation;
+    std::shared_ptr<T> value;
+    Slot() : generation(0) { lock.clear(); }
+  };
+
+  class SpinLock {
+   public:
+    explicit SpinLock(std::atomic_flag& flag) : flag_(flag) {
+      while (flag_.test_and_set(std::memory_order_acquire)) {
+      }
+    }
+    ~SpinLock() { flag_.clear(std::memory_order_release); }
+
+   private:
+    std::atomic_flag& flag_;
+  };
+
+  Slot& GetSlot(unsigned long index) {
+    return chunk_[index / kChunkSize].load(std::memory_order_acquire)[index % kChunkSize];
+  }
+  Slot* FindSlot(unsigned long handle) {
+    auto index = handle & kIndexMask;
+    if (index == 0) {
+      return nullptr;
+    }
+    auto chunk = chunk_[index / kChunkSize].load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+      return nullptr;
+    }
+    return &chunk[index % kChunkSize];
+  }
+
+ private:
+  std::atomic<Slot*> chunk_[kMaxChunk];
+  std::mutex lock_;
+  unsigned long slot_count_;
+  unsigned long size_;
+  std::deque<unsigned long> free_index_;
+};
+
+} // namespace net
+
+#endif	// NET_HANDLE_TABLE_H_
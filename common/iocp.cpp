@@ -1,23 +1,37 @@
 #include "iocp.h"
 #include "log.h"
-#include "utility.h"
+#include "thread_affinity.h"
+
+#ifdef _WIN32
 
 namespace net {
 
+namespace {
+
+thread_local int t_loop = -1;
+
+// completion key of a timer wakeup, a stop request posts a null key and overlapped
+const ULONG_PTR kTimerWakeupKey = 1;
+
+} // namespace
+
 IOCP::IOCP() {
   init_ = false;
-  iocp_ = NULL;
+  per_core_ = false;
+  cpu_mask_ = 0;
+  next_loop_ = 0;
+  next_timer_loop_ = 0;
 }
 
 IOCP::~IOCP() {
   Uninit();
 }
 
-bool IOCP::Init(std::function<bool (LPOVERLAPPED, DWORD)> callback) {
+bool IOCP::Init(std::function<bool (LPOVERLAPPED, DWORD)> callback, std::function<void (const TimerEvent&)> timer_callback, const NetOptions& options) {
   if (init_) {
     return true;
   }
-  if (!callback) {
+  if (!callback || !timer_callback) {
     LOG(kStartup, "initialize IOCP failed: invalid callback parameter.");
     return false;
   }
@@ -27,17 +41,25 @@ bool IOCP::Init(std::function<bool (LPOVERLAPPED, DWORD)> callback) {
     return false;
   }
   callback_ = callback;
+  timer_callback_ = timer_callback;
   init_ = true;
-  iocp_ = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, NULL, 0);
-  if (iocp_ == NULL) {
-    LOG(kStartup, "CreateIoCompletionPort failed, error code: %d.", ::WSAGetLastError());
-    Uninit();
-    return false;
+  per_core_ = options.per_core;
+  cpu_mask_ = options.cpu_mask;
+  thread_name_ = options.thread_name;
+  next_loop_ = 0;
+  auto port_num = per_core_ ? options.thread_count : 1;
+  for (auto i = 0; i < port_num; ++i) {
+    auto iocp = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, NULL, per_core_ ? 1 : 0);
+    if (iocp == NULL) {
+      LOG(kStartup, "CreateIoCompletionPort failed, error code: %d.", ::WSAGetLastError());
+      Uninit();
+      return false;
+    }
+    iocp_.push_back(iocp);
   }
-  auto thread_num = utility::GetProcessorNum() * 2;
-  auto thread_proc = std::bind(&IOCP::ThreadWorker, this);
-  for (auto i = 0; i < thread_num; ++i) {
-    auto new_thread = new std::thread(thread_proc);
+  CreateTimerWheel(port_num);
+  for (auto i = 0; i < options.thread_count; ++i) {
+    auto new_thread = new std::thread(std::bind(&IOCP::ThreadWorker, this, per_core_ ? i : 0, i));
     iocp_thread_.push_back(new_thread);
   }
   return true;
@@ -47,48 +69,86 @@ void IOCP::Uninit() {
   if (!init_) {
     return;
   }
-  for (const auto& i : iocp_thread_) {
-    ::PostQueuedCompletionStatus(iocp_, 0, NULL, NULL);
+  for (auto i = 0; i < static_cast<int>(iocp_thread_.size()); ++i) {
+    ::PostQueuedCompletionStatus(iocp_[per_core_ ? i : 0], 0, NULL, NULL);
   }
   for (const auto& i : iocp_thread_) {
     i->join();
     delete i;
   }
   iocp_thread_.clear();
-  if (iocp_ != NULL) {
-    ::CloseHandle(iocp_);
-    iocp_ = NULL;
+  for (const auto& i : iocp_) {
+    ::CloseHandle(i);
   }
+  iocp_.clear();
+  DestroyTimerWheel();
   ::WSACleanup();
   callback_ = nullptr;
+  timer_callback_ = nullptr;
   init_ = false;
 }
 
-bool IOCP::BindToIOCP(SOCKET socket) {
-  if (socket == INVALID_SOCKET) {
+bool IOCP::BindToIOCP(SOCKET socket, int& loop) {
+  if (socket == INVALID_SOCKET || iocp_.empty()) {
     LOG(kError, "BindToIOCP failed: invalid socket parameter.");
     return false;
   }
-  HANDLE existing_iocp = ::CreateIoCompletionPort((HANDLE)socket, iocp_, NULL, 0);
-  if (existing_iocp != iocp_) {
+  loop = next_loop_++ % iocp_.size();
+  HANDLE existing_iocp = ::CreateIoCompletionPort((HANDLE)socket, iocp_[loop], NULL, 0);
+  if (existing_iocp != iocp_[loop]) {
     LOG(kError, "BindToIOCP failed, error code: %d.", ::WSAGetLastError());
     return false;
   }
   return true;
 }
 
-bool IOCP::ThreadWorker() {
+bool IOCP::PostToLoop(int loop, LPOVERLAPPED ovlp) {
+  if (loop < 0 || loop >= static_cast<int>(iocp_.size()) || ovlp == NULL) {
+    LOG(kError, "post to loop failed: invalid parameter.");
+    return false;
+  }
+  if (!::PostQueuedCompletionStatus(iocp_[loop], 0, NULL, ovlp)) {
+    LOG(kError, "PostQueuedCompletionStatus failed, error code: %d.", ::WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+int IOCP::CurrentLoop() {
+  return t_loop;
+}
+
+void IOCP::WakeLoop(int loop) {
+  if (!::PostQueuedCompletionStatus(iocp_[loop], 0, kTimerWakeupKey, NULL)) {
+    LOG(kError, "PostQueuedCompletionStatus failed, error code: %d.", ::WSAGetLastError());
+  }
+}
+
+bool IOCP::ThreadWorker(int loop, int index) {
+  if (!InitIoThread(thread_name_, cpu_mask_, per_core_, index)) {
+    LOG(kStartup, "set affinity of io thread %d failed.", index);
+  }
+  t_loop = loop;
+  auto iocp = iocp_[loop];
+  auto timer_wheel = timer_wheel_[loop];
   while (true) {
     DWORD transfer_size = 0;
-    ULONG completion_key = NULL;
+    ULONG_PTR completion_key = NULL;
     LPOVERLAPPED ovlp = NULL;
-    if (!::GetQueuedCompletionStatus(iocp_, &transfer_size, &completion_key, &ovlp, INFINITE)) {
+    auto wait = timer_wheel->Advance(timer_callback_);
+    if (!::GetQueuedCompletionStatus(iocp, &transfer_size, &completion_key, &ovlp, wait < 0 ? INFINITE : wait)) {
       int error_code = ::WSAGetLastError();
+      if (ovlp == NULL && error_code == WAIT_TIMEOUT) {
+        continue;
+      }
       if (error_code != ERROR_NETNAME_DELETED && error_code != ERROR_CONNECTION_ABORTED &&
         error_code != ERROR_OPERATION_ABORTED) {
         LOG(kError, "GetQueuedCompletionStatus failed, error code: %d.", error_code);
       }
     }
+    if (completion_key == kTimerWakeupKey) {
+      continue;
+    }
     if (transfer_size == 0 && ovlp == NULL) {
       break;
     }
@@ -96,7 +156,58 @@ bool IOCP::ThreadWorker() {
       callback_(ovlp, transfer_size);
     }
   }
+  t_loop = -1;
+  return true;
+}
+
+} // namespace net
+
+#endif // _WIN32
+
+namespace net {
+
+// the timer wheels are the same for every backend, only waking a loop differs
+void IOCP::CreateTimerWheel(int loop_count) {
+  next_timer_loop_ = 0;
+  for (auto i = 0; i < loop_count; ++i) {
+    timer_wheel_.push_back(new TimerWheel(i));
+  }
+}
+
+void IOCP::DestroyTimerWheel() {
+  for (const auto& i : timer_wheel_) {
+    delete i;
+  }
+  timer_wheel_.clear();
+}
+
+bool IOCP::ScheduleTimer(int loop, int type, unsigned long handle, unsigned long long arg, int delay, int period, unsigned long long& id) {
+  if (timer_wheel_.empty() || loop >= static_cast<int>(timer_wheel_.size())) {
+    LOG(kError, "schedule timer failed: invalid loop or not initialized.");
+    return false;
+  }
+  if (loop < 0) {
+    loop = CurrentLoop();
+    if (loop < 0) {
+      loop = next_timer_loop_++ % timer_wheel_.size();
+    }
+  }
+  auto was_empty = false;
+  if (!timer_wheel_[loop]->Add(type, handle, arg, delay, period, id, was_empty)) {
+    return false;
+  }
+  if (was_empty && CurrentLoop() != loop) {
+    WakeLoop(loop);
+  }
   return true;
 }
 
-} // namespace net
\ No newline at end of file
+bool IOCP::CancelTimer(unsigned long long id) {
+  auto loop = TimerWheel::LoopOf(id);
+  if (loop >= static_cast<int>(timer_wheel_.size())) {
+    return false;
+  }
+  return timer_wheel_[loop]->Cancel(id);
+}
+
+} // namespace net
@@ -1,32 +1,85 @@
 #ifndef NET_IOCP_H_
 #define NET_IOCP_H_
 
+#include "net.h"
+#include "platform.h"
+#include "timer_wheel.h"
 #include "uncopyable.h"
+#include <atomic>
 #include <functional>
+#include <string>
 #include <thread>
 #include <vector>
-#include <WinSock2.h>
 
 namespace net {
 
+#ifndef _WIN32
+#ifdef NET_USE_IO_URING
+struct UringQueue;
+#else
+struct EpollLoop;
+#endif
+#endif
+
 class IOCP : public utility::Uncopyable {
  public:
   IOCP();
   ~IOCP();
-  bool Init(std::function<bool (LPOVERLAPPED, DWORD)> callback);
+  // per_core: options.thread_count loops, each served by a single thread pinned to a processor.
+  // otherwise options.thread_count threads share the loops (one loop per thread with io_uring).
+  // due timers of a loop are passed to timer_callback on one of its threads
+  bool Init(std::function<bool (LPOVERLAPPED, DWORD)> callback, std::function<void (const TimerEvent&)> timer_callback, const NetOptions& options);
   void Uninit();
-  bool BindToIOCP(SOCKET socket);
+  // a socket stays on the loop it is bound to until it is closed
+  bool BindToIOCP(SOCKET socket, int& loop);
+  // hand an overlapped to the threads of a loop, it comes out as a completion of size 0
+  bool PostToLoop(int loop, LPOVERLAPPED ovlp);
+  // the loop served by the calling thread, -1 outside the worker threads
+  static int CurrentLoop();
+  bool per_core() { return per_core_; }
+  // a timer of loop -1 goes to the calling io thread's loop, or to the loops in turn
+  bool ScheduleTimer(int loop, int type, unsigned long handle, unsigned long long arg, int delay, int period, unsigned long long& id);
+  bool CancelTimer(unsigned long long id);
 
  private:
-  bool ThreadWorker();
+  void CreateTimerWheel(int loop_count);
+  void DestroyTimerWheel();
+  // ends the wait of the loop's threads, so one of them picks up the timeout of a first timer
+  void WakeLoop(int loop);
+#ifdef _WIN32
+  bool ThreadWorker(int loop, int index);
+#elif defined(NET_USE_IO_URING)
+  bool ThreadWorker(UringQueue* ring, int index);
+  void TakePostedCompletion(UringQueue* ring);
+  void DispatchCompletion();
+#else
+  bool ThreadWorker(EpollLoop* loop, int index);
+  void TakePostedCompletion(EpollLoop* loop);
+  void DispatchCompletion();
+#endif
 
  private:
   bool init_;
-  HANDLE iocp_;
+  bool per_core_;
+  unsigned long long cpu_mask_;
+  std::string thread_name_;
+  std::atomic<unsigned int> next_loop_;
+#ifdef _WIN32
+  std::vector<HANDLE> iocp_;
+#elif defined(NET_USE_IO_URING)
+  std::atomic<bool> stopping_;
+  std::vector<UringQueue*> ring_;
+#else
+  std::atomic<bool> stopping_;
+  std::vector<EpollLoop*> loop_;
+#endif
   std::function<bool (LPOVERLAPPED, DWORD)> callback_;
+  std::function<void (const TimerEvent&)> timer_callback_;
+  std::vector<TimerWheel*> timer_wheel_;
+  std::atomic<unsigned int> next_timer_loop_;
   std::vector<std::thread*> iocp_thread_;
 };
 
 } // namespace net
 
-#endif	// NET_IOCP_H_
\ No newline at end of file
+#endif	// NET_IOCP_H_
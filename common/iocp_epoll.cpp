@@ -0,0 +1,717 @@
+#include "iocp.h"
+#include "channel_table.h"
+#include "log.h"
+#include "thread_affinity.h"
+
+#if !defined(_WIN32) && !defined(NET_USE_IO_URING)
+
+#include <fcntl.h>
+#include <mutex>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace net {
+
+// one epoll instance with the threads waiting on it, foreign threads hand
+// completions over through the posted list and wake a waiter with the eventfd
+struct EpollLoop {
+  int index;
+  int epoll;
+  int wakeup;
+  std::mutex posted_lock;
+  LPOVERLAPPED posted_head;
+  LPOVERLAPPED posted_tail;
+  EpollLoop() : index(0), epoll(-1), wakeup(-1), posted_head(nullptr), posted_tail(nullptr) {}
+};
+
+namespace {
+
+const int kOperationAccept = 1;
+const int kOperationSend = 2;
+const int kOperationRecv = 3;
+const int kOperationSendTo = 4;
+const int kOperationRecvFrom = 5;
+const int kOperationConnect = 6;
+const int kOperationRecvBatch = 7;
+const int kOperationSendBatch = 8;
+
+const int kPerformDone = 0;
+const int kPerformAgain = 1;
+
+const int kMaxEpollEvents = 128;
+const unsigned long long kWakeupKey = ~0ULL;
+
+// state of one socket bound to an epoll port, operations wait in a read queue
+// (accept/recv/recvfrom) and a write queue (send/sendto) until the socket is ready
+struct Channel {
+  std::mutex lock;
+  unsigned int generation;
+  bool open;
+  bool nonblock;
+  bool readable;
+  bool writable;
+  EpollLoop* loop;
+  LPOVERLAPPED read_head;
+  LPOVERLAPPED read_tail;
+  LPOVERLAPPED write_head;
+  LPOVERLAPPED write_tail;
+  Channel() : generation(0), open(false), nonblock(false), readable(false), writable(false), loop(nullptr),
+    read_head(nullptr), read_tail(nullptr), write_head(nullptr), write_tail(nullptr) {}
+};
+
+ChannelTable<Channel> g_channel;
+
+// completions produced by a worker thread of its own loop are dispatched by that thread
+thread_local EpollLoop* t_loop = nullptr;
+thread_local LPOVERLAPPED t_completion_head = nullptr;
+thread_local LPOVERLAPPED t_completion_tail = nullptr;
+
+void PushBack(LPOVERLAPPED& head, LPOVERLAPPED& tail, LPOVERLAPPED ovlp) {
+  ovlp->next = nullptr;
+  if (tail == nullptr) {
+    head = ovlp;
+  } else {
+    tail->next = ovlp;
+  }
+  tail = ovlp;
+}
+
+LPOVERLAPPED PopFront(LPOVERLAPPED& head, LPOVERLAPPED& tail) {
+  auto ovlp = head;
+  head = ovlp->next;
+  if (head == nullptr) {
+    tail = nullptr;
+  }
+  ovlp->next = nullptr;
+  return ovlp;
+}
+
+int Complete(LPOVERLAPPED ovlp, DWORD transferred, int error) {
+  ovlp->transferred = transferred;
+  ovlp->error = error;
+  return kPerformDone;
+}
+
+void WakeUp(EpollLoop* loop) {
+  uint64_t value = 1;
+  if (::write(loop->wakeup, &value, sizeof(value)) != sizeof(value)) {
+    LOG(kError, "wake up epoll loop failed, error code: %d.", errno);
+  }
+}
+
+void PostCompletion(EpollLoop* loop, LPOVERLAPPED ovlp) {
+  if (t_loop == loop) {
+    PushBack(t_completion_head, t_completion_tail, ovlp);
+    return;
+  }
+  bool was_empty = false;
+  {
+    std::lock_guard<std::mutex> lock(loop->posted_lock);
+    was_empty = loop->posted_head == nullptr;
+    PushBack(loop->posted_head, loop->posted_tail, ovlp);
+  }
+  if (was_empty) {
+    WakeUp(loop);
+  }
+}
+
+int PerformAccept(LPOVERLAPPED ovlp) {
+  while (true) {
+    auto new_socket = ::accept4(ovlp->socket, nullptr, nullptr, SOCK_CLOEXEC);
+    if (new_socket < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return kPerformAgain;
+      }
+      return Complete(ovlp, 0, errno);
+    }
+    // AcceptEx accepts into a socket the caller created, keep that descriptor number alive
+    auto result = ::dup3(new_socket, ovlp->accept_socket, O_CLOEXEC);
+    auto error = errno;
+    ::close(new_socket);
+    return Complete(ovlp, 0, result < 0 ? error : 0);
+  }
+}
+
+int PerformRecv(LPOVERLAPPED ovlp) {
+  msghdr msg = {0};
+  msg.msg_iov = ovlp->iov;
+  msg.msg_iovlen = ovlp->iov_count;
+  if (ovlp->operation == kOperationRecvFrom) {
+    msg.msg_name = ovlp->from_addr;
+    msg.msg_namelen = *ovlp->from_size;
+  }
+  while (true) {
+    auto size = ::recvmsg(ovlp->socket, &msg, MSG_DONTWAIT);
+    if (size >= 0) {
+      if (ovlp->operation == kOperationRecvFrom) {
+        *ovlp->from_size = msg.msg_namelen;
+      }
+      return Complete(ovlp, static_cast<DWORD>(size), 0);
+    }
+    if (errno == EINTR || (ovlp->operation == kOperationRecvFrom && errno == ECONNREFUSED)) {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return kPerformAgain;
+    }
+    return Complete(ovlp, 0, errno);
+  }
+}
+
+// the handshake result waits in SO_ERROR. a writable edge left over from before the
+// connect started finds no peer yet, the connect then keeps waiting for the next one
+int PerformConnect(LPOVERLAPPED ovlp) {
+  int error = 0;
+  socklen_t size = sizeof(error);
+  if (::getsockopt(ovlp->socket, SOL_SOCKET, SO_ERROR, &error, &size) != 0) {
+    return Complete(ovlp, 0, errno);
+  }
+  if (error != 0) {
+    return Complete(ovlp, 0, error);
+  }
+  SOCKADDR_IN peer_addr;
+  socklen_t peer_size = sizeof(peer_addr);
+  if (::getpeername(ovlp->socket, (SOCKADDR*)&peer_addr, &peer_size) != 0) {
+    return errno == ENOTCONN ? kPerformAgain : Complete(ovlp, 0, errno);
+  }
+  return Complete(ovlp, 0, 0);
+}
+
+// a stream send completes only when every byte is written, like WSASend does
+int PerformSend(LPOVERLAPPED ovlp) {
+  msghdr msg = {0};
+  if (ovlp->operation == kOperationSendTo) {
+    msg.msg_name = &ovlp->to_addr;
+    msg.msg_namelen = sizeof(ovlp->to_addr);
+  }
+  while (ovlp->iov_index < ovlp->iov_count) {
+    msg.msg_iov = &ovlp->iov[ovlp->iov_index];
+    msg.msg_iovlen = ovlp->iov_count - ovlp->iov_index;
+    auto size = ::sendmsg(ovlp->socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (size < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return kPerformAgain;
+      }
+      return Complete(ovlp, 0, errno);
+    }
+    ovlp->transferred += static_cast<DWORD>(size);
+    while (size > 0 && ovlp->iov_index < ovlp->iov_count) {
+      auto& iov = ovlp->iov[ovlp->iov_index];
+      if (static_cast<size_t>(size) < iov.iov_len) {
+        iov.iov_base = static_cast<char*>(iov.iov_base) + size;
+        iov.iov_len -= size;
+        size = 0;
+      } else {
+        size -= iov.iov_len;
+        ++ovlp->iov_index;
+      }
+    }
+    if (ovlp->operation == kOperationSendTo) {
+      break;
+    }
+  }
+  return Complete(ovlp, ovlp->transferred, 0);
+}
+
+int PerformRecvBatch(LPOVERLAPPED ovlp) {
+  while (true) {
+    auto count = ::recvmmsg(ovlp->socket, ovlp->msgs, ovlp->msg_count, MSG_DONTWAIT, nullptr);
+    if (count >= 0) {
+      return Complete(ovlp, static_cast<DWORD>(count), 0);
+    }
+    if (errno == EINTR || errno == ECONNREFUSED) {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return kPerformAgain;
+    }
+    return Complete(ovlp, 0, errno);
+  }
+}
+
+// sendmmsg stops at the first datagram failing, it is skipped and the rest go on
+int PerformSendBatch(LPOVERLAPPED ovlp) {
+  while (ovlp->msg_index < ovlp->msg_count) {
+    auto count = ::sendmmsg(ovlp->socket, &ovlp->msgs[ovlp->msg_index], ovlp->msg_count - ovlp->msg_index, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return kPerformAgain;
+      }
+      ++ovlp->msg_index;
+      continue;
+    }
+    ovlp->msg_index += count;
+    ovlp->transferred += static_cast<DWORD>(count);
+  }
+  return Complete(ovlp, ovlp->transferred, 0);
+}
+
+int Perform(LPOVERLAPPED ovlp) {
+  switch (ovlp->operation) {
+  case kOperationAccept:
+    return PerformAccept(ovlp);
+  case kOperationRecv:
+  case kOperationRecvFrom:
+    return PerformRecv(ovlp);
+  case kOperationSend:
+  case kOperationSendTo:
+    return PerformSend(ovlp);
+  case kOperationConnect:
+    return PerformConnect(ovlp);
+  case kOperationRecvBatch:
+    return PerformRecvBatch(ovlp);
+  case kOperationSendBatch:
+    return PerformSendBatch(ovlp);
+  default:
+    return Complete(ovlp, 0, EINVAL);
+  }
+}
+
+// a connect waits for the socket to turn writable like a send
+bool IsWriteOperation(LPOVERLAPPED ovlp) {
+  return ovlp->operation == kOperationSend || ovlp->operation == kOperationSendTo || ovlp->operation == kOperationSendBatch ||
+    ovlp->operation == kOperationConnect;
+}
+
+// try the operation right away when the socket was last seen ready,
+// otherwise park it until epoll reports the next edge
+int Submit(LPOVERLAPPED ovlp) {
+  auto channel = g_channel.Get(ovlp->socket, false);
+  if (channel == nullptr) {
+    errno = ENOTSOCK;
+    return SOCKET_ERROR;
+  }
+  EpollLoop* loop = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(channel->lock);
+    if (!channel->open) {
+      errno = ENOTSOCK;
+      return SOCKET_ERROR;
+    }
+    if ((ovlp->operation == kOperationAccept || ovlp->operation == kOperationConnect) && !channel->nonblock) {
+      auto flags = ::fcntl(ovlp->socket, F_GETFL, 0);
+      if (flags < 0 || ::fcntl(ovlp->socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return SOCKET_ERROR;
+      }
+      channel->nonblock = true;
+    }
+    if (ovlp->operation == kOperationConnect) {
+      if (::connect(ovlp->socket, (SOCKADDR*)&ovlp->to_addr, sizeof(ovlp->to_addr)) != 0 && errno != EINPROGRESS && errno != EINTR) {
+        return SOCKET_ERROR;
+      }
+      // even a connect done at once completes through the writable edge it raised
+      channel->writable = false;
+    }
+    auto is_write = IsWriteOperation(ovlp);
+    auto& head = is_write ? channel->write_head : channel->read_head;
+    auto& tail = is_write ? channel->write_tail : channel->read_tail;
+    auto& ready = is_write ? channel->writable : channel->readable;
+    if (head == nullptr && ready && Perform(ovlp) == kPerformDone) {
+      loop = channel->loop;
+    } else {
+      if (head == nullptr) {
+        ready = false;
+      }
+      PushBack(head, tail, ovlp);
+    }
+  }
+  if (loop != nullptr) {
+    PostCompletion(loop, ovlp);
+    return 0;
+  }
+  errno = ERROR_IO_PENDING;
+  return SOCKET_ERROR;
+}
+
+int SubmitBuffers(LPOVERLAPPED ovlp, int operation, SOCKET socket, WSABUF* buffers, DWORD count) {
+  if (ovlp == nullptr || buffers == nullptr || count == 0) {
+    errno = EINVAL;
+    return SOCKET_ERROR;
+  }
+  ovlp->operation = operation;
+  ovlp->socket = socket;
+  ovlp->iov_count = count;
+  ovlp->iov_index = 0;
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  if (count > static_cast<DWORD>(kOverlappedIovecSize)) {
+    ovlp->iov = reinterpret_cast<iovec*>(buffers);
+  } else {
+    ovlp->iov = ovlp->iov_inline;
+    for (DWORD i = 0; i < count; ++i) {
+      ovlp->iov[i].iov_base = buffers[i].buf;
+      ovlp->iov[i].iov_len = buffers[i].len;
+    }
+  }
+  return Submit(ovlp);
+}
+
+int SubmitMsgBatch(LPOVERLAPPED ovlp, int operation, SOCKET socket, mmsghdr* msgs, unsigned int count) {
+  if (ovlp == nullptr || msgs == nullptr || count == 0) {
+    errno = EINVAL;
+    return SOCKET_ERROR;
+  }
+  ovlp->operation = operation;
+  ovlp->socket = socket;
+  ovlp->msgs = msgs;
+  ovlp->msg_count = count;
+  ovlp->msg_index = 0;
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  return Submit(ovlp);
+}
+
+void DrainQueue(LPOVERLAPPED& head, LPOVERLAPPED& tail, bool& ready) {
+  while (head != nullptr) {
+    if (Perform(head) != kPerformDone) {
+      ready = false;
+      return;
+    }
+    PushBack(t_completion_head, t_completion_tail, PopFront(head, tail));
+  }
+}
+
+void ProcessEvent(const epoll_event& event) {
+  auto socket = static_cast<SOCKET>(event.data.u64 & 0xFFFFFFFF);
+  auto generation = static_cast<unsigned int>(event.data.u64 >> 32);
+  auto channel = g_channel.Get(socket, false);
+  if (channel == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(channel->lock);
+  if (!channel->open || channel->generation != generation) {
+    return;
+  }
+  if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+    channel->readable = true;
+    DrainQueue(channel->read_head, channel->read_tail, channel->readable);
+  }
+  if (event.events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+    channel->writable = true;
+    DrainQueue(channel->write_head, channel->write_tail, channel->writable);
+  }
+}
+
+} // namespace
+
+IOCP::IOCP() {
+  init_ = false;
+  per_core_ = false;
+  cpu_mask_ = 0;
+  next_loop_ = 0;
+  next_timer_loop_ = 0;
+  stopping_ = false;
+}
+
+IOCP::~IOCP() {
+  Uninit();
+}
+
+bool IOCP::Init(std::function<bool (LPOVERLAPPED, DWORD)> callback, std::function<void (const TimerEvent&)> timer_callback, const NetOptions& options) {
+  if (init_) {
+    return true;
+  }
+  if (!callback || !timer_callback) {
+    LOG(kStartup, "initialize IOCP failed: invalid callback parameter.");
+    return false;
+  }
+  callback_ = callback;
+  timer_callback_ = timer_callback;
+  init_ = true;
+  per_core_ = options.per_core;
+  cpu_mask_ = options.cpu_mask;
+  thread_name_ = options.thread_name;
+  next_loop_ = 0;
+  stopping_ = false;
+  auto loop_num = per_core_ ? options.thread_count : 1;
+  for (auto i = 0; i < loop_num; ++i) {
+    auto loop = new EpollLoop;
+    loop->index = i;
+    loop_.push_back(loop);
+    loop->epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll < 0) {
+      LOG(kStartup, "epoll_create1 failed, error code: %d.", errno);
+      Uninit();
+      return false;
+    }
+    loop->wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wakeup < 0) {
+      LOG(kStartup, "eventfd failed, error code: %d.", errno);
+      Uninit();
+      return false;
+    }
+    epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = kWakeupKey;
+    if (::epoll_ctl(loop->epoll, EPOLL_CTL_ADD, loop->wakeup, &event) != 0) {
+      LOG(kStartup, "epoll_ctl add wakeup failed, error code: %d.", errno);
+      Uninit();
+      return false;
+    }
+  }
+  CreateTimerWheel(loop_num);
+  for (auto i = 0; i < options.thread_count; ++i) {
+    auto new_thread = new std::thread(std::bind(&IOCP::ThreadWorker, this, loop_[per_core_ ? i : 0], i));
+    iocp_thread_.push_back(new_thread);
+  }
+  return true;
+}
+
+void IOCP::Uninit() {
+  if (!init_) {
+    return;
+  }
+  stopping_ = true;
+  for (const auto& loop : loop_) {
+    if (loop->wakeup >= 0) {
+      WakeUp(loop);
+    }
+  }
+  for (const auto& i : iocp_thread_) {
+    i->join();
+    delete i;
+  }
+  iocp_thread_.clear();
+  for (const auto& loop : loop_) {
+    if (loop->wakeup >= 0) {
+      ::close(loop->wakeup);
+    }
+    if (loop->epoll >= 0) {
+      ::close(loop->epoll);
+    }
+    delete loop;
+  }
+  loop_.clear();
+  DestroyTimerWheel();
+  callback_ = nullptr;
+  timer_callback_ = nullptr;
+  init_ = false;
+}
+
+bool IOCP::BindToIOCP(SOCKET socket, int& loop) {
+  auto channel = g_channel.Get(socket, true);
+  if (channel == nullptr || loop_.empty()) {
+    LOG(kError, "BindToIOCP failed: invalid socket parameter.");
+    return false;
+  }
+  auto epoll_loop = loop_[next_loop_++ % loop_.size()];
+  std::lock_guard<std::mutex> lock(channel->lock);
+  ++channel->generation;
+  epoll_event event = {0};
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.u64 = (static_cast<unsigned long long>(channel->generation) << 32) | static_cast<unsigned int>(socket);
+  if (::epoll_ctl(epoll_loop->epoll, EPOLL_CTL_ADD, socket, &event) != 0) {
+    if (errno != EEXIST || ::epoll_ctl(epoll_loop->epoll, EPOLL_CTL_MOD, socket, &event) != 0) {
+      LOG(kError, "BindToIOCP failed, error code: %d.", errno);
+      return false;
+    }
+  }
+  channel->open = true;
+  channel->nonblock = false;
+  channel->readable = true;
+  channel->writable = true;
+  channel->loop = epoll_loop;
+  channel->read_head = channel->read_tail = nullptr;
+  channel->write_head = channel->write_tail = nullptr;
+  loop = epoll_loop->index;
+  return true;
+}
+
+bool IOCP::PostToLoop(int loop, LPOVERLAPPED ovlp) {
+  if (loop < 0 || loop >= static_cast<int>(loop_.size()) || ovlp == nullptr) {
+    LOG(kError, "post to loop failed: invalid parameter.");
+    return false;
+  }
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  net::PostCompletion(loop_[loop], ovlp);
+  return true;
+}
+
+int IOCP::CurrentLoop() {
+  return t_loop != nullptr ? t_loop->index : -1;
+}
+
+void IOCP::WakeLoop(int loop) {
+  WakeUp(loop_[loop]);
+}
+
+void IOCP::TakePostedCompletion(EpollLoop* loop) {
+  std::lock_guard<std::mutex> lock(loop->posted_lock);
+  while (loop->posted_head != nullptr) {
+    PushBack(t_completion_head, t_completion_tail, PopFront(loop->posted_head, loop->posted_tail));
+  }
+}
+
+// only what is queued now is dispatched, operations re-posted by callbacks wait for the next round
+void IOCP::DispatchCompletion() {
+  auto head = t_completion_head;
+  t_completion_head = nullptr;
+  t_completion_tail = nullptr;
+  while (head != nullptr) {
+    auto ovlp = head;
+    head = head->next;
+    ovlp->next = nullptr;
+    if (callback_) {
+      callback_(ovlp, ovlp->transferred);
+    }
+  }
+}
+
+bool IOCP::ThreadWorker(EpollLoop* loop, int index) {
+  if (!InitIoThread(thread_name_, cpu_mask_, per_core_, index)) {
+    LOG(kStartup, "set affinity of io thread %d failed.", index);
+  }
+  t_loop = loop;
+  epoll_event events[kMaxEpollEvents];
+  auto timer_wheel = timer_wheel_[loop->index];
+  while (true) {
+    // timers run first, the completions they cause are dispatched without waiting
+    auto wait = timer_wheel->Advance(timer_callback_);
+    auto timeout = t_completion_head != nullptr ? 0 : wait;
+    auto count = ::epoll_wait(loop->epoll, events, kMaxEpollEvents, timeout);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(kError, "epoll_wait failed, error code: %d.", errno);
+      break;
+    }
+    for (auto i = 0; i < count; ++i) {
+      if (events[i].data.u64 == kWakeupKey) {
+        // the eventfd stays readable once stopping so every thread of the loop wakes up,
+        // completions posted by the last closesocket calls still run first
+        if (stopping_) {
+          TakePostedCompletion(loop);
+          DispatchCompletion();
+          t_loop = nullptr;
+          return true;
+        }
+        uint64_t value = 0;
+        if (::read(loop->wakeup, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+          LOG(kError, "read epoll wakeup failed, error code: %d.", errno);
+        }
+        TakePostedCompletion(loop);
+      } else {
+        ProcessEvent(events[i]);
+      }
+    }
+    DispatchCompletion();
+  }
+  t_loop = nullptr;
+  return true;
+}
+
+} // namespace net
+
+int closesocket(SOCKET socket) {
+  using namespace net;
+  auto channel = g_channel.Get(socket, false);
+  if (channel == nullptr) {
+    return ::close(socket);
+  }
+  EpollLoop* loop = nullptr;
+  LPOVERLAPPED aborted_head = nullptr;
+  LPOVERLAPPED aborted_tail = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(channel->lock);
+    if (channel->open) {
+      channel->open = false;
+      ++channel->generation;
+      ::epoll_ctl(channel->loop->epoll, EPOLL_CTL_DEL, socket, nullptr);
+      loop = channel->loop;
+      while (channel->read_head != nullptr) {
+        PushBack(aborted_head, aborted_tail, PopFront(channel->read_head, channel->read_tail));
+      }
+      while (channel->write_head != nullptr) {
+        PushBack(aborted_head, aborted_tail, PopFront(channel->write_head, channel->write_tail));
+      }
+    }
+  }
+  auto result = ::close(socket);
+  // pending operations of a closed socket complete as aborted, like on windows
+  while (aborted_head != nullptr) {
+    auto ovlp = PopFront(aborted_head, aborted_tail);
+    Complete(ovlp, 0, ECONNABORTED);
+    PostCompletion(loop, ovlp);
+  }
+  return result;
+}
+
+int WSASend(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* sent, DWORD flags, LPOVERLAPPED ovlp, void* routine) {
+  return net::SubmitBuffers(ovlp, net::kOperationSend, socket, buffers, count);
+}
+
+int WSARecv(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* received, DWORD* flags, LPOVERLAPPED ovlp, void* routine) {
+  return net::SubmitBuffers(ovlp, net::kOperationRecv, socket, buffers, count);
+}
+
+int WSASendTo(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* sent, DWORD flags, const SOCKADDR* to, int to_size, LPOVERLAPPED ovlp, void* routine) {
+  if (to == nullptr || to_size < static_cast<int>(sizeof(SOCKADDR_IN)) || ovlp == nullptr) {
+    errno = EINVAL;
+    return SOCKET_ERROR;
+  }
+  memcpy(&ovlp->to_addr, to, sizeof(ovlp->to_addr));
+  return net::SubmitBuffers(ovlp, net::kOperationSendTo, socket, buffers, count);
+}
+
+int WSARecvFrom(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* received, DWORD* flags, SOCKADDR* from, PINT from_size, LPOVERLAPPED ovlp, void* routine) {
+  if (from == nullptr || from_size == nullptr || ovlp == nullptr) {
+    errno = EINVAL;
+    return SOCKET_ERROR;
+  }
+  ovlp->from_addr = reinterpret_cast<PSOCKADDR_IN>(from);
+  ovlp->from_size = from_size;
+  return net::SubmitBuffers(ovlp, net::kOperationRecvFrom, socket, buffers, count);
+}
+
+BOOL AcceptEx(SOCKET listen_socket, SOCKET accept_socket, void* buffer, DWORD receive_size, DWORD local_size, DWORD remote_size, DWORD* received, LPOVERLAPPED ovlp) {
+  if (ovlp == nullptr || accept_socket == INVALID_SOCKET) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  ovlp->operation = net::kOperationAccept;
+  ovlp->socket = listen_socket;
+  ovlp->accept_socket = accept_socket;
+  ovlp->iov_count = 0;
+  ovlp->iov_index = 0;
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  return net::Submit(ovlp) == 0 ? TRUE : FALSE;
+}
+
+BOOL ConnectEx(SOCKET socket, const SOCKADDR* name, int name_size, void* send_buffer, DWORD send_size, DWORD* sent, LPOVERLAPPED ovlp) {
+  if (ovlp == nullptr || name == nullptr || name_size < static_cast<int>(sizeof(SOCKADDR_IN)) || send_size != 0) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  memcpy(&ovlp->to_addr, name, sizeof(ovlp->to_addr));
+  ovlp->operation = net::kOperationConnect;
+  ovlp->socket = socket;
+  ovlp->iov = ovlp->iov_inline;
+  ovlp->iov_count = 0;
+  ovlp->iov_index = 0;
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  return net::Submit(ovlp) == 0 ? TRUE : FALSE;
+}
+
+int RecvMsgBatch(SOCKET socket, mmsghdr* msgs, unsigned int count, LPOVERLAPPED ovlp) {
+  return net::SubmitMsgBatch(ovlp, net::kOperationRecvBatch, socket, msgs, count);
+}
+
+int SendMsgBatch(SOCKET socket, mmsghdr* msgs, unsigned int count, LPOVERLAPPED ovlp) {
+  return net::SubmitMsgBatch(ovlp, net::kOperationSendBatch, socket, msgs, count);
+}
+
+#endif // !_WIN32 && !NET_USE_IO_URING
@@ -0,0 +1,1160 @@
+#include "iocp.h"
+#include "channel_table.h"
+#include "log.h"
+#include "thread_affinity.h"
+
+#if !defined(_WIN32) && defined(NET_USE_IO_URING)
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <utility>
+
+namespace net {
+
+namespace {
+
+const int kOperationAccept = 1;
+const int kOperationSend = 2;
+const int kOperationRecv = 3;
+const int kOperationSendTo = 4;
+const int kOperationRecvFrom = 5;
+const int kOperationConnect = 6;
+const int kOperationRecvBatch = 7;
+const int kOperationSendBatch = 8;
+
+const unsigned int kRingEntries = 4096;
+const unsigned int kCompletionEntries = 16384;
+const unsigned int kProvidedBufferCount = 256;
+const unsigned int kProvidedBufferSize = 8 * 1024;
+const unsigned short kProvidedBufferGroup = 0;
+// provided buffers a socket may hold before its multishot recv is cancelled, one receive
+// ring's worth, so a fast sender can not take every buffer of the ring from the others
+const size_t kMaxParkedSegments = 8;
+const unsigned int kMaxFixedFile = 65536;
+// how long a stopping worker waits for the cancelled requests of the closed sockets
+const int kStopDrainTimeout = 1000;
+
+// user_data of a single shot request is its OVERLAPPED, whose low bits are zero,
+// multishot requests pack descriptor, channel generation and kind instead
+const uint64_t kKindOverlapped = 0;
+const uint64_t kKindRecv = 1;
+const uint64_t kKindAccept = 2;
+const uint64_t kKindIgnore = 3;
+const uint64_t kKindMask = 3;
+const unsigned int kGenerationMask = 0x3FFFFFFF;
+
+int RingSetup(unsigned int entries, io_uring_params* params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int RingEnter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+// waits for a completion at most timeout milliseconds, an expired wait fails with ETIME
+int RingWait(int fd, unsigned int to_submit, int timeout) {
+  __kernel_timespec ts;
+  ts.tv_sec = timeout / 1000;
+  ts.tv_nsec = static_cast<long long>(timeout % 1000) * 1000000;
+  io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = reinterpret_cast<uint64_t>(&ts);
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)));
+}
+
+int RingRegister(int fd, unsigned int opcode, void* arg, unsigned int count) {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+} // namespace
+
+// one ring per worker thread, only the owner thread reaps it. any thread may queue
+// submissions, the owner's own submissions ride along with its next wait
+struct UringQueue {
+  int index;
+  int fd;
+  IOCP* port;
+  std::mutex sq_lock;
+  unsigned int* sq_head;
+  unsigned int* sq_tail;
+  unsigned int sq_mask;
+  unsigned int sq_entries;
+  unsigned int sqe_tail;
+  io_uring_sqe* sqes;
+  std::atomic<unsigned int> unsubmitted;
+  std::atomic<int> inflight;    // single shot requests queued and not reaped yet
+  unsigned int* cq_head;
+  unsigned int* cq_tail;
+  unsigned int cq_mask;
+  io_uring_cqe* cqes;
+  void* sq_ring;
+  size_t sq_ring_size;
+  void* cq_ring;
+  size_t cq_ring_size;
+  size_t sqes_size;
+  char* buffer;
+  std::atomic<bool> recycled;
+  std::mutex starved_lock;
+  std::vector<std::pair<SOCKET, unsigned int>> starved;
+  std::mutex file_lock;
+  std::vector<int> free_file;
+  std::mutex posted_lock;
+  LPOVERLAPPED posted_head;
+  LPOVERLAPPED posted_tail;
+  UringQueue() : index(0), fd(-1), port(nullptr), sq_head(nullptr), sq_tail(nullptr), sq_mask(0), sq_entries(0), sqe_tail(0),
+    sqes(nullptr), unsubmitted(0), inflight(0), cq_head(nullptr), cq_tail(nullptr), cq_mask(0), cqes(nullptr),
+    sq_ring(MAP_FAILED), sq_ring_size(0), cq_ring(MAP_FAILED), cq_ring_size(0), sqes_size(0),
+    buffer(nullptr), recycled(false), posted_head(nullptr), posted_tail(nullptr) {}
+};
+
+namespace {
+
+struct Segment {
+  unsigned short bid;
+  int offset;
+  int size;
+};
+
+// a socket bound to a ring. received data and accepted descriptors produced by the
+// multishot requests wait here until a WSARecv or AcceptEx picks them up
+struct Channel {
+  std::mutex lock;
+  unsigned int generation;
+  bool open;
+  bool recv_armed;
+  bool recv_parked;             // the armed recv is being cancelled, the socket holds enough buffers
+  bool accept_armed;
+  bool eof;
+  int recv_error;
+  int file;
+  UringQueue* ring;
+  LPOVERLAPPED read_head;
+  LPOVERLAPPED read_tail;
+  std::deque<Segment> segment;
+  std::deque<SOCKET> accepted;
+  Channel() : generation(0), open(false), recv_armed(false), recv_parked(false), accept_armed(false), eof(false), recv_error(0),
+    file(-1), ring(nullptr), read_head(nullptr), read_tail(nullptr) {}
+};
+
+ChannelTable<Channel> g_channel;
+
+thread_local UringQueue* t_ring = nullptr;
+thread_local LPOVERLAPPED t_completion_head = nullptr;
+thread_local LPOVERLAPPED t_completion_tail = nullptr;
+
+void PushBack(LPOVERLAPPED& head, LPOVERLAPPED& tail, LPOVERLAPPED ovlp) {
+  ovlp->next = nullptr;
+  if (tail == nullptr) {
+    head = ovlp;
+  } else {
+    tail->next = ovlp;
+  }
+  tail = ovlp;
+}
+
+LPOVERLAPPED PopFront(LPOVERLAPPED& head, LPOVERLAPPED& tail) {
+  auto ovlp = head;
+  head = ovlp->next;
+  if (head == nullptr) {
+    tail = nullptr;
+  }
+  ovlp->next = nullptr;
+  return ovlp;
+}
+
+void Complete(LPOVERLAPPED ovlp, DWORD transferred, int error) {
+  ovlp->transferred = transferred;
+  ovlp->error = error;
+}
+
+uint64_t PackUserData(SOCKET socket, unsigned int generation, uint64_t kind) {
+  return (static_cast<uint64_t>(static_cast<unsigned int>(socket)) << 32) |
+    (static_cast<uint64_t>(generation & kGenerationMask) << 2) | kind;
+}
+
+void PostCompletion(UringQueue* ring, LPOVERLAPPED ovlp);
+
+// sq_lock must be held, makes room by submitting when the ring is full
+io_uring_sqe* GetSqe(UringQueue* ring) {
+  while (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+    auto to_submit = ring->unsubmitted.exchange(0);
+    auto submitted = RingEnter(ring->fd, to_submit, 0, 0);
+    if (submitted < 0) {
+      ring->unsubmitted += to_submit;
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        LOG(kError, "io_uring_enter submit failed, error code: %d.", errno);
+        return nullptr;
+      }
+    } else if (static_cast<unsigned int>(submitted) < to_submit) {
+      ring->unsubmitted += to_submit - submitted;
+    }
+  }
+  return &ring->sqes[ring->sqe_tail & ring->sq_mask];
+}
+
+bool QueueSqe(UringQueue* ring, const io_uring_sqe& prepared, bool flush) {
+  std::lock_guard<std::mutex> lock(ring->sq_lock);
+  auto sqe = GetSqe(ring);
+  if (sqe == nullptr) {
+    return false;
+  }
+  *sqe = prepared;
+  ++ring->sqe_tail;
+  __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+  ++ring->unsubmitted;
+  if (flush || t_ring != ring) {
+    auto to_submit = ring->unsubmitted.exchange(0);
+    auto submitted = RingEnter(ring->fd, to_submit, 0, 0);
+    if (submitted < 0) {
+      ring->unsubmitted += to_submit;
+      LOG(kError, "io_uring_enter submit failed, error code: %d.", errno);
+    } else if (static_cast<unsigned int>(submitted) < to_submit) {
+      ring->unsubmitted += to_submit - submitted;
+    }
+  }
+  return true;
+}
+
+void PrepareSqe(io_uring_sqe& sqe, int opcode, const Channel* channel, SOCKET socket, uint64_t user_data) {
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = static_cast<unsigned char>(opcode);
+  if (channel->file >= 0) {
+    sqe.fd = channel->file;
+    sqe.flags |= IOSQE_FIXED_FILE;
+  } else {
+    sqe.fd = socket;
+  }
+  sqe.user_data = user_data;
+}
+
+// a request carrying an OVERLAPPED, counted until its completion is reaped
+bool QueueSingleShot(UringQueue* ring, const io_uring_sqe& sqe) {
+  ++ring->inflight;
+  if (!QueueSqe(ring, sqe, false)) {
+    --ring->inflight;
+    return false;
+  }
+  return true;
+}
+
+// hand provided buffers back to the kernel, the owner thread's requests ride along with its next wait
+void ProvideBuffer(UringQueue* ring, unsigned short bid, unsigned int count) {
+  io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe.fd = static_cast<int>(count);
+  sqe.addr = reinterpret_cast<uint64_t>(ring->buffer + static_cast<size_t>(bid) * kProvidedBufferSize);
+  sqe.len = kProvidedBufferSize;
+  sqe.off = bid;
+  sqe.buf_group = kProvidedBufferGroup;
+  sqe.user_data = kKindIgnore;
+  QueueSqe(ring, sqe, false);
+}
+
+void RecycleBuffer(UringQueue* ring, unsigned short bid) {
+  ProvideBuffer(ring, bid, 1);
+  ring->recycled = true;
+}
+
+int AcquireFile(UringQueue* ring, SOCKET socket) {
+  std::lock_guard<std::mutex> lock(ring->file_lock);
+  if (ring->free_file.empty()) {
+    return -1;
+  }
+  auto file = ring->free_file.back();
+  io_uring_files_update update = {0};
+  update.offset = file;
+  update.fds = reinterpret_cast<uint64_t>(&socket);
+  if (RingRegister(ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) != 1) {
+    return -1;
+  }
+  ring->free_file.pop_back();
+  return file;
+}
+
+void ReleaseFile(UringQueue* ring, int file) {
+  std::lock_guard<std::mutex> lock(ring->file_lock);
+  int empty = -1;
+  io_uring_files_update update = {0};
+  update.offset = file;
+  update.fds = reinterpret_cast<uint64_t>(&empty);
+  RingRegister(ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+  ring->free_file.push_back(file);
+}
+
+// channel lock held for the Arm*/Match* helpers below
+void ArmRecv(Channel* channel, SOCKET socket) {
+  io_uring_sqe sqe;
+  PrepareSqe(sqe, IORING_OP_RECV, channel, socket, PackUserData(socket, channel->generation, kKindRecv));
+  sqe.ioprio = IORING_RECV_MULTISHOT;
+  sqe.flags |= IOSQE_BUFFER_SELECT;
+  sqe.buf_group = kProvidedBufferGroup;
+  channel->recv_armed = QueueSqe(channel->ring, sqe, false);
+}
+
+// a recv is armed only for a waiting WSARecv and while the socket holds few provided buffers
+bool WantRecv(const Channel* channel) {
+  return channel->read_head != nullptr && !channel->recv_armed && !channel->eof && channel->recv_error == 0 &&
+    channel->segment.size() < kMaxParkedSegments;
+}
+
+// stops the multishot recv of a socket holding kMaxParkedSegments, unread data waits in the
+// socket buffer and the peer is throttled by tcp until a WSARecv takes the segments
+void ParkRecv(Channel* channel, SOCKET socket) {
+  if (!channel->recv_armed || channel->recv_parked || channel->segment.size() < kMaxParkedSegments) {
+    return;
+  }
+  io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_ASYNC_CANCEL;
+  sqe.addr = PackUserData(socket, channel->generation, kKindRecv);
+  sqe.user_data = kKindIgnore;
+  channel->recv_parked = QueueSqe(channel->ring, sqe, false);
+}
+
+void ArmAccept(Channel* channel, SOCKET socket) {
+  io_uring_sqe sqe;
+  PrepareSqe(sqe, IORING_OP_ACCEPT, channel, socket, PackUserData(socket, channel->generation, kKindAccept));
+  sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe.accept_flags = SOCK_CLOEXEC;
+  channel->accept_armed = QueueSqe(channel->ring, sqe, false);
+}
+
+// hand buffered stream data to the waiting WSARecv, several provided buffers
+// are coalesced into one completion when the caller's buffer has room.
+// the bytes are copied: the receive ring of the connection stays the buffer the
+// packets are parsed from, the provided buffers only stage data for it
+void MatchRecv(Channel* channel) {
+  while (channel->read_head != nullptr && (!channel->segment.empty() || channel->eof || channel->recv_error != 0)) {
+    auto ovlp = PopFront(channel->read_head, channel->read_tail);
+    if (channel->segment.empty()) {
+      Complete(ovlp, 0, channel->recv_error);
+      PostCompletion(channel->ring, ovlp);
+      continue;
+    }
+    DWORD copied = 0;
+    for (auto i = 0; i < ovlp->iov_count && !channel->segment.empty(); ++i) {
+      size_t iov_offset = 0;
+      while (iov_offset < ovlp->iov[i].iov_len && !channel->segment.empty()) {
+        auto& segment = channel->segment.front();
+        auto size = std::min(ovlp->iov[i].iov_len - iov_offset, static_cast<size_t>(segment.size - segment.offset));
+        auto source = channel->ring->buffer + static_cast<size_t>(segment.bid) * kProvidedBufferSize + segment.offset;
+        memcpy(static_cast<char*>(ovlp->iov[i].iov_base) + iov_offset, source, size);
+        iov_offset += size;
+        segment.offset += static_cast<int>(size);
+        copied += static_cast<DWORD>(size);
+        if (segment.offset == segment.size) {
+          RecycleBuffer(channel->ring, segment.bid);
+          channel->segment.pop_front();
+        }
+      }
+    }
+    Complete(ovlp, copied, 0);
+    PostCompletion(channel->ring, ovlp);
+  }
+}
+
+void MatchAccept(Channel* channel) {
+  while (channel->read_head != nullptr && !channel->accepted.empty()) {
+    auto ovlp = PopFront(channel->read_head, channel->read_tail);
+    auto new_socket = channel->accepted.front();
+    channel->accepted.pop_front();
+    // AcceptEx accepts into a socket the caller created, keep that descriptor number alive
+    auto result = ::dup3(new_socket, ovlp->accept_socket, O_CLOEXEC);
+    auto error = errno;
+    ::close(new_socket);
+    Complete(ovlp, 0, result < 0 ? error : 0);
+    PostCompletion(channel->ring, ovlp);
+  }
+}
+
+void PostCompletion(UringQueue* ring, LPOVERLAPPED ovlp) {
+  if (t_ring == ring) {
+    PushBack(t_completion_head, t_completion_tail, ovlp);
+    return;
+  }
+  bool was_empty = false;
+  {
+    std::lock_guard<std::mutex> lock(ring->posted_lock);
+    was_empty = ring->posted_head == nullptr;
+    PushBack(ring->posted_head, ring->posted_tail, ovlp);
+  }
+  if (was_empty) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_NOP;
+    sqe.user_data = kKindIgnore;
+    QueueSqe(ring, sqe, true);
+  }
+}
+
+bool IsMsgBatch(LPOVERLAPPED ovlp) {
+  return ovlp->operation == kOperationRecvBatch || ovlp->operation == kOperationSendBatch;
+}
+
+// the ring has no request moving several datagrams: a batch moves what it can without
+// blocking and waits for readiness through a single shot poll otherwise.
+// false means nothing could be moved yet, errno is left from the last attempt
+bool PerformMsgBatch(LPOVERLAPPED ovlp) {
+  if (ovlp->operation == kOperationRecvBatch) {
+    while (true) {
+      auto count = ::recvmmsg(ovlp->socket, ovlp->msgs, ovlp->msg_count, MSG_DONTWAIT, nullptr);
+      if (count >= 0) {
+        Complete(ovlp, static_cast<DWORD>(count), 0);
+        return true;
+      }
+      if (errno == EINTR || errno == ECONNREFUSED) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return false;
+      }
+      Complete(ovlp, 0, errno);
+      return true;
+    }
+  }
+  // sendmmsg stops at the first datagram failing, it is skipped and the rest go on
+  while (ovlp->msg_index < ovlp->msg_count) {
+    auto count = ::sendmmsg(ovlp->socket, &ovlp->msgs[ovlp->msg_index], ovlp->msg_count - ovlp->msg_index, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return false;
+      }
+      ++ovlp->msg_index;
+      continue;
+    }
+    ovlp->msg_index += count;
+    ovlp->transferred += static_cast<DWORD>(count);
+  }
+  Complete(ovlp, ovlp->transferred, 0);
+  return true;
+}
+
+bool SubmitSingleShot(LPOVERLAPPED ovlp) {
+  auto channel = g_channel.Get(ovlp->socket, false);
+  if (channel == nullptr) {
+    errno = ENOTSOCK;
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(channel->lock);
+  if (!channel->open) {
+    errno = ENOTSOCK;
+    return false;
+  }
+  io_uring_sqe sqe;
+  if (IsMsgBatch(ovlp)) {
+    if (PerformMsgBatch(ovlp)) {
+      PostCompletion(channel->ring, ovlp);
+      return true;
+    }
+    PrepareSqe(sqe, IORING_OP_POLL_ADD, channel, ovlp->socket, reinterpret_cast<uint64_t>(ovlp));
+    sqe.poll32_events = ovlp->operation == kOperationRecvBatch ? POLLIN : POLLOUT;
+    if (!QueueSingleShot(channel->ring, sqe)) {
+      errno = EAGAIN;
+      return false;
+    }
+    return true;
+  }
+  if (ovlp->operation == kOperationConnect) {
+    PrepareSqe(sqe, IORING_OP_CONNECT, channel, ovlp->socket, reinterpret_cast<uint64_t>(ovlp));
+    sqe.addr = reinterpret_cast<uint64_t>(&ovlp->to_addr);
+    sqe.off = sizeof(ovlp->to_addr);
+    if (!QueueSingleShot(channel->ring, sqe)) {
+      errno = EAGAIN;
+      return false;
+    }
+    return true;
+  }
+  memset(&ovlp->msg, 0, sizeof(ovlp->msg));
+  ovlp->msg.msg_iov = &ovlp->iov[ovlp->iov_index];
+  ovlp->msg.msg_iovlen = ovlp->iov_count - ovlp->iov_index;
+  if (ovlp->operation == kOperationRecvFrom) {
+    ovlp->msg.msg_name = ovlp->from_addr;
+    ovlp->msg.msg_namelen = *ovlp->from_size;
+    PrepareSqe(sqe, IORING_OP_RECVMSG, channel, ovlp->socket, reinterpret_cast<uint64_t>(ovlp));
+  } else {
+    if (ovlp->operation == kOperationSendTo) {
+      ovlp->msg.msg_name = &ovlp->to_addr;
+      ovlp->msg.msg_namelen = sizeof(ovlp->to_addr);
+    }
+    PrepareSqe(sqe, IORING_OP_SENDMSG, channel, ovlp->socket, reinterpret_cast<uint64_t>(ovlp));
+    sqe.msg_flags = MSG_NOSIGNAL | (ovlp->operation == kOperationSend ? MSG_WAITALL : 0);
+  }
+  sqe.addr = reinterpret_cast<uint64_t>(&ovlp->msg);
+  sqe.len = 1;
+  if (!QueueSingleShot(channel->ring, sqe)) {
+    errno = EAGAIN;
+    return false;
+  }
+  return true;
+}
+
+// a stream send completes only when every byte is written, like WSASend does
+void OnSingleShot(LPOVERLAPPED ovlp, int result) {
+  if (IsMsgBatch(ovlp)) {
+    if (result < 0) {
+      Complete(ovlp, ovlp->transferred, -result);
+    } else if (SubmitSingleShot(ovlp)) {
+      return;
+    } else {
+      Complete(ovlp, ovlp->transferred, errno);
+    }
+    PushBack(t_completion_head, t_completion_tail, ovlp);
+    return;
+  }
+  if (result < 0) {
+    if (ovlp->operation == kOperationRecvFrom && result == -ECONNREFUSED && SubmitSingleShot(ovlp)) {
+      return;
+    }
+    Complete(ovlp, 0, -result);
+    PushBack(t_completion_head, t_completion_tail, ovlp);
+    return;
+  }
+  if (ovlp->operation == kOperationConnect) {
+    Complete(ovlp, 0, 0);
+    PushBack(t_completion_head, t_completion_tail, ovlp);
+    return;
+  }
+  if (ovlp->operation == kOperationRecvFrom) {
+    *ovlp->from_size = ovlp->msg.msg_namelen;
+    Complete(ovlp, static_cast<DWORD>(result), 0);
+    PushBack(t_completion_head, t_completion_tail, ovlp);
+    return;
+  }
+  ovlp->transferred += static_cast<DWORD>(result);
+  size_t size = static_cast<size_t>(result);
+  while (size > 0 && ovlp->iov_index < ovlp->iov_count) {
+    auto& iov = ovlp->iov[ovlp->iov_index];
+    if (size < iov.iov_len) {
+      iov.iov_base = static_cast<char*>(iov.iov_base) + size;
+      iov.iov_len -= size;
+      size = 0;
+    } else {
+      size -= iov.iov_len;
+      ++ovlp->iov_index;
+    }
+  }
+  if (ovlp->operation == kOperationSend && ovlp->iov_index < ovlp->iov_count && SubmitSingleShot(ovlp)) {
+    return;
+  }
+  Complete(ovlp, ovlp->transferred, 0);
+  PushBack(t_completion_head, t_completion_tail, ovlp);
+}
+
+void OnMultiShot(const io_uring_cqe& cqe, UringQueue* ring) {
+  auto kind = cqe.user_data & kKindMask;
+  auto socket = static_cast<SOCKET>(cqe.user_data >> 32);
+  auto generation = static_cast<unsigned int>((cqe.user_data >> 2) & kGenerationMask);
+  auto has_buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+  auto bid = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+  auto more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+  auto channel = g_channel.Get(socket, false);
+  std::unique_lock<std::mutex> lock;
+  if (channel != nullptr) {
+    lock = std::unique_lock<std::mutex>(channel->lock);
+  }
+  if (channel == nullptr || !channel->open || (channel->generation & kGenerationMask) != generation) {
+    if (has_buffer) {
+      RecycleBuffer(ring, bid);
+    }
+    if (kind == kKindAccept && cqe.res >= 0) {
+      ::close(cqe.res);
+    }
+    return;
+  }
+  if (kind == kKindRecv) {
+    if (!more) {
+      channel->recv_armed = false;
+      channel->recv_parked = false;
+    }
+    if (cqe.res > 0 && has_buffer) {
+      Segment segment = {bid, 0, cqe.res};
+      channel->segment.push_back(segment);
+    } else if (cqe.res == 0) {
+      channel->eof = true;
+    } else if (cqe.res == -ENOBUFS) {
+      // every provided buffer is parked in some channel, retry once one comes back
+      std::lock_guard<std::mutex> starved_lock(ring->starved_lock);
+      ring->starved.push_back(std::make_pair(socket, channel->generation));
+      return;
+    } else if (cqe.res < 0 && cqe.res != -ECANCELED) {
+      channel->recv_error = -cqe.res;
+    }
+    MatchRecv(channel);
+    if (WantRecv(channel)) {
+      ArmRecv(channel, socket);
+    } else {
+      ParkRecv(channel, socket);
+    }
+  } else {
+    if (!more) {
+      channel->accept_armed = false;
+    }
+    if (cqe.res >= 0) {
+      channel->accepted.push_back(cqe.res);
+      MatchAccept(channel);
+    } else if (cqe.res != -ECANCELED && channel->read_head != nullptr) {
+      auto ovlp = PopFront(channel->read_head, channel->read_tail);
+      Complete(ovlp, 0, -cqe.res);
+      PostCompletion(ring, ovlp);
+    }
+  }
+}
+
+void ReapCompletion(UringQueue* ring) {
+  auto head = *ring->cq_head;
+  auto tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    auto cqe = ring->cqes[head & ring->cq_mask];
+    ++head;
+    // publish the slot before handling, handlers may queue new requests
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    auto kind = cqe.user_data & kKindMask;
+    if (kind == kKindOverlapped && cqe.user_data != 0) {
+      --ring->inflight;
+      OnSingleShot(reinterpret_cast<LPOVERLAPPED>(cqe.user_data), cqe.res);
+    } else if (kind == kKindRecv || kind == kKindAccept) {
+      OnMultiShot(cqe, ring);
+    }
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+  }
+}
+
+// re-arm the multishot recv of sockets that ran out of provided buffers
+void RearmStarved(UringQueue* ring) {
+  std::vector<std::pair<SOCKET, unsigned int>> starved;
+  {
+    std::lock_guard<std::mutex> lock(ring->starved_lock);
+    starved.swap(ring->starved);
+  }
+  for (const auto& i : starved) {
+    auto channel = g_channel.Get(i.first, false);
+    if (channel == nullptr) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(channel->lock);
+    if (channel->open && channel->generation == i.second && WantRecv(channel)) {
+      ArmRecv(channel, i.first);
+    }
+  }
+}
+
+bool HasCompletion(UringQueue* ring) {
+  return *ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+void DestroyRing(UringQueue* ring) {
+  if (ring->fd >= 0) {
+    ::close(ring->fd);
+  }
+  if (ring->sqes != nullptr) {
+    ::munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+    ::munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring != MAP_FAILED) {
+    ::munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  delete[] ring->buffer;
+  delete ring;
+}
+
+UringQueue* CreateRing(IOCP* port) {
+  auto ring = new UringQueue;
+  ring->port = port;
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+  params.cq_entries = kCompletionEntries;
+  ring->fd = RingSetup(kRingEntries, &params);
+  if (ring->fd < 0) {
+    LOG(kStartup, "io_uring_setup failed, error code: %d.", errno);
+    DestroyRing(ring);
+    return nullptr;
+  }
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->sq_ring_size = ring->cq_ring_size = std::max(ring->sq_ring_size, ring->cq_ring_size);
+  }
+  ring->sq_ring = ::mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED) {
+    LOG(kStartup, "mmap io_uring submission ring failed, error code: %d.", errno);
+    DestroyRing(ring);
+    return nullptr;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->cq_ring = ::mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED) {
+      LOG(kStartup, "mmap io_uring completion ring failed, error code: %d.", errno);
+      DestroyRing(ring);
+      return nullptr;
+    }
+  }
+  ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  auto sqes = ::mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    LOG(kStartup, "mmap io_uring sqes failed, error code: %d.", errno);
+    DestroyRing(ring);
+    return nullptr;
+  }
+  ring->sqes = static_cast<io_uring_sqe*>(sqes);
+  auto sq = static_cast<char*>(ring->sq_ring);
+  auto cq = static_cast<char*>(ring->cq_ring);
+  ring->sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+  ring->sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+  ring->sq_mask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+  ring->sq_entries = params.sq_entries;
+  ring->sqe_tail = *ring->sq_tail;
+  auto sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+  for (unsigned int i = 0; i < params.sq_entries; ++i) {
+    sq_array[i] = i;
+  }
+  ring->cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+  ring->cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+  ring->cq_mask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+  ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  // provided buffers shared by the multishot recv of every socket on this ring
+  ring->buffer = new char[static_cast<size_t>(kProvidedBufferCount) * kProvidedBufferSize];
+  ProvideBuffer(ring, 0, kProvidedBufferCount);
+
+  // sparse registered file table, sockets fall back to plain descriptors when it is full
+  rlimit limit = {0};
+  auto file_count = kMaxFixedFile;
+  if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < file_count) {
+    file_count = static_cast<unsigned int>(limit.rlim_cur);
+  }
+  std::vector<int> empty_file(file_count, -1);
+  if (file_count > 0 && RingRegister(ring->fd, IORING_REGISTER_FILES, &empty_file[0], file_count) == 0) {
+    ring->free_file.reserve(file_count);
+    for (auto i = static_cast<int>(file_count) - 1; i >= 0; --i) {
+      ring->free_file.push_back(i);
+    }
+  } else {
+    LOG(kStartup, "register io_uring files failed, error code: %d.", errno);
+  }
+  return ring;
+}
+
+} // namespace
+
+IOCP::IOCP() {
+  init_ = false;
+  per_core_ = false;
+  cpu_mask_ = 0;
+  next_loop_ = 0;
+  next_timer_loop_ = 0;
+  stopping_ = false;
+}
+
+IOCP::~IOCP() {
+  Uninit();
+}
+
+bool IOCP::Init(std::function<bool (LPOVERLAPPED, DWORD)> callback, std::function<void (const TimerEvent&)> timer_callback, const NetOptions& options) {
+  if (init_) {
+    return true;
+  }
+  if (!callback || !timer_callback) {
+    LOG(kStartup, "initialize IOCP failed: invalid callback parameter.");
+    return false;
+  }
+  callback_ = callback;
+  timer_callback_ = timer_callback;
+  init_ = true;
+  per_core_ = options.per_core;
+  cpu_mask_ = options.cpu_mask;
+  thread_name_ = options.thread_name;
+  next_loop_ = 0;
+  stopping_ = false;
+  // a ring is always served by one thread, per core only changes the count and pins them
+  for (auto i = 0; i < options.thread_count; ++i) {
+    auto ring = CreateRing(this);
+    if (ring == nullptr) {
+      Uninit();
+      return false;
+    }
+    ring->index = i;
+    ring_.push_back(ring);
+  }
+  CreateTimerWheel(static_cast<int>(ring_.size()));
+  for (const auto& ring : ring_) {
+    auto new_thread = new std::thread(std::bind(&IOCP::ThreadWorker, this, ring, ring->index));
+    iocp_thread_.push_back(new_thread);
+  }
+  return true;
+}
+
+void IOCP::Uninit() {
+  if (!init_) {
+    return;
+  }
+  stopping_ = true;
+  for (const auto& ring : ring_) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_NOP;
+    sqe.user_data = kKindIgnore;
+    QueueSqe(ring, sqe, true);
+  }
+  for (const auto& i : iocp_thread_) {
+    i->join();
+    delete i;
+  }
+  iocp_thread_.clear();
+  for (const auto& ring : ring_) {
+    DestroyRing(ring);
+  }
+  ring_.clear();
+  DestroyTimerWheel();
+  callback_ = nullptr;
+  timer_callback_ = nullptr;
+  init_ = false;
+}
+
+bool IOCP::BindToIOCP(SOCKET socket, int& loop) {
+  auto channel = g_channel.Get(socket, true);
+  if (channel == nullptr || ring_.empty()) {
+    LOG(kError, "BindToIOCP failed: invalid socket parameter.");
+    return false;
+  }
+  auto ring = ring_[next_loop_++ % ring_.size()];
+  std::lock_guard<std::mutex> lock(channel->lock);
+  ++channel->generation;
+  channel->open = true;
+  channel->recv_armed = false;
+  channel->recv_parked = false;
+  channel->accept_armed = false;
+  channel->eof = false;
+  channel->recv_error = 0;
+  channel->ring = ring;
+  channel->file = AcquireFile(ring, socket);
+  channel->read_head = channel->read_tail = nullptr;
+  channel->segment.clear();
+  channel->accepted.clear();
+  loop = ring->index;
+  return true;
+}
+
+bool IOCP::PostToLoop(int loop, LPOVERLAPPED ovlp) {
+  if (loop < 0 || loop >= static_cast<int>(ring_.size()) || ovlp == nullptr) {
+    LOG(kError, "post to loop failed: invalid parameter.");
+    return false;
+  }
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  net::PostCompletion(ring_[loop], ovlp);
+  return true;
+}
+
+int IOCP::CurrentLoop() {
+  return t_ring != nullptr ? t_ring->index : -1;
+}
+
+void IOCP::WakeLoop(int loop) {
+  io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_NOP;
+  sqe.user_data = kKindIgnore;
+  QueueSqe(ring_[loop], sqe, true);
+}
+
+void IOCP::TakePostedCompletion(UringQueue* ring) {
+  std::lock_guard<std::mutex> lock(ring->posted_lock);
+  while (ring->posted_head != nullptr) {
+    PushBack(t_completion_head, t_completion_tail, PopFront(ring->posted_head, ring->posted_tail));
+  }
+}
+
+// only what is queued now is dispatched, operations re-posted by callbacks wait for the next round
+void IOCP::DispatchCompletion() {
+  auto head = t_completion_head;
+  t_completion_head = nullptr;
+  t_completion_tail = nullptr;
+  while (head != nullptr) {
+    auto ovlp = head;
+    head = head->next;
+    ovlp->next = nullptr;
+    if (callback_) {
+      callback_(ovlp, ovlp->transferred);
+    }
+  }
+}
+
+bool IOCP::ThreadWorker(UringQueue* ring, int index) {
+  if (!InitIoThread(thread_name_, cpu_mask_, per_core_, index)) {
+    LOG(kStartup, "set affinity of io thread %d failed.", index);
+  }
+  t_ring = ring;
+  auto timer_wheel = timer_wheel_[ring->index];
+  while (!stopping_) {
+    auto timeout = timer_wheel->Advance(timer_callback_);
+    auto wait = t_completion_head == nullptr && !HasCompletion(ring);
+    auto to_submit = ring->unsubmitted.exchange(0);
+    auto result = wait && timeout >= 0 ? RingWait(ring->fd, to_submit, timeout) :
+      RingEnter(ring->fd, to_submit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+    if (result < 0) {
+      ring->unsubmitted += to_submit;
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME) {
+        LOG(kError, "io_uring_enter failed, error code: %d.", errno);
+        break;
+      }
+    } else if (static_cast<unsigned int>(result) < to_submit) {
+      ring->unsubmitted += to_submit - result;
+    }
+    ReapCompletion(ring);
+    if (ring->recycled.exchange(false)) {
+      RearmStarved(ring);
+    }
+    TakePostedCompletion(ring);
+    DispatchCompletion();
+  }
+  // the closed sockets cancelled their requests, the buffers those carry come back
+  // through their completions, so run them and what was posted before leaving
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kStopDrainTimeout);
+  while (true) {
+    ReapCompletion(ring);
+    TakePostedCompletion(ring);
+    DispatchCompletion();
+    if (ring->inflight <= 0) {
+      break;
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      LOG(kError, "io thread %d stopped with %d requests outstanding.", index, ring->inflight.load());
+      break;
+    }
+    auto to_submit = ring->unsubmitted.exchange(0);
+    if (RingWait(ring->fd, to_submit, 10) < 0 && errno != EINTR && errno != ETIME) {
+      ring->unsubmitted += to_submit;
+    }
+  }
+  t_ring = nullptr;
+  return true;
+}
+
+} // namespace net
+
+int closesocket(SOCKET socket) {
+  using namespace net;
+  auto channel = g_channel.Get(socket, false);
+  if (channel == nullptr) {
+    return ::close(socket);
+  }
+  UringQueue* ring = nullptr;
+  LPOVERLAPPED aborted_head = nullptr;
+  LPOVERLAPPED aborted_tail = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(channel->lock);
+    if (channel->open) {
+      ring = channel->ring;
+      // cancel before the registered file slot goes away, otherwise the cancel can not find it
+      io_uring_sqe sqe;
+      PrepareSqe(sqe, IORING_OP_ASYNC_CANCEL, channel, socket, kKindIgnore);
+      sqe.flags &= ~IOSQE_FIXED_FILE;
+      sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL |
+        (channel->file >= 0 ? IORING_ASYNC_CANCEL_FD_FIXED : 0);
+      QueueSqe(ring, sqe, true);
+      if (channel->file >= 0) {
+        ReleaseFile(ring, channel->file);
+        channel->file = -1;
+      }
+      channel->open = false;
+      ++channel->generation;
+      while (channel->read_head != nullptr) {
+        PushBack(aborted_head, aborted_tail, PopFront(channel->read_head, channel->read_tail));
+      }
+      for (const auto& i : channel->segment) {
+        RecycleBuffer(ring, i.bid);
+      }
+      channel->segment.clear();
+      for (const auto& i : channel->accepted) {
+        ::close(i);
+      }
+      channel->accepted.clear();
+    }
+  }
+  ::shutdown(socket, SHUT_RDWR);
+  auto result = ::close(socket);
+  // pending operations of a closed socket complete as aborted, like on windows
+  while (aborted_head != nullptr) {
+    auto ovlp = PopFront(aborted_head, aborted_tail);
+    Complete(ovlp, 0, ECONNABORTED);
+    PostCompletion(ring, ovlp);
+  }
+  return result;
+}
+
+namespace {
+
+int SubmitBuffers(LPOVERLAPPED ovlp, int operation, SOCKET socket, WSABUF* buffers, DWORD count) {
+  if (ovlp == nullptr || buffers == nullptr || count == 0) {
+    errno = EINVAL;
+    return SOCKET_ERROR;
+  }
+  ovlp->operation = operation;
+  ovlp->socket = socket;
+  ovlp->iov_count = count;
+  ovlp->iov_index = 0;
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  if (count > static_cast<DWORD>(kOverlappedIovecSize)) {
+    ovlp->iov = reinterpret_cast<iovec*>(buffers);
+  } else {
+    ovlp->iov = ovlp->iov_inline;
+    for (DWORD i = 0; i < count; ++i) {
+      ovlp->iov[i].iov_base = buffers[i].buf;
+      ovlp->iov[i].iov_len = buffers[i].len;
+    }
+  }
+  if (operation != net::kOperationRecv) {
+    if (!net::SubmitSingleShot(ovlp)) {
+      return SOCKET_ERROR;
+    }
+    errno = ERROR_IO_PENDING;
+    return SOCKET_ERROR;
+  }
+  auto channel = net::g_channel.Get(socket, false);
+  if (channel == nullptr) {
+    errno = ENOTSOCK;
+    return SOCKET_ERROR;
+  }
+  std::lock_guard<std::mutex> lock(channel->lock);
+  if (!channel->open) {
+    errno = ENOTSOCK;
+    return SOCKET_ERROR;
+  }
+  net::PushBack(channel->read_head, channel->read_tail, ovlp);
+  net::MatchRecv(channel);
+  if (net::WantRecv(channel)) {
+    net::ArmRecv(channel, socket);
+  }
+  errno = ERROR_IO_PENDING;
+  return SOCKET_ERROR;
+}
+
+int SubmitMsgBatch(LPOVERLAPPED ovlp, int operation, SOCKET socket, mmsghdr* msgs, unsigned int count) {
+  if (ovlp == nullptr || msgs == nullptr || count == 0) {
+    errno = EINVAL;
+    return SOCKET_ERROR;
+  }
+  ovlp->operation = operation;
+  ovlp->socket = socket;
+  ovlp->msgs = msgs;
+  ovlp->msg_count = count;
+  ovlp->msg_index = 0;
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  if (!net::SubmitSingleShot(ovlp)) {
+    return SOCKET_ERROR;
+  }
+  errno = ERROR_IO_PENDING;
+  return SOCKET_ERROR;
+}
+
+} // namespace
+
+int WSASend(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* sent, DWORD flags, LPOVERLAPPED ovlp, void* routine) {
+  return SubmitBuffers(ovlp, net::kOperationSend, socket, buffers, count);
+}
+
+int WSARecv(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* received, DWORD* flags, LPOVERLAPPED ovlp, void* routine) {
+  return SubmitBuffers(ovlp, net::kOperationRecv, socket, buffers, count);
+}
+
+int WSASendTo(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* sent, DWORD flags, const SOCKADDR* to, int to_size, LPOVERLAPPED ovlp, void* routine) {
+  if (to == nullptr || to_size < static_cast<int>(sizeof(SOCKADDR_IN)) || ovlp == nullptr) {
+    errno = EINVAL;
+    return SOCKET_ERROR;
+  }
+  memcpy(&ovlp->to_addr, to, sizeof(ovlp->to_addr));
+  return SubmitBuffers(ovlp, net::kOperationSendTo, socket, buffers, count);
+}
+
+int WSARecvFrom(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* received, DWORD* flags, SOCKADDR* from, PINT from_size, LPOVERLAPPED ovlp, void* routine) {
+  if (from == nullptr || from_size == nullptr || ovlp == nullptr) {
+    errno = EINVAL;
+    return SOCKET_ERROR;
+  }
+  ovlp->from_addr = reinterpret_cast<PSOCKADDR_IN>(from);
+  ovlp->from_size = from_size;
+  return SubmitBuffers(ovlp, net::kOperationRecvFrom, socket, buffers, count);
+}
+
+BOOL AcceptEx(SOCKET listen_socket, SOCKET accept_socket, void* buffer, DWORD receive_size, DWORD local_size, DWORD remote_size, DWORD* received, LPOVERLAPPED ovlp) {
+  if (ovlp == nullptr || accept_socket == INVALID_SOCKET) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  auto channel = net::g_channel.Get(listen_socket, false);
+  if (channel == nullptr) {
+    errno = ENOTSOCK;
+    return FALSE;
+  }
+  ovlp->operation = net::kOperationAccept;
+  ovlp->socket = listen_socket;
+  ovlp->accept_socket = accept_socket;
+  ovlp->iov_count = 0;
+  ovlp->iov_index = 0;
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  std::lock_guard<std::mutex> lock(channel->lock);
+  if (!channel->open) {
+    errno = ENOTSOCK;
+    return FALSE;
+  }
+  net::PushBack(channel->read_head, channel->read_tail, ovlp);
+  net::MatchAccept(channel);
+  if (channel->read_head != nullptr && !channel->accept_armed) {
+    net::ArmAccept(channel, listen_socket);
+  }
+  errno = ERROR_IO_PENDING;
+  return FALSE;
+}
+
+BOOL ConnectEx(SOCKET socket, const SOCKADDR* name, int name_size, void* send_buffer, DWORD send_size, DWORD* sent, LPOVERLAPPED ovlp) {
+  if (ovlp == nullptr || name == nullptr || name_size < static_cast<int>(sizeof(SOCKADDR_IN)) || send_size != 0) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  memcpy(&ovlp->to_addr, name, sizeof(ovlp->to_addr));
+  ovlp->operation = net::kOperationConnect;
+  ovlp->socket = socket;
+  ovlp->iov = ovlp->iov_inline;
+  ovlp->iov_count = 0;
+  ovlp->iov_index = 0;
+  ovlp->transferred = 0;
+  ovlp->error = 0;
+  if (!net::SubmitSingleShot(ovlp)) {
+    return FALSE;
+  }
+  errno = ERROR_IO_PENDING;
+  return FALSE;
+}
+
+int RecvMsgBatch(SOCKET socket, mmsghdr* msgs, unsigned int count, LPOVERLAPPED ovlp) {
+  return SubmitMsgBatch(ovlp, net::kOperationRecvBatch, socket, msgs, count);
+}
+
+int SendMsgBatch(SOCKET socket, mmsghdr* msgs, unsigned int count, LPOVERLAPPED ovlp) {
+  return SubmitMsgBatch(ovlp, net::kOperationSendBatch, socket, msgs, count);
+}
+
+#endif // !_WIN32 && NET_USE_IO_URING
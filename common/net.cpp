@@ -1,4 +1,6 @@
 #include "net.h"
+#include "flight_recorder.h"
+#include "net_metrics.h"
 #include "res_manager.h"
 
 namespace net {
@@ -6,6 +8,9 @@ namespace net {
 NET_API bool StartupNet() {
   return SingleResManager::GetInstance()->StartupNet();
 }
+NET_API bool StartupNet(const NetOptions& options) {
+  return SingleResManager::GetInstance()->StartupNet(options);
+}
 NET_API bool CleanupNet() {
   if (!SingleResManager::GetInstance()->CleanupNet()) {
     return false;
@@ -23,17 +28,47 @@ NET_API bool TcpListen(TcpHandle handle) {
   return SingleResManager::GetInstance()->TcpListen(handle);
 }
 NET_API bool TcpConnect(TcpHandle handle, const std::string& ip, int port) {
-  return SingleResManager::GetInstance()->TcpConnect(handle, ip, port);
+  return SingleResManager::GetInstance()->TcpConnect(handle, ip, port, 0);
+}
+NET_API bool TcpConnect(TcpHandle handle, const std::string& ip, int port, int timeout) {
+  return SingleResManager::GetInstance()->TcpConnect(handle, ip, port, timeout);
 }
 NET_API bool TcpSend(TcpHandle handle, std::unique_ptr<char[]> packet, int size) {
   return SingleResManager::GetInstance()->TcpSend(handle, std::move(packet), size);
 }
+NET_API bool TcpSendv(TcpHandle handle, const NetBuffer* buffers, int count) {
+  return SingleResManager::GetInstance()->TcpSendv(handle, buffers, count);
+}
+NET_API SharedPacket MakeSharedPacket(std::unique_ptr<char[]> packet, int size) {
+  return SingleResManager::GetInstance()->MakeSharedPacket(std::move(packet), size);
+}
+NET_API int TcpBroadcast(const TcpHandle* handles, int count, const SharedPacket& packet) {
+  return SingleResManager::GetInstance()->TcpBroadcast(handles, count, packet);
+}
+NET_API int TcpTrySend(TcpHandle handle, std::unique_ptr<char[]>& packet, int size) {
+  return SingleResManager::GetInstance()->TcpTrySend(handle, packet, size);
+}
 NET_API bool TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port) {
   return SingleResManager::GetInstance()->TcpGetLocalAddr(handle, ip, port);
 }
 NET_API bool TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port) {
   return SingleResManager::GetInstance()->TcpGetRemoteAddr(handle, ip, port);
 }
+NET_API bool TcpSetOptions(TcpHandle handle, const TcpOptions& options) {
+  return SingleResManager::GetInstance()->TcpSetOptions(handle, options);
+}
+NET_API bool TcpGetOptions(TcpHandle handle, TcpOptions& options) {
+  return SingleResManager::GetInstance()->TcpGetOptions(handle, options);
+}
+NET_API bool TcpPoolCreate(NetInterface* callback, const std::string& ip, int port, const TcpPoolOptions& options, TcpPoolHandle& new_handle) {
+  return SingleResManager::GetInstance()->TcpPoolCreate(callback, ip, port, options, new_handle);
+}
+NET_API bool TcpPoolDestroy(TcpPoolHandle handle) {
+  return SingleResManager::GetInstance()->TcpPoolDestroy(handle);
+}
+NET_API bool TcpPoolSend(TcpPoolHandle handle, std::unique_ptr<char[]> packet, int size) {
+  return SingleResManager::GetInstance()->TcpPoolSend(handle, std::move(packet), size);
+}
 NET_API bool UdpCreate(NetInterface* callback, const std::string& ip, int port, UdpHandle& new_handle) {
   return SingleResManager::GetInstance()->UdpCreate(callback, ip, port, new_handle);
 }
@@ -43,5 +78,59 @@ NET_API bool UdpDestroy(UdpHandle handle) {
 NET_API bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const std::string& ip, int port) {
   return SingleResManager::GetInstance()->UdpSendTo(handle, std::move(packet), size, ip, port);
 }
+NET_API bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const UdpEndpoint& to) {
+  return SingleResManager::GetInstance()->UdpSendTo(handle, std::move(packet), size, to);
+}
+NET_API bool UdpMakeEndpoint(const std::string& ip, int port, UdpEndpoint& endpoint) {
+  return SingleResManager::GetInstance()->UdpMakeEndpoint(ip, port, endpoint);
+}
+NET_API void UdpEndpointToAddr(const UdpEndpoint& endpoint, char ip[16], int& port) {
+  SingleResManager::GetInstance()->UdpEndpointToAddr(endpoint, ip, port);
+}
+NET_API bool UdpResolvePeer(const std::string& host, int port, UdpPeerHandle& new_handle) {
+  return SingleResManager::GetInstance()->UdpResolvePeer(host, port, new_handle);
+}
+NET_API bool UdpReleasePeer(UdpPeerHandle handle) {
+  return SingleResManager::GetInstance()->UdpReleasePeer(handle);
+}
+NET_API bool UdpSendToPeer(UdpHandle handle, std::unique_ptr<char[]> packet, int size, UdpPeerHandle peer) {
+  return SingleResManager::GetInstance()->UdpSendToPeer(handle, std::move(packet), size, peer);
+}
+NET_API bool UdpConnect(UdpHandle handle, const std::string& ip, int port) {
+  return SingleResManager::GetInstance()->UdpConnect(handle, ip, port);
+}
+NET_API bool UdpSend(UdpHandle handle, std::unique_ptr<char[]> packet, int size) {
+  return SingleResManager::GetInstance()->UdpSend(handle, std::move(packet), size);
+}
+NET_API bool NetScheduleTimer(NetInterface* callback, int delay, int period, NetTimerHandle& new_handle) {
+  return SingleResManager::GetInstance()->ScheduleTimer(callback, delay, period, new_handle);
+}
+NET_API bool NetCancelTimer(NetTimerHandle handle) {
+  return SingleResManager::GetInstance()->CancelTimer(handle);
+}
+NET_API bool NetSetSendOptions(const NetSendOptions& options) {
+  return SingleResManager::GetInstance()->SetSendOptions(options);
+}
+NET_API bool NetSetPoolOptions(int pool, const NetPoolOptions& options) {
+  return SingleResManager::GetInstance()->SetPoolOptions(pool, options);
+}
+NET_API bool NetGetPoolStats(int pool, NetPoolStats& stats) {
+  return SingleResManager::GetInstance()->GetPoolStats(pool, stats);
+}
+NET_API bool NetGetStats(NetStats& stats) {
+  return SingleResManager::GetInstance()->GetStats(stats);
+}
+NET_API bool TcpGetStats(TcpHandle handle, NetTcpStats& stats) {
+  return SingleResManager::GetInstance()->TcpGetStats(handle, stats);
+}
+NET_API std::string NetFormatStats(const NetStats& stats) {
+  return FormatStats(stats);
+}
+NET_API bool NetDumpFlightRecorder(const std::string& path) {
+  return FlightRecorder::Instance()->Dump(path);
+}
+NET_API bool NetSetFlightRecorderSignal(int signal, const std::string& path) {
+  return FlightRecorder::Instance()->SetSignal(signal, path);
+}
 
 } // namespace net
\ No newline at end of file
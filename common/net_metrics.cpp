@@ -0,0 +1,246 @@
+#include "net_metrics.h"
+#include "timer_wheel.h"
+#include <algorithm>
+#include <memory>
+#include <stdio.h>
+
+namespace net {
+
+namespace {
+
+const char* const kPoolName[kNetPoolCount] = {"tcp_accept", "tcp_send", "tcp_recv", "udp_send", "udp_recv", "tcp_stitch", "tcp_flush",
+  "tcp_connect", "udp_recv_batch"};
+
+void AppendSample(std::string& text, const char* name, const char* label, unsigned long long value) {
+  char line[128];
+  snprintf(line, sizeof(line), "net_%s%s %llu\n", name, label, value);
+  text += line;
+}
+
+void AppendLatency(std::string& text, const char* name, const NetLatencyStats& stats) {
+  char label[32];
+  const char* const kQuantile[] = {"0.5", "0.9", "0.99", "0.999"};
+  const unsigned long long kValue[] = {stats.p50, stats.p90, stats.p99, stats.p999};
+  for (auto i = 0; i < 4; ++i) {
+    snprintf(label, sizeof(label), "{quantile=\"%s\"}", kQuantile[i]);
+    AppendSample(text, name, label, kValue[i]);
+  }
+  std::string sum = name;
+  AppendSample(text, (sum + "_sum").c_str(), "", stats.total);
+  AppendSample(text, (sum + "_count").c_str(), "", stats.count);
+  AppendSample(text, (sum + "_max").c_str(), "", stats.max);
+}
+
+} // namespace
+
+std::string FormatStats(const NetStats& stats) {
+  std::string text;
+  AppendSample(text, "tcp_bytes_in", "", stats.tcp_bytes_in);
+  AppendSample(text, "tcp_bytes_out", "", stats.tcp_bytes_out);
+  AppendSample(text, "tcp_packets_in", "", stats.tcp_packets_in);
+  AppendSample(text, "tcp_packets_out", "", stats.tcp_packets_out);
+  AppendSample(text, "udp_bytes_in", "", stats.udp_bytes_in);
+  AppendSample(text, "udp_bytes_out", "", stats.udp_bytes_out);
+  AppendSample(text, "udp_datagrams_in", "", stats.udp_datagrams_in);
+  AppendSample(text, "udp_datagrams_out", "", stats.udp_datagrams_out);
+  AppendSample(text, "tcp_accepted", "", stats.tcp_accepted);
+  AppendSample(text, "tcp_connected", "", stats.tcp_connected);
+  AppendSample(text, "tcp_connect_failed", "", stats.tcp_connect_failed);
+  AppendSample(text, "tcp_disconnected", "", stats.tcp_disconnected);
+  AppendSample(text, "tcp_idle_timeouts", "", stats.tcp_idle_timeouts);
+  AppendSample(text, "tcp_send_timeouts", "", stats.tcp_send_timeouts);
+  AppendSample(text, "tcp_heartbeat_timeouts", "", stats.tcp_heartbeat_timeouts);
+  AppendSample(text, "tcp_broadcast_skipped", "", stats.tcp_broadcast_skipped);
+  char label[64];
+  for (auto i = 0; i < kNetErrorCodeCount; ++i) {
+    snprintf(label, sizeof(label), "{code=\"%d\"}", i);
+    AppendSample(text, "tcp_errors", label, stats.tcp_error[i]);
+  }
+  for (auto i = 0; i < kNetErrorCodeCount; ++i) {
+    snprintf(label, sizeof(label), "{code=\"%d\"}", i);
+    AppendSample(text, "udp_errors", label, stats.udp_error[i]);
+  }
+  AppendSample(text, "tcp_sends_outstanding", "", stats.tcp_sends_outstanding);
+  AppendSample(text, "udp_sends_outstanding", "", stats.udp_sends_outstanding);
+  for (auto i = 0; i < kNetPoolCount; ++i) {
+    snprintf(label, sizeof(label), "{pool=\"%s\"}", kPoolName[i]);
+    AppendSample(text, "pool_gets", label, stats.pool[i].get_count);
+    AppendSample(text, "pool_cache_hits", label, stats.pool[i].cache_hit);
+    AppendSample(text, "pool_capacity", label, stats.pool[i].capacity);
+    AppendSample(text, "pool_in_use", label, stats.pool[i].in_use);
+  }
+  AppendLatency(text, "callback_time_ns", stats.callback_time);
+  AppendLatency(text, "completion_latency_ns", stats.completion_latency);
+  return text;
+}
+
+NetMetrics::Shard::Shard(bool local) : completion(0), local(local) {
+  for (auto& i : counter) {
+    i = 0;
+  }
+  for (auto& i : histogram) {
+    for (auto& j : i.bucket) {
+      j = 0;
+    }
+    i.count = 0;
+    i.total = 0;
+    i.max = 0;
+  }
+  if (local) {
+    Instance()->Register(this);
+  }
+}
+
+NetMetrics::Shard::~Shard() {
+  if (local) {
+    Instance()->Unregister(this);
+  }
+}
+
+void NetMetrics::CountTcpError(int error) {
+  switch (error) {
+  case kTcpIdleTimedOut:
+    Add(kMetricTcpIdleTimeouts, 1);
+    break;
+  case kTcpSendTimedOut:
+    Add(kMetricTcpSendTimeouts, 1);
+    break;
+  case kTcpHeartbeatTimedOut:
+    Add(kMetricTcpHeartbeatTimeouts, 1);
+    break;
+  default:
+    Add(kMetricTcpError + (error > 0 && error < kNetErrorCodeCount ? error : 0), 1);
+    break;
+  }
+}
+
+void NetMetrics::CountUdpError(int error) {
+  Add(kMetricUdpError + (error > 0 && error < kNetErrorCodeCount ? error : 0), 1);
+}
+
+void NetMetrics::Record(int histogram, unsigned long long value) {
+  auto& target = Shard::Local().histogram[histogram];
+  Increase(target.bucket[BucketOf(value)], 1);
+  Increase(target.count, 1);
+  Increase(target.total, value);
+  if (value > target.max.load(std::memory_order_relaxed)) {
+    target.max.store(value, std::memory_order_relaxed);
+  }
+}
+
+// values below two sub bucket counts get a bucket each, above that every power of two
+// is split into kSubBucketCount buckets of equal width
+int NetMetrics::BucketOf(unsigned long long value) {
+  const auto kLargest = (1ULL << kMaxValueBits) - 1;
+  if (value > kLargest) {
+    value = kLargest;
+  }
+  if (value < 2 * kSubBucketCount) {
+    return static_cast<int>(value);
+  }
+  auto top_bit = 0;
+  while ((value >> (top_bit + 1)) != 0) {
+    ++top_bit;
+  }
+  auto shift = top_bit - kSubBucketBits;
+  return (shift + 1) * kSubBucketCount + static_cast<int>((value >> shift) - kSubBucketCount);
+}
+
+unsigned long long NetMetrics::BucketTop(int bucket) {
+  if (bucket < 2 * kSubBucketCount) {
+    return bucket;
+  }
+  auto shift = bucket / kSubBucketCount - 1;
+  auto sub_bucket = static_cast<unsigned long long>(bucket % kSubBucketCount + kSubBucketCount);
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+void NetMetrics::Merge(const Shard& from, Shard& to) {
+  for (auto i = 0; i < kMetricCount; ++i) {
+    Increase(to.counter[i], from.counter[i].load(std::memory_order_relaxed));
+  }
+  for (auto i = 0; i < kHistogramCount; ++i) {
+    const auto& source = from.histogram[i];
+    auto& target = to.histogram[i];
+    for (auto j = 0; j < kBucketCount; ++j) {
+      Increase(target.bucket[j], source.bucket[j].load(std::memory_order_relaxed));
+    }
+    Increase(target.count, source.count.load(std::memory_order_relaxed));
+    Increase(target.total, source.total.load(std::memory_order_relaxed));
+    target.max = std::max(target.max.load(std::memory_order_relaxed), source.max.load(std::memory_order_relaxed));
+  }
+}
+
+// a percentile is reported as the top of its bucket, never above the largest value seen
+void NetMetrics::Percentiles(const Histogram& histogram, NetLatencyStats& stats) {
+  stats.count = histogram.count;
+  stats.total = histogram.total;
+  stats.max = histogram.max;
+  stats.p50 = stats.p90 = stats.p99 = stats.p999 = 0;
+  if (stats.count == 0) {
+    return;
+  }
+  const double kQuantile[] = {0.5, 0.9, 0.99, 0.999};
+  unsigned long long* const kResult[] = {&stats.p50, &stats.p90, &stats.p99, &stats.p999};
+  unsigned long long seen = 0;
+  auto next = 0;
+  for (auto i = 0; i < kBucketCount && next < 4; ++i) {
+    seen += histogram.bucket[i];
+    while (next < 4 && seen >= static_cast<unsigned long long>(kQuantile[next] * stats.count + 0.5) && seen > 0) {
+      *kResult[next] = std::min(BucketTop(i), stats.max);
+      ++next;
+    }
+  }
+  for (; next < 4; ++next) {
+    *kResult[next] = stats.max;
+  }
+}
+
+// a shard of a running thread may move on while it is read, every counter is still a total it had
+void NetMetrics::Snapshot(NetStats& stats) {
+  std::unique_ptr<Shard> sum(new Shard(false));
+  {
+    std::lock_guard<std::mutex> lock(shard_lock_);
+    Merge(retired_, *sum);
+    for (const auto& i : shard_) {
+      Merge(*i, *sum);
+    }
+  }
+  const auto& counter = sum->counter;
+  stats.time = SteadyMilliseconds();
+  stats.tcp_bytes_in = counter[kMetricTcpBytesIn];
+  stats.tcp_bytes_out = counter[kMetricTcpBytesOut];
+  stats.tcp_packets_in = counter[kMetricTcpPacketsIn];
+  stats.tcp_packets_out = counter[kMetricTcpPacketsOut];
+  stats.udp_bytes_in = counter[kMetricUdpBytesIn];
+  stats.udp_bytes_out = counter[kMetricUdpBytesOut];
+  stats.udp_datagrams_in = counter[kMetricUdpDatagramsIn];
+  stats.udp_datagrams_out = counter[kMetricUdpDatagramsOut];
+  stats.tcp_accepted = counter[kMetricTcpAccepted];
+  stats.tcp_connected = counter[kMetricTcpConnected];
+  stats.tcp_connect_failed = counter[kMetricTcpConnectFailed];
+  stats.tcp_disconnected = counter[kMetricTcpDisconnected];
+  stats.tcp_idle_timeouts = counter[kMetricTcpIdleTimeouts];
+  stats.tcp_send_timeouts = counter[kMetricTcpSendTimeouts];
+  stats.tcp_heartbeat_timeouts = counter[kMetricTcpHeartbeatTimeouts];
+  stats.tcp_broadcast_skipped = counter[kMetricTcpBroadcastSkipped];
+  for (auto i = 0; i < kNetErrorCodeCount; ++i) {
+    stats.tcp_error[i] = counter[kMetricTcpError + i];
+    stats.udp_error[i] = counter[kMetricUdpError + i];
+  }
+  Percentiles(sum->histogram[kHistogramCallback], stats.callback_time);
+  Percentiles(sum->histogram[kHistogramCompletion], stats.completion_latency);
+}
+
+void NetMetrics::Register(Shard* shard) {
+  std::lock_guard<std::mutex> lock(shard_lock_);
+  shard_.push_back(shard);
+}
+
+void NetMetrics::Unregister(Shard* shard) {
+  std::lock_guard<std::mutex> lock(shard_lock_);
+  Merge(*shard, retired_);
+  shard_.erase(std::remove(shard_.begin(), shard_.end(), shard), shard_.end());
+}
+
+} // namespace net
@@ -0,0 +1,146 @@
+#ifndef NET_NET_METRICS_H_
+#define NET_NET_METRICS_H_
+
+#include "net.h"
+#include "uncopyable.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace net {
+
+const int kMetricTcpBytesIn = 0;
+const int kMetricTcpBytesOut = 1;
+const int kMetricTcpPacketsIn = 2;
+const int kMetricTcpPacketsOut = 3;
+const int kMetricUdpBytesIn = 4;
+const int kMetricUdpBytesOut = 5;
+const int kMetricUdpDatagramsIn = 6;
+const int kMetricUdpDatagramsOut = 7;
+const int kMetricTcpAccepted = 8;
+const int kMetricTcpConnected = 9;
+const int kMetricTcpConnectFailed = 10;
+const int kMetricTcpDisconnected = 11;
+const int kMetricTcpIdleTimeouts = 12;
+const int kMetricTcpSendTimeouts = 13;
+const int kMetricTcpHeartbeatTimeouts = 14;
+const int kMetricTcpBroadcastSkipped = 15;
+const int kMetricTcpError = 16;
+const int kMetricUdpError = kMetricTcpError + kNetErrorCodeCount;
+const int kMetricCount = kMetricUdpError + kNetErrorCodeCount;
+
+// NetStats in the prometheus text format
+std::string FormatStats(const NetStats& stats);
+
+inline unsigned long long SteadyNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the counters and histograms behind NetGetStats. every thread writes its own shard with
+// relaxed stores, a snapshot sums the live shards and what exited threads left behind.
+// histograms are log linear like hdr histograms: 16 buckets per power of two
+class NetMetrics : public utility::Uncopyable {
+ public:
+  static const int kSubBucketBits = 4;
+  static const int kSubBucketCount = 1 << kSubBucketBits;
+  static const int kMaxValueBits = 40;
+  static const int kBucketCount = (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+  static const int kHistogramCallback = 0;
+  static const int kHistogramCompletion = 1;
+  static const int kHistogramCount = 2;
+
+  static NetMetrics* Instance() {
+    static NetMetrics metrics;
+    return &metrics;
+  }
+
+  static void Add(int metric, unsigned long long value) {
+    Increase(Shard::Local().counter[metric], value);
+  }
+  static void CountTcpError(int error);
+  static void CountUdpError(int error);
+  bool timing() { return timing_.load(std::memory_order_relaxed); }
+  void set_timing(bool timing) { timing_ = timing; }
+  // the io completion about to be handled, the callbacks it runs measure their latency from here
+  static void MarkCompletion() {
+    Shard::Local().completion = Instance()->timing() ? SteadyNanoseconds() : 0;
+  }
+  // the callbacks run next belong to no io completion
+  static void ClearCompletion() {
+    Shard::Local().completion = 0;
+  }
+  static void Record(int histogram, unsigned long long value);
+  static void RecordCompletion(unsigned long long now) {
+    auto completion = Shard::Local().completion;
+    if (completion != 0 && now >= completion) {
+      Record(kHistogramCompletion, now - completion);
+    }
+  }
+  void Snapshot(NetStats& stats);
+
+ private:
+  struct Histogram {
+    std::atomic<unsigned long long> bucket[kBucketCount];
+    std::atomic<unsigned long long> count;
+    std::atomic<unsigned long long> total;
+    std::atomic<unsigned long long> max;
+  };
+
+  struct Shard {
+    // written by the owner thread only, read by Snapshot
+    std::atomic<unsigned long long> counter[kMetricCount];
+    Histogram histogram[kHistogramCount];
+    unsigned long long completion;
+    bool local;   // registered, the retired shard and snapshot sums are not
+
+    static Shard& Local() {
+      static thread_local Shard shard(true);
+      return shard;
+    }
+    explicit Shard(bool local);
+    ~Shard();
+  };
+
+  NetMetrics() : timing_(false), retired_(false) {}
+
+  static void Increase(std::atomic<unsigned long long>& counter, unsigned long long value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+  static int BucketOf(unsigned long long value);
+  static unsigned long long BucketTop(int bucket);
+  static void Merge(const Shard& from, Shard& to);
+  static void Percentiles(const Histogram& histogram, NetLatencyStats& stats);
+  void Register(Shard* shard);
+  void Unregister(Shard* shard);
+
+ private:
+  std::atomic<bool> timing_;
+  std::mutex shard_lock_;
+  std::vector<Shard*> shard_;
+  Shard retired_;
+};
+
+// times a callback into the histograms when NetOptions::callback_timing is set
+class CallbackTimer {
+ public:
+  CallbackTimer() : start_(0) {
+    if (NetMetrics::Instance()->timing()) {
+      start_ = SteadyNanoseconds();
+      NetMetrics::RecordCompletion(start_);
+    }
+  }
+  ~CallbackTimer() {
+    if (start_ != 0) {
+      NetMetrics::Record(NetMetrics::kHistogramCallback, SteadyNanoseconds() - start_);
+    }
+  }
+
+ private:
+  unsigned long long start_;
+};
+
+} // namespace net
+
+#endif	// NET_NET_METRICS_H_
@@ -0,0 +1,132 @@
+/************************************************************************/
+/*  Platform Shim                                                       */
+/*  on windows this is plain WinSock2, on linux it declares the small   */
+/*  subset of WinSock2 the socket classes use, implemented on top of    */
+/*  the completion emulation in iocp_epoll.cpp or iocp_uring.cpp        */
+/************************************************************************/
+
+#ifndef NET_PLATFORM_H_
+#define NET_PLATFORM_H_
+
+#ifdef _WIN32
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#else
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+typedef int BOOL;
+typedef int INT;
+typedef int* PINT;
+typedef char CHAR;
+typedef unsigned long ULONG;
+typedef unsigned long DWORD;
+typedef sockaddr SOCKADDR;
+typedef sockaddr* PSOCKADDR;
+typedef sockaddr_in SOCKADDR_IN;
+typedef sockaddr_in* PSOCKADDR_IN;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define SD_SEND SHUT_WR
+
+const SOCKET INVALID_SOCKET = -1;
+const int SOCKET_ERROR = -1;
+const int ERROR_IO_PENDING = 997;
+
+// same layout as iovec, so a long gather list can be handed to the kernel as is
+struct WSABUF {
+  CHAR* buf;
+  ULONG len;
+};
+static_assert(sizeof(WSABUF) == sizeof(iovec) && offsetof(WSABUF, len) == offsetof(iovec, iov_len), "WSABUF must match iovec");
+
+const int kOverlappedIovecSize = 2;
+
+// an emulated overlapped operation: everything the completion emulation
+// needs to finish the operation later lives here, so BaseBuffer keeps its layout
+struct OVERLAPPED {
+  OVERLAPPED* next;
+  int operation;
+  SOCKET socket;
+  SOCKET accept_socket;
+  iovec* iov;
+  iovec iov_inline[kOverlappedIovecSize];
+  int iov_count;
+  int iov_index;
+  SOCKADDR_IN to_addr;
+  PSOCKADDR_IN from_addr;
+  PINT from_size;
+  msghdr msg;
+  mmsghdr* msgs;
+  unsigned int msg_count;
+  unsigned int msg_index;
+  DWORD transferred;
+  int error;
+};
+typedef OVERLAPPED* LPOVERLAPPED;
+
+inline int WSAGetLastError() { return errno; }
+
+// the outcome of a completed operation, a failed one leaves its error code in errno
+inline BOOL WSAGetOverlappedResult(SOCKET socket, LPOVERLAPPED ovlp, DWORD* transferred, BOOL wait, DWORD* flags) {
+  if (transferred != nullptr) {
+    *transferred = ovlp->transferred;
+  }
+  if (ovlp->error != 0) {
+    errno = ovlp->error;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+inline int strcpy_s(char* dest, size_t size, const char* src) {
+  if (dest == nullptr || src == nullptr || size == 0) {
+    return EINVAL;
+  }
+  auto length = strlen(src);
+  if (length >= size) {
+    dest[0] = '\0';
+    return ERANGE;
+  }
+  memcpy(dest, src, length + 1);
+  return 0;
+}
+
+// same contracts as their winsock namesakes: SOCKET_ERROR with ERROR_IO_PENDING means
+// the operation is queued and its OVERLAPPED will come out of the IOCP the socket is bound to.
+// one difference: a buffer list longer than kOverlappedIovecSize is used in place,
+// so it has to stay untouched until the operation completes
+int closesocket(SOCKET socket);
+int WSASend(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* sent, DWORD flags, LPOVERLAPPED ovlp, void* routine);
+int WSARecv(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* received, DWORD* flags, LPOVERLAPPED ovlp, void* routine);
+int WSASendTo(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* sent, DWORD flags, const SOCKADDR* to, int to_size, LPOVERLAPPED ovlp, void* routine);
+int WSARecvFrom(SOCKET socket, WSABUF* buffers, DWORD count, DWORD* received, DWORD* flags, SOCKADDR* from, PINT from_size, LPOVERLAPPED ovlp, void* routine);
+BOOL AcceptEx(SOCKET listen_socket, SOCKET accept_socket, void* buffer, DWORD receive_size, DWORD local_size, DWORD remote_size, DWORD* received, LPOVERLAPPED ovlp);
+// send_buffer is not supported, the socket has to be bound already like on windows
+BOOL ConnectEx(SOCKET socket, const SOCKADDR* name, int name_size, void* send_buffer, DWORD send_size, DWORD* sent, LPOVERLAPPED ovlp);
+// not winsock: up to count datagrams in one operation through recvmmsg and sendmmsg, same
+// pending contract as above. a receive completes with the number of datagrams received in
+// transferred, a send once every datagram went out, one the kernel refuses is dropped
+int RecvMsgBatch(SOCKET socket, mmsghdr* msgs, unsigned int count, LPOVERLAPPED ovlp);
+int SendMsgBatch(SOCKET socket, mmsghdr* msgs, unsigned int count, LPOVERLAPPED ovlp);
+
+#endif // _WIN32
+
+#endif // NET_PLATFORM_H_
@@ -1,17 +1,48 @@
 #include "res_manager.h"
+#include "buffer_pool.h"
+#include "crc32c.h"
+#include "flight_recorder.h"
 #include "log.h"
+#include "net_metrics.h"
+#include "thread_affinity.h"
+#include "timer_wheel.h"
 #include "utility.h"
 #include "utility_net.h"
+#include <stdint.h>
+#ifndef _WIN32
+#include <netdb.h>
+#endif // _WIN32
 
 namespace net {
 
-const TcpHandle kMaxTcpHandleNumber = 0xFFFFFFFF;
-const UdpHandle kMaxUdpHandleNumber = 0xFFFFFFFF;
+const int kDefaultGatherPacket = 64;
+const int kDefaultGatherBytes = 256 * kOneKibibyte;
+
+#ifndef _WIN32
+namespace {
+
+// the datagrams of one batched receive, handed to the callback in one go
+thread_local std::vector<UdpDatagramView> t_datagram;
+
+} // namespace
+#endif // _WIN32
 
 ResManager::ResManager() {
   net_started_ = false;
-  tcp_socket_count_ = 0;
-  udp_socket_count_ = 0;
+  options_.thread_count = 0;
+  options_.per_core = false;
+  options_.cpu_mask = 0;
+  options_.thread_name = "net";
+  options_.accept_count = utility::GetProcessorNum() * 2;
+  options_.udp_recv_count = utility::GetProcessorNum();
+  options_.tcp_buffer_size = kTcpBufferSize;
+  options_.udp_buffer_size = kUdpBufferSize;
+  options_.udp_batch_count = kUdpBatchCount;
+  options_.udp_gro = false;
+  options_.max_tcp_packet_size = kMaxTcpPacketSize;
+  options_.callback_timing = false;
+  send_options_.max_gather_packet = kDefaultGatherPacket;
+  send_options_.max_gather_bytes = kDefaultGatherBytes;
 }
 
 ResManager::~ResManager() {
@@ -22,28 +53,116 @@ bool ResManager::StartupNet() {
   if (net_started_) {
     return true;
   }
+  // objects carved before keep their tail, a restart can not change the buffer sizes
+  if (!BufferPool<TcpRecvBuffer>::Instance()->SetTailSize(options_.tcp_buffer_size) ||
+    !BufferPool<TcpStitchBuffer>::Instance()->SetTailSize(options_.tcp_buffer_size) ||
+    !BufferPool<UdpRecvBuffer>::Instance()->SetTailSize(options_.udp_buffer_size)) {
+    LOG(kStartup, "startup net failed: buffer sizes differ from the first startup.");
+    return false;
+  }
+  NetMetrics::Instance()->set_timing(options_.callback_timing);
+#ifndef _WIN32
+  if (options_.udp_batch_count > 1 &&
+    !BufferPool<UdpRecvBatchBuffer>::Instance()->SetTailSize(options_.udp_batch_count * UdpSlotSize())) {
+    LOG(kStartup, "startup net failed: udp batch differs from the first startup.");
+    return false;
+  }
+#endif // _WIN32
+  auto iocp_options = options_;
+  if (iocp_options.thread_count == 0) {
+    auto processor_num = utility::GetProcessorNum();
+    if (!iocp_options.per_core) {
+      iocp_options.thread_count = processor_num * 2;
+    } else if (iocp_options.cpu_mask == 0) {
+      iocp_options.thread_count = processor_num;
+    } else {
+      for (auto i = 0; i < kMaxAffinityProcessor; ++i) {
+        iocp_options.thread_count += static_cast<int>((iocp_options.cpu_mask >> i) & 1);
+      }
+    }
+  }
   net_started_ = true;
   auto iocp_callback = std::bind(&ResManager::TransferAsyncType, this, std::placeholders::_1, std::placeholders::_2);
-  if (!iocp_.Init(iocp_callback)) {
+  auto timer_callback = std::bind(&ResManager::TransferTimerType, this, std::placeholders::_1);
+  if (!iocp_.Init(iocp_callback, timer_callback, iocp_options)) {
     CleanupNet();
     return false;
   }
   return true;
 }
 
+bool ResManager::StartupNet(const NetOptions& options) {
+  if (net_started_) {
+    return true;
+  }
+  auto tcp_buffer_size = options.tcp_buffer_size;
+  if (options.thread_count < 0 || options.accept_count < 0 || options.udp_recv_count < 0 ||
+    tcp_buffer_size < 0 || (tcp_buffer_size != 0 && (tcp_buffer_size < kOneKibibyte || (tcp_buffer_size & (tcp_buffer_size - 1)) != 0)) ||
+    options.udp_buffer_size < 0 || options.udp_buffer_size > kMaxUdpDatagramSize || options.max_tcp_packet_size < 0 ||
+    options.udp_batch_count < 0 || options.udp_batch_count > kMaxUdpBatchCount) {
+    LOG(kStartup, "startup net failed: invalid options.");
+    return false;
+  }
+  if (options.thread_count != 0) {
+    options_.thread_count = options.thread_count;
+  }
+  if (options.per_core) {
+    options_.per_core = true;
+  }
+  if (options.cpu_mask != 0) {
+    options_.cpu_mask = options.cpu_mask;
+  }
+  if (!options.thread_name.empty()) {
+    options_.thread_name = options.thread_name;
+  }
+  if (options.accept_count != 0) {
+    options_.accept_count = options.accept_count;
+  }
+  if (options.udp_recv_count != 0) {
+    options_.udp_recv_count = options.udp_recv_count;
+  }
+  if (options.tcp_buffer_size != 0) {
+    options_.tcp_buffer_size = options.tcp_buffer_size;
+  }
+  if (options.udp_buffer_size != 0) {
+    options_.udp_buffer_size = options.udp_buffer_size;
+  }
+  if (options.max_tcp_packet_size != 0) {
+    options_.max_tcp_packet_size = options.max_tcp_packet_size;
+  }
+  if (options.udp_batch_count != 0) {
+    options_.udp_batch_count = options.udp_batch_count;
+  }
+  if (options.udp_gro) {
+    options_.udp_gro = true;
+  }
+  if (options.callback_timing) {
+    options_.callback_timing = true;
+  }
+  return StartupNet();
+}
+
 bool ResManager::CleanupNet() {
   if (!net_started_) {
     return true;
   }
-  tcp_socket_lock_.lock();
-  tcp_socket_.clear();
-  tcp_socket_count_ = 0;
-  tcp_socket_lock_.unlock();
-  udp_socket_lock_.lock();
-  udp_socket_.clear();
-  udp_socket_count_ = 0;
-  udp_socket_lock_.unlock();
+  // stopped pools schedule no reconnect, so no connection is made behind the clear
+  {
+    std::lock_guard<std::mutex> lock(pool_lock_);
+    for (const auto& key : pool_key_) {
+      auto pool = tcp_pool_.Get(key.second);
+      if (pool) {
+        pool->Stop();
+      }
+    }
+    pool_key_.clear();
+  }
+  tcp_socket_.Clear();
+  udp_socket_.Clear();
   iocp_.Uninit();
+  tcp_pool_.Clear();
+  udp_peer_.Clear();
+  closed_pool_.clear();
   net_started_ = false;
   return true;
 }
@@ -60,9 +179,12 @@ bool ResManager::TcpCreate(NetInterface* callback, const std::string& ip, int po
   if (!new_socket->Bind(ip, port)) {
     return false;
   }
-  if (!iocp_.BindToIOCP(new_socket->socket())) {
+  auto loop = 0;
+  if (!iocp_.BindToIOCP(new_socket->socket(), loop)) {
     return false;
   }
+  new_socket->set_loop(loop);
+  new_socket->set_max_packet_size(options_.max_tcp_packet_size);
   if (!NewTcpSocket(new_handle, new_socket)) {
     return false;
   }
@@ -79,11 +201,11 @@ bool ResManager::TcpListen(TcpHandle handle) {
   if (!socket) {
     return false;
   }
-  auto backlog = utility::GetProcessorNum() * 2;
-  if (!socket->Listen(backlog)) {
+  // the backlog absorbs connect bursts while the posted accepts catch up
+  if (!socket->Listen(SOMAXCONN)) {
     return false;
   }
-  for (auto i = 0; i < backlog; ++i) {
+  for (auto i = 0; i < options_.accept_count; ++i) {
     auto accept_buffer = GetTcpAcceptBuffer();
     if (accept_buffer == nullptr) {
       return false;
@@ -95,27 +217,35 @@ bool ResManager::TcpListen(TcpHandle handle) {
   return true;
 }
 
-bool ResManager::TcpConnect(TcpHandle handle, const std::string& ip, int port) {
+bool ResManager::TcpConnect(TcpHandle handle, const std::string& ip, int port, int timeout) {
+  if (timeout < 0) {
+    LOG(kError, "connect tcp handle: %lu failed: invalid parameter.", handle);
+    return false;
+  }
   auto socket = GetTcpSocket(handle);
   if (!socket) {
     return false;
   }
-  if (!socket->Connect(ip, port)) {
+  auto connect_buffer = GetTcpConnectBuffer();
+  if (connect_buffer == nullptr) {
     return false;
   }
-  auto recv_buffer = GetTcpRecvBuffer();
-  if (recv_buffer == nullptr) {
+  connect_buffer->set_handle(handle);
+  if (!socket->AsyncConnect(ip, port, connect_buffer->ovlp())) {
+    ReturnTcpConnectBuffer(connect_buffer);
     return false;
   }
-  if (!AsyncTcpRecv(handle, socket, recv_buffer)) {
-    return false;
+  // a timer firing after the completion finds the connect done and does nothing
+  unsigned long long timer_id = 0;
+  if (timeout > 0) {
+    iocp_.ScheduleTimer(socket->loop(), kTimerTypeTcpConnect, handle, 0, timeout, 0, timer_id);
   }
   return true;
 }
 
 bool ResManager::TcpSend(TcpHandle handle, std::unique_ptr<char[]> packet, int size) {
-  if (!packet || size <= 0 || size > kMaxTcpPacketSize) {
-    LOG(kError, "send tcp handle: %u packet failed: invalid parameter.", handle);
+  if (!packet || size <= 0 || size > options_.max_tcp_packet_size) {
+    LOG(kError, "send tcp handle: %lu packet failed: invalid parameter.", handle);
     return false;
   }
   auto socket = GetTcpSocket(handle);
@@ -132,17 +262,152 @@ bool ResManager::TcpSend(TcpHandle handle, std::unique_ptr<char[]> packet, int s
     ReturnTcpSendBuffer(send_buffer);
     return false;
   }
+  if (socket->options().checksum) {
+    send_buffer->SetChecksum(Crc32c(packet_ptr, size));
+  }
   send_buffer->set_handle(handle);
-  if (!socket->AsyncSend(send_buffer->header(), send_buffer->buffer(), send_buffer->buffer_size(), send_buffer->ovlp())) {
-    ReturnTcpSendBuffer(send_buffer);
+  if (socket->PushSend(send_buffer)) {
+    return StartTcpSend(handle, socket);
+  }
+  return true;
+}
+
+// the library owns every buffer from here on, a part not taken by a send buffer yet is released
+// on the spot when the send fails
+bool ResManager::TcpSendv(TcpHandle handle, const NetBuffer* buffers, int count) {
+  auto release_from = [buffers](int first, int count) {
+    for (auto i = first; i < count; ++i) {
+      if (buffers[i].release) {
+        buffers[i].release(buffers[i].data);
+      }
+    }
+  };
+  long long frame_size = 0;
+  for (auto i = 0; buffers != nullptr && i < count; ++i) {
+    if (buffers[i].data == nullptr || buffers[i].size <= 0) {
+      frame_size = -1;
+      break;
+    }
+    frame_size += buffers[i].size;
+  }
+  if (buffers == nullptr || count <= 0 || count > kMaxTcpSendvBuffers || frame_size <= 0 || frame_size > options_.max_tcp_packet_size) {
+    LOG(kError, "send tcp handle: %lu buffers failed: invalid parameter.", handle);
+    if (buffers != nullptr && count > 0) {
+      release_from(0, count);
+    }
+    return false;
+  }
+  auto socket = GetTcpSocket(handle);
+  if (!socket) {
+    release_from(0, count);
     return false;
   }
+  TcpSendBuffer* frame = nullptr;
+  TcpSendBuffer* last = nullptr;
+  auto checksum = socket->options().checksum;
+  unsigned int crc = 0;
+  for (auto i = 0; i < count; ++i) {
+    auto part = GetTcpSendBuffer();
+    std::function<void (char*)> deleter;
+    if (buffers[i].release) {
+      deleter = buffers[i].release;
+    }
+    auto ok = part != nullptr && (i == 0 ? part->InitFrame(buffers[i].data, buffers[i].size, deleter, count, static_cast<int>(frame_size)) :
+      part->InitPart(buffers[i].data, buffers[i].size, deleter));
+    if (!ok) {
+      if (part != nullptr) {
+        ReturnTcpSendBuffer(part);
+      }
+      ReturnTcpSendBatch(frame);
+      release_from(i, count);
+      return false;
+    }
+    part->set_handle(handle);
+    if (checksum) {
+      crc = Crc32cExtend(crc, buffers[i].data, buffers[i].size);
+    }
+    if (last == nullptr) {
+      frame = part;
+    } else {
+      last->set_next(part);
+    }
+    last = part;
+  }
+  if (checksum) {
+    frame->SetChecksum(crc);
+  }
+  if (socket->PushSend(frame)) {
+    return StartTcpSend(handle, socket);
+  }
+  return true;
+}
+
+SharedPacket ResManager::MakeSharedPacket(std::unique_ptr<char[]> packet, int size) {
+  if (!packet || size <= 0 || size > options_.max_tcp_packet_size) {
+    LOG(kError, "make shared packet failed: invalid parameter.");
+    return SharedPacket();
+  }
+  return std::make_shared<const SharedPacketData>(std::move(packet), size);
+}
+
+// every send buffer holds a reference, the payload goes when the last of them is returned.
+// closed handles are expected in a broadcast list, they are counted instead of logged one by one
+int ResManager::TcpBroadcast(const TcpHandle* handles, int count, const SharedPacket& packet) {
+  if (handles == nullptr || count <= 0 || !packet) {
+    LOG(kError, "broadcast tcp packet failed: invalid parameter.");
+    return 0;
+  }
+  auto sent = 0;
+  for (auto i = 0; i < count; ++i) {
+    auto socket = tcp_socket_.Get(handles[i]);
+    if (!socket) {
+      continue;
+    }
+    auto send_buffer = GetTcpSendBuffer();
+    if (send_buffer == nullptr) {
+      continue;
+    }
+    send_buffer->InitShared(packet, socket->options().checksum);
+    send_buffer->set_handle(handles[i]);
+    if (socket->PushSend(send_buffer) && !StartTcpSend(handles[i], socket)) {
+      continue;
+    }
+    ++sent;
+  }
+  if (sent < count) {
+    NetMetrics::Add(kMetricTcpBroadcastSkipped, count - sent);
+  }
+  return sent;
+}
+
+int ResManager::TcpTrySend(TcpHandle handle, std::unique_ptr<char[]>& packet, int size) {
+  auto socket = GetTcpSocket(handle);
+  if (!socket) {
+    return kTcpSendFailed;
+  }
+  if (socket->WouldBlock()) {
+    return kTcpSendWouldBlock;
+  }
+  return TcpSend(handle, std::move(packet), size) ? kTcpSendOk : kTcpSendFailed;
+}
+
+// a heartbeat frame queues behind the packets already sent, a failure is left to the heartbeat to find
+bool ResManager::SendTcpControl(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, uint32_t packet_flag, uint32_t sequence) {
+  auto send_buffer = GetTcpSendBuffer();
+  if (send_buffer == nullptr) {
+    return false;
+  }
+  send_buffer->InitControl(packet_flag, sequence);
+  send_buffer->set_handle(handle);
+  if (socket->PushSend(send_buffer)) {
+    return StartTcpSend(handle, socket);
+  }
   return true;
 }
 
 bool ResManager::TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port) {
   if (ip == nullptr) {
-    LOG(kError, "get tcp handle : %u local address failed: invalid ip parameter.", handle);
+    LOG(kError, "get tcp handle : %lu local address failed: invalid ip parameter.", handle);
     return false;
   }
   auto socket = GetTcpSocket(handle);
@@ -159,7 +424,7 @@ bool ResManager::TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port) {
 
 bool ResManager::TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port) {
   if (ip == nullptr) {
-    LOG(kError, "get tcp handle : %u remote address failed: invalid ip parameter.", handle);
+    LOG(kError, "get tcp handle : %lu remote address failed: invalid ip parameter.", handle);
     return false;
   }
   auto socket = GetTcpSocket(handle);
@@ -174,6 +439,88 @@ bool ResManager::TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port) {
   return true;
 }
 
+bool ResManager::TcpSetOptions(TcpHandle handle, const TcpOptions& options) {
+  if (options.idle_timeout < 0 || options.send_timeout < 0 || options.heartbeat_interval < 0 || options.heartbeat_miss < 0 ||
+      options.send_high_watermark < 0 || options.send_low_watermark < 0 || options.send_low_watermark > options.send_high_watermark ||
+      options.chunk_threshold < 0) {
+    LOG(kError, "set tcp handle: %lu options failed: invalid parameter.", handle);
+    return false;
+  }
+  auto socket = GetTcpSocket(handle);
+  if (!socket) {
+    return false;
+  }
+  socket->set_options(options);
+  // the first check only works out when the next one is due
+  if (options.idle_timeout > 0 || options.send_timeout > 0 || options.heartbeat_interval > 0) {
+    ArmTcpCheck(handle, socket, 0);
+  }
+  return true;
+}
+
+bool ResManager::TcpGetOptions(TcpHandle handle, TcpOptions& options) {
+  auto socket = GetTcpSocket(handle);
+  if (!socket) {
+    return false;
+  }
+  options = socket->options();
+  return true;
+}
+
+bool ResManager::TcpPoolCreate(NetInterface* callback, const std::string& ip, int port, const TcpPoolOptions& options, TcpPoolHandle& new_handle) {
+  if (callback == nullptr || port <= 0 || options.connection_count <= 0 || options.connect_timeout < 0 ||
+    options.min_backoff < 0 || options.max_backoff < 0 || options.max_queued_packet < 0) {
+    LOG(kError, "create tcp pool failed: invalid parameter.");
+    return false;
+  }
+  if (!net_started_) {
+    LOG(kError, "create tcp pool failed: net not started.");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  std::shared_ptr<TcpPool> new_pool(new TcpPool(this, callback, ip, port, options));
+  if (pool_key_.find(new_pool->key()) != pool_key_.end()) {
+    LOG(kError, "create tcp pool %s failed: already created.", new_pool->key().c_str());
+    return false;
+  }
+  if (!tcp_pool_.Insert(new_pool, new_handle)) {
+    LOG(kError, "fail to new tcp pool handle: reach max tcp pool handle number.");
+    return false;
+  }
+  pool_key_[new_pool->key()] = new_handle;
+  new_pool->set_handle(new_handle);
+  new_pool->Start();
+  return true;
+}
+
+bool ResManager::TcpPoolDestroy(TcpPoolHandle handle) {
+  std::shared_ptr<TcpPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(pool_lock_);
+    pool = tcp_pool_.Remove(handle);
+    if (!pool) {
+      return true;
+    }
+    pool_key_.erase(pool->key());
+    closed_pool_.push_back(pool);
+  }
+  pool->Stop();
+  return true;
+}
+
+bool ResManager::TcpPoolSend(TcpPoolHandle handle, std::unique_ptr<char[]> packet, int size) {
+  if (!packet || size <= 0 || size > options_.max_tcp_packet_size) {
+    LOG(kError, "send tcp pool handle: %lu packet failed: invalid parameter.", handle);
+    return false;
+  }
+  auto pool = tcp_pool_.Get(handle);
+  if (!pool) {
+    LOG(kError, "can not find tcp pool handle: %lu.", handle);
+    return false;
+  }
+  return pool->Send(std::move(packet), size);
+}
+
 bool ResManager::UdpCreate(NetInterface* callback, const std::string& ip, int port, UdpHandle& new_handle) {
   if (callback == nullptr) {
     LOG(kError, "create udp handle failed: invalid callback parameter.");
@@ -186,13 +533,42 @@ bool ResManager::UdpCreate(NetInterface* callback, const std::string& ip, int po
   if (!new_socket->Bind(ip, port)) {
     return false;
   }
-  if (!iocp_.BindToIOCP(new_socket->socket())) {
+  auto loop = 0;
+  if (!iocp_.BindToIOCP(new_socket->socket(), loop)) {
     return false;
   }
   if (!NewUdpSocket(new_handle, new_socket)) {
     return false;
   }
-  auto recv_count = utility::GetProcessorNum();
+  // receives posted before the failure come back once the socket closes, their handle is gone by then
+  if (!StartUdpRecv(new_handle, new_socket)) {
+    RemoveUdpSocket(new_handle);
+    new_handle = kInvalidUdpHandle;
+    return false;
+  }
+  return true;
+}
+
+bool ResManager::StartUdpRecv(UdpHandle new_handle, const std::shared_ptr<UdpSocket>& new_socket) {
+  auto recv_count = options_.udp_recv_count;
+#ifndef _WIN32
+  if (options_.udp_batch_count > 1) {
+    new_socket->set_batch_count(options_.udp_batch_count);
+    if (options_.udp_gro) {
+      new_socket->EnableGro();
+    }
+    for (auto i = 0; i < recv_count; ++i) {
+      auto recv_buffer = GetUdpRecvBatchBuffer();
+      if (recv_buffer == nullptr) {
+        return false;
+      }
+      if (!AsyncUdpRecvBatch(new_handle, new_socket, recv_buffer)) {
+        return false;
+      }
+    }
+    return true;
+  }
+#endif // _WIN32
   for (auto i = 0; i < recv_count; ++i) {
     auto recv_buffer = GetUdpRecvBuffer();
     if (recv_buffer == nullptr) {
@@ -211,14 +587,112 @@ bool ResManager::UdpDestroy(UdpHandle handle) {
 }
 
 bool ResManager::UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const std::string& ip, int port) {
-  if (!packet || size <= 0 || size > kMaxUdpPacketSize || port <= 0) {
-    LOG(kError, "send udp handle: %u packet failed: invalid parameter.", handle);
+  if (port <= 0) {
+    LOG(kError, "send udp handle: %lu packet failed: invalid parameter.", handle);
+    return false;
+  }
+  SOCKADDR_IN to_addr = {0};
+  utility::ToSockAddr(to_addr, ip, port);
+  return SendUdpTo(handle, std::move(packet), size, &to_addr);
+}
+
+bool ResManager::UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const UdpEndpoint& to) {
+  if (to.port == 0) {
+    LOG(kError, "send udp handle: %lu packet failed: invalid parameter.", handle);
+    return false;
+  }
+  SOCKADDR_IN to_addr;
+  ToSockAddr(to_addr, to);
+  return SendUdpTo(handle, std::move(packet), size, &to_addr);
+}
+
+bool ResManager::UdpMakeEndpoint(const std::string& ip, int port, UdpEndpoint& endpoint) {
+  in_addr addr;
+  if (port <= 0 || port > 0xFFFF || ::inet_pton(AF_INET, ip.c_str(), &addr) != 1) {
+    LOG(kError, "make udp endpoint %s:%d failed: invalid parameter.", ip.c_str(), port);
+    return false;
+  }
+  memcpy(endpoint.address, &addr, sizeof(endpoint.address));
+  endpoint.port = static_cast<unsigned short>(port);
+  return true;
+}
+
+void ResManager::UdpEndpointToAddr(const UdpEndpoint& endpoint, char ip[16], int& port) {
+  ::inet_ntop(AF_INET, const_cast<unsigned char*>(endpoint.address), ip, 16);
+  port = endpoint.port;
+}
+
+// resolved here once, a send to the peer only copies the address
+bool ResManager::UdpResolvePeer(const std::string& host, int port, UdpPeerHandle& new_handle) {
+  if (host.empty() || port <= 0 || port > 0xFFFF) {
+    LOG(kError, "resolve udp peer %s:%d failed: invalid parameter.", host.c_str(), port);
+    return false;
+  }
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* result = nullptr;
+  auto error = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+  if (error != 0 || result == nullptr) {
+    LOG(kError, "resolve udp peer %s:%d failed, error code: %d.", host.c_str(), port, error);
+    return false;
+  }
+  std::shared_ptr<SOCKADDR_IN> peer(new SOCKADDR_IN);
+  memcpy(peer.get(), result->ai_addr, sizeof(SOCKADDR_IN));
+  ::freeaddrinfo(result);
+  if (!udp_peer_.Insert(peer, new_handle)) {
+    LOG(kError, "resolve udp peer %s:%d failed: reach max peer number.", host.c_str(), port);
+    return false;
+  }
+  return true;
+}
+
+bool ResManager::UdpReleasePeer(UdpPeerHandle handle) {
+  return udp_peer_.Remove(handle) != nullptr;
+}
+
+bool ResManager::UdpSendToPeer(UdpHandle handle, std::unique_ptr<char[]> packet, int size, UdpPeerHandle peer) {
+  auto to_addr = udp_peer_.Get(peer);
+  if (!to_addr) {
+    LOG(kError, "send udp handle: %lu packet failed: unknown peer.", handle);
+    return false;
+  }
+  return SendUdpTo(handle, std::move(packet), size, to_addr.get());
+}
+
+bool ResManager::UdpConnect(UdpHandle handle, const std::string& ip, int port) {
+  UdpEndpoint endpoint;
+  if (!UdpMakeEndpoint(ip, port, endpoint)) {
     return false;
   }
   auto socket = GetUdpSocket(handle);
   if (!socket) {
     return false;
   }
+  SOCKADDR_IN addr;
+  ToSockAddr(addr, endpoint);
+  return socket->Connect(addr);
+}
+
+bool ResManager::UdpSend(UdpHandle handle, std::unique_ptr<char[]> packet, int size) {
+  return SendUdpTo(handle, std::move(packet), size, nullptr);
+}
+
+// every udp send ends here, the address is parsed or copied once and kept with the buffer
+bool ResManager::SendUdpTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const SOCKADDR_IN* to_addr) {
+  if (!packet || size <= 0 || size > options_.udp_buffer_size) {
+    LOG(kError, "send udp handle: %lu packet failed: invalid parameter.", handle);
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (!socket) {
+    return false;
+  }
+  if (to_addr == nullptr && !socket->connected()) {
+    LOG(kError, "send udp handle: %lu packet failed: not connected.", handle);
+    return false;
+  }
   auto send_buffer = GetUdpSendBuffer();
   if (send_buffer == nullptr) {
     return false;
@@ -230,149 +704,266 @@ bool ResManager::UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int
     return false;
   }
   send_buffer->set_handle(handle);
-  if (!socket->AsyncSendTo(send_buffer->buffer(), send_buffer->buffer_size(), ip, port, send_buffer->ovlp())) {
+#ifndef _WIN32
+  if (socket->batch_count() > 1) {
+    if (to_addr != nullptr) {
+      *send_buffer->to_addr() = *to_addr;
+    } else {
+      memset(send_buffer->to_addr(), 0, sizeof(SOCKADDR_IN));
+    }
+    if (socket->PushSend(send_buffer)) {
+      return FlushUdpSend(socket);
+    }
+    return true;
+  }
+#endif // _WIN32
+  auto sent = to_addr != nullptr ? socket->AsyncSendTo(send_buffer->buffer(), send_buffer->buffer_size(), *to_addr, send_buffer->ovlp()) :
+    socket->AsyncSend(send_buffer->buffer(), send_buffer->buffer_size(), send_buffer->ovlp());
+  if (!sent) {
     ReturnUdpSendBuffer(send_buffer);
     return false;
   }
   return true;
 }
 
+bool ResManager::SetSendOptions(const NetSendOptions& options) {
+  if (options.max_gather_packet <= 0 || options.max_gather_packet > kMaxTcpGatherPacket || options.max_gather_bytes <= 0) {
+    LOG(kError, "set send options failed: invalid parameter.");
+    return false;
+  }
+  send_options_ = options;
+  return true;
+}
+
+bool ResManager::SetPoolOptions(int pool, const NetPoolOptions& options) {
+  auto result = false;
+  switch (pool) {
+  case kNetPoolTcpAccept:
+    result = BufferPool<TcpAcceptBuffer>::Instance()->SetOptions(options);
+    break;
+  case kNetPoolTcpSend:
+    result = BufferPool<TcpSendBuffer>::Instance()->SetOptions(options);
+    break;
+  case kNetPoolTcpRecv:
+    result = BufferPool<TcpRecvBuffer>::Instance()->SetOptions(options);
+    break;
+  case kNetPoolUdpSend:
+    result = BufferPool<UdpSendBuffer>::Instance()->SetOptions(options);
+    break;
+  case kNetPoolUdpRecv:
+    result = BufferPool<UdpRecvBuffer>::Instance()->SetOptions(options);
+    break;
+  case kNetPoolTcpStitch:
+    result = BufferPool<TcpStitchBuffer>::Instance()->SetOptions(options);
+    break;
+  case kNetPoolTcpFlush:
+    result = BufferPool<TcpFlushBuffer>::Instance()->SetOptions(options);
+    break;
+  case kNetPoolTcpConnect:
+    result = BufferPool<TcpConnectBuffer>::Instance()->SetOptions(options);
+    break;
+#ifndef _WIN32
+  case kNetPoolUdpRecvBatch:
+    result = BufferPool<UdpRecvBatchBuffer>::Instance()->SetOptions(options);
+    break;
+#endif // _WIN32
+  default:
+    break;
+  }
+  if (!result) {
+    LOG(kError, "set pool: %d options failed: invalid parameter.", pool);
+  }
+  return result;
+}
+
+bool ResManager::GetPoolStats(int pool, NetPoolStats& stats) {
+  switch (pool) {
+  case kNetPoolTcpAccept:
+    BufferPool<TcpAcceptBuffer>::Instance()->GetStats(stats);
+    return true;
+  case kNetPoolTcpSend:
+    BufferPool<TcpSendBuffer>::Instance()->GetStats(stats);
+    return true;
+  case kNetPoolTcpRecv:
+    BufferPool<TcpRecvBuffer>::Instance()->GetStats(stats);
+    return true;
+  case kNetPoolUdpSend:
+    BufferPool<UdpSendBuffer>::Instance()->GetStats(stats);
+    return true;
+  case kNetPoolUdpRecv:
+    BufferPool<UdpRecvBuffer>::Instance()->GetStats(stats);
+    return true;
+  case kNetPoolTcpStitch:
+    BufferPool<TcpStitchBuffer>::Instance()->GetStats(stats);
+    return true;
+  case kNetPoolTcpFlush:
+    BufferPool<TcpFlushBuffer>::Instance()->GetStats(stats);
+    return true;
+  case kNetPoolTcpConnect:
+    BufferPool<TcpConnectBuffer>::Instance()->GetStats(stats);
+    return true;
+  case kNetPoolUdpRecvBatch:
+#ifndef _WIN32
+    BufferPool<UdpRecvBatchBuffer>::Instance()->GetStats(stats);
+#else
+    // windows receives one datagram per buffer, the pool is never used
+    stats = NetPoolStats();
+#endif // _WIN32
+    return true;
+  default:
+    LOG(kError, "get pool: %d stats failed: invalid parameter.", pool);
+    return false;
+  }
+}
+
+bool ResManager::GetStats(NetStats& stats) {
+  NetMetrics::Instance()->Snapshot(stats);
+  for (auto i = 0; i < kNetPoolCount; ++i) {
+    GetPoolStats(i, stats.pool[i]);
+  }
+  stats.tcp_sends_outstanding = stats.pool[kNetPoolTcpSend].in_use;
+  stats.udp_sends_outstanding = stats.pool[kNetPoolUdpSend].in_use;
+  return true;
+}
+
+bool ResManager::TcpGetStats(TcpHandle handle, NetTcpStats& stats) {
+  auto socket = GetTcpSocket(handle);
+  if (!socket) {
+    return false;
+  }
+  socket->GetStats(stats);
+  return true;
+}
+
+bool ResManager::ScheduleTimer(NetInterface* callback, int delay, int period, NetTimerHandle& new_handle) {
+  if (callback == nullptr || delay < 0 || period < 0) {
+    LOG(kError, "schedule timer failed: invalid parameter.");
+    return false;
+  }
+  auto arg = static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(callback));
+  return iocp_.ScheduleTimer(-1, kTimerTypeUser, 0, arg, delay, period, new_handle);
+}
+
+bool ResManager::CancelTimer(NetTimerHandle handle) {
+  return iocp_.CancelTimer(handle);
+}
+
+bool ResManager::SchedulePoolTimer(TcpPoolHandle handle, int index, int delay) {
+  unsigned long long timer_id = 0;
+  return iocp_.ScheduleTimer(-1, kTimerTypeTcpPool, handle, index, delay, 0, timer_id);
+}
+
+long long ResManager::TcpQueuedBytes(TcpHandle handle) {
+  auto socket = tcp_socket_.Get(handle);
+  if (!socket) {
+    return -1;
+  }
+  return socket->queued_bytes();
+}
+
 bool ResManager::NewTcpSocket(TcpHandle& new_handle, const std::shared_ptr<TcpSocket>& new_socket) {
-  std::lock_guard<std::mutex> lock(tcp_socket_lock_);
-  if (tcp_socket_.size() == kMaxTcpHandleNumber) {
+  if (!tcp_socket_.Insert(new_socket, new_handle)) {
     LOG(kError, "fail to new tcp handle: reach max tcp handle number.");
     return false;
   }
-  if (tcp_socket_count_ != kMaxTcpHandleNumber) {
-    ++tcp_socket_count_;
-    new_handle = tcp_socket_count_;
-  } else {
-    TcpHandle min_handle = 1;
-    auto socket = tcp_socket_.find(min_handle);
-    while (socket != tcp_socket_.end()) {
-      ++min_handle;
-      socket = tcp_socket_.find(min_handle);
-    }
-    new_handle = min_handle;
-  }
-  tcp_socket_.insert(std::make_pair(new_handle, new_socket));
   return true;
 }
 
-bool ResManager::NewUdpSocket(TcpHandle& new_handle, const std::shared_ptr<UdpSocket>& new_socket) {
-  std::lock_guard<std::mutex> lock(udp_socket_lock_);
-  if (udp_socket_.size() == kMaxUdpHandleNumber) {
+bool ResManager::NewUdpSocket(UdpHandle& new_handle, const std::shared_ptr<UdpSocket>& new_socket) {
+  if (!udp_socket_.Insert(new_socket, new_handle)) {
     LOG(kError, "fail to new udp handle: reach max udp handle number.");
     return false;
   }
-  if (udp_socket_count_ != kMaxUdpHandleNumber) {
-    ++udp_socket_count_;
-    new_handle = udp_socket_count_;
-  } else {
-    UdpHandle min_handle = 1;
-    auto socket = udp_socket_.find(min_handle);
-    while (socket != udp_socket_.end()) {
-      ++min_handle;
-      socket = udp_socket_.find(min_handle);
-    }
-    new_handle = min_handle;
-  }
-  udp_socket_.insert(std::make_pair(new_handle, new_socket));
   return true;
 }
 
 void ResManager::RemoveTcpSocket(TcpHandle handle) {
-  std::lock_guard<std::mutex> lock(tcp_socket_lock_);
-  auto socket = tcp_socket_.find(handle);
-  if (socket == tcp_socket_.end()) {
-    return;
+  auto socket = tcp_socket_.Remove(handle);
+  if (socket && socket->check_timer() != 0) {
+    iocp_.CancelTimer(socket->exchange_check_timer(0));
   }
-  tcp_socket_.erase(socket);
-  return;
 }
 
 void ResManager::RemoveUdpSocket(UdpHandle handle) {
-  std::lock_guard<std::mutex> lock(udp_socket_lock_);
-  auto socket = udp_socket_.find(handle);
-  if (socket == udp_socket_.end()) {
-    return;
-  }
-  udp_socket_.erase(socket);
-  return;
+  udp_socket_.Remove(handle);
 }
 
 std::shared_ptr<TcpSocket> ResManager::GetTcpSocket(TcpHandle handle) {
-  std::lock_guard<std::mutex> lock(tcp_socket_lock_);
-  auto socket = tcp_socket_.find(handle);
-  if (socket == tcp_socket_.end()) {
-    LOG(kError, "can not find tcp handle: %u.", handle);
-    return nullptr;
+  auto socket = tcp_socket_.Get(handle);
+  if (!socket) {
+    LOG(kError, "can not find tcp handle: %lu.", handle);
   }
-  return socket->second;
+  return socket;
 }
 
 std::shared_ptr<UdpSocket> ResManager::GetUdpSocket(UdpHandle handle) {
-  std::lock_guard<std::mutex> lock(udp_socket_lock_);
-  auto socket = udp_socket_.find(handle);
-  if (socket == udp_socket_.end()) {
-    return nullptr;
-  }
-  return socket->second;
+  return udp_socket_.Get(handle);
 }
 
 TcpAcceptBuffer* ResManager::GetTcpAcceptBuffer() {
-  auto buffer = new TcpAcceptBuffer;
-  return buffer;
+  return BufferPool<TcpAcceptBuffer>::Instance()->Get();
 }
 
 TcpSendBuffer* ResManager::GetTcpSendBuffer() {
-  auto buffer = new TcpSendBuffer;
-  return buffer;
+  return BufferPool<TcpSendBuffer>::Instance()->Get();
 }
 
 TcpRecvBuffer* ResManager::GetTcpRecvBuffer() {
-  auto buffer = new TcpRecvBuffer;
-  return buffer;
+  return BufferPool<TcpRecvBuffer>::Instance()->Get();
 }
 
 UdpSendBuffer* ResManager::GetUdpSendBuffer() {
-  auto buffer = new UdpSendBuffer;
-  return buffer;
+  return BufferPool<UdpSendBuffer>::Instance()->Get();
 }
 
 UdpRecvBuffer* ResManager::GetUdpRecvBuffer() {
-  auto buffer = new UdpRecvBuffer;
-  return buffer;
+  return BufferPool<UdpRecvBuffer>::Instance()->Get();
+}
+
+TcpFlushBuffer* ResManager::GetTcpFlushBuffer() {
+  return BufferPool<TcpFlushBuffer>::Instance()->Get();
+}
+
+TcpConnectBuffer* ResManager::GetTcpConnectBuffer() {
+  return BufferPool<TcpConnectBuffer>::Instance()->Get();
 }
 
 void ResManager::ReturnTcpAcceptBuffer(TcpAcceptBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
-  }
+  BufferPool<TcpAcceptBuffer>::Instance()->Return(buffer);
 }
 
 void ResManager::ReturnTcpSendBuffer(TcpSendBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
-  }
+  BufferPool<TcpSendBuffer>::Instance()->Return(buffer);
 }
 
 void ResManager::ReturnTcpRecvBuffer(TcpRecvBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
-  }
+  BufferPool<TcpRecvBuffer>::Instance()->Return(buffer);
 }
 
 void ResManager::ReturnUdpSendBuffer(UdpSendBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
-  }
+  BufferPool<UdpSendBuffer>::Instance()->Return(buffer);
 }
 
 void ResManager::ReturnUdpRecvBuffer(UdpRecvBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
-  }
+  BufferPool<UdpRecvBuffer>::Instance()->Return(buffer);
+}
+
+#ifndef _WIN32
+UdpRecvBatchBuffer* ResManager::GetUdpRecvBatchBuffer() {
+  return BufferPool<UdpRecvBatchBuffer>::Instance()->Get();
+}
+
+void ResManager::ReturnUdpRecvBatchBuffer(UdpRecvBatchBuffer* buffer) {
+  BufferPool<UdpRecvBatchBuffer>::Instance()->Return(buffer);
+}
+#endif // _WIN32
+
+void ResManager::ReturnTcpFlushBuffer(TcpFlushBuffer* buffer) {
+  BufferPool<TcpFlushBuffer>::Instance()->Return(buffer);
+}
+
+void ResManager::ReturnTcpConnectBuffer(TcpConnectBuffer* buffer) {
+  BufferPool<TcpConnectBuffer>::Instance()->Return(buffer);
 }
 
 bool ResManager::AsyncTcpAccept(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpAcceptBuffer* buffer) {
@@ -394,13 +985,67 @@ bool ResManager::AsyncTcpAccept(TcpHandle handle, const std::shared_ptr<TcpSocke
 
 bool ResManager::AsyncTcpRecv(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpRecvBuffer* buffer) {
   buffer->set_handle(handle);
-  if (!socket->AsyncRecv(buffer->buffer(), buffer->buffer_size(), buffer->ovlp())) {
+  if (!socket->AsyncRecv(buffer)) {
     ReturnTcpRecvBuffer(buffer);
     return false;
   }
   return true;
 }
 
+// in per core mode only the loop owning the connection writes to it, other threads post it a flush.
+// a write that can not be started fails the connection, its queued packets are dropped
+bool ResManager::StartTcpSend(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket) {
+  if (!iocp_.per_core() || IOCP::CurrentLoop() == socket->loop()) {
+    if (!FlushTcpSend(socket)) {
+      FailTcpSend(handle, socket);
+      return false;
+    }
+    return true;
+  }
+  auto flush_buffer = GetTcpFlushBuffer();
+  if (flush_buffer == nullptr) {
+    ReturnTcpSendBatch(socket->AbortSend(nullptr));
+    FailTcpSend(handle, socket);
+    return false;
+  }
+  flush_buffer->set_handle(handle);
+  if (!iocp_.PostToLoop(socket->loop(), flush_buffer->ovlp())) {
+    ReturnTcpFlushBuffer(flush_buffer);
+    ReturnTcpSendBatch(socket->AbortSend(nullptr));
+    FailTcpSend(handle, socket);
+    return false;
+  }
+  return true;
+}
+
+// another failed write may have removed the handle already, the error is reported once
+void ResManager::FailTcpSend(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket) {
+  if (tcp_socket_.Get(handle) == socket) {
+    OnTcpError(handle, socket->callback(), 5);
+  }
+}
+
+// the first packet of a batch carries the overlapped of the whole gather write
+bool ResManager::FlushTcpSend(const std::shared_ptr<TcpSocket>& socket) {
+  auto batch = socket->PopSendBatch(send_options_.max_gather_packet, send_options_.max_gather_bytes);
+  if (batch == nullptr) {
+    return true;
+  }
+  if (!socket->AsyncSend(batch)) {
+    ReturnTcpSendBatch(socket->AbortSend(batch));
+    return false;
+  }
+  return true;
+}
+
+void ResManager::ReturnTcpSendBatch(TcpSendBuffer* batch) {
+  while (batch != nullptr) {
+    auto next = batch->next();
+    ReturnTcpSendBuffer(batch);
+    batch = next;
+  }
+}
+
 bool ResManager::AsyncUdpRecv(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer* buffer) {
   buffer->set_handle(handle);
   if (!socket->AsyncRecvFrom(buffer->buffer(), buffer->buffer_size(), buffer->ovlp(), buffer->from_addr(), buffer->addr_size())) {
@@ -410,8 +1055,49 @@ bool ResManager::AsyncUdpRecv(UdpHandle handle, const std::shared_ptr<UdpSocket>
   return true;
 }
 
+void ResManager::ReturnUdpSendBatch(UdpSendBuffer* batch) {
+  while (batch != nullptr) {
+    auto next = batch->next();
+    ReturnUdpSendBuffer(batch);
+    batch = next;
+  }
+}
+
+#ifndef _WIN32
+// a gro slot has to hold the largest coalesced receive, a plain one the largest datagram
+int ResManager::UdpSlotSize() {
+  return options_.udp_gro ? kUdpGroBufferSize : options_.udp_buffer_size;
+}
+
+bool ResManager::AsyncUdpRecvBatch(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBatchBuffer* buffer) {
+  buffer->set_handle(handle);
+  buffer->Prepare(socket->batch_count(), UdpSlotSize());
+  if (!socket->AsyncRecvBatch(buffer)) {
+    ReturnUdpRecvBatchBuffer(buffer);
+    return false;
+  }
+  return true;
+}
+
+// the first datagram of a batch carries the overlapped of the whole send
+bool ResManager::FlushUdpSend(const std::shared_ptr<UdpSocket>& socket) {
+  auto batch = socket->PopSendBatch();
+  if (batch == nullptr) {
+    return true;
+  }
+  if (!socket->AsyncSendBatch(batch)) {
+    ReturnUdpSendBatch(batch);
+    return false;
+  }
+  return true;
+}
+#endif // _WIN32
+
 bool ResManager::TransferAsyncType(LPOVERLAPPED ovlp, DWORD transfer_size) {
+  NetMetrics::MarkCompletion();
   auto async_buffer = (BaseBuffer*)ovlp;
+  // the buffer may be reused by the time the scope closes, so the event is taken now
+  FlightScope flight(async_buffer->async_type(), async_buffer->handle(), transfer_size);
   switch (async_buffer->async_type()) {
   case kAsyncTypeTcpAccept:
     return OnTcpAccept((TcpAcceptBuffer*)async_buffer);
@@ -423,15 +1109,85 @@ bool ResManager::TransferAsyncType(LPOVERLAPPED ovlp, DWORD transfer_size) {
     return OnUdpSend((UdpSendBuffer*)async_buffer);
   case kAsyncTypeUdpRecv:
     return OnUdpRecv((UdpRecvBuffer*)async_buffer, transfer_size);
+  case kAsyncTypeTcpFlush:
+    return OnTcpFlush((TcpFlushBuffer*)async_buffer);
+  case kAsyncTypeTcpConnect:
+    return OnTcpConnect((TcpConnectBuffer*)async_buffer);
+#ifndef _WIN32
+  case kAsyncTypeUdpRecvBatch:
+    return OnUdpRecvBatch((UdpRecvBatchBuffer*)async_buffer, transfer_size);
+#endif // _WIN32
   default:
     return false;
   }
 }
 
+void ResManager::TransferTimerType(const TimerEvent& event) {
+  NetMetrics::ClearCompletion();
+  FlightScope flight(kFlightTimerBase + event.type, event.handle, 0);
+  switch (event.type) {
+  case kTimerTypeTcpConnect:
+    OnTcpConnectTimeout(event.handle);
+    break;
+  case kTimerTypeTcpCheck:
+    OnTcpCheck(event.handle, event.id);
+    break;
+  case kTimerTypeTcpPool: {
+    auto pool = tcp_pool_.Get(event.handle);
+    if (pool) {
+      pool->OnConnectTimer(static_cast<int>(event.arg));
+    }
+    break;
+  }
+  case kTimerTypeUser: {
+    CallbackTimer timer;
+    reinterpret_cast<NetInterface*>(static_cast<uintptr_t>(event.arg))->OnTimer(event.id);
+    break;
+  }
+  default:
+    LOG(kError, "unknown timer type: %d.", event.type);
+    break;
+  }
+}
+
+// a newer check replaces the pending one, so a socket never has two of them running
+void ResManager::ArmTcpCheck(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, int delay) {
+  unsigned long long timer_id = 0;
+  if (!iocp_.ScheduleTimer(socket->loop(), kTimerTypeTcpCheck, handle, 0, delay, 0, timer_id)) {
+    return;
+  }
+  auto old_id = socket->exchange_check_timer(timer_id);
+  if (old_id != 0) {
+    iocp_.CancelTimer(old_id);
+  }
+}
+
+void ResManager::OnTcpCheck(TcpHandle handle, unsigned long long id) {
+  auto socket = tcp_socket_.Get(handle);
+  if (!socket || socket->check_timer() != id) {
+    return;
+  }
+  auto error = 0;
+  uint32_t ping = 0;
+  auto delay = socket->CheckTimeout(SteadyMilliseconds(), error, ping);
+  if (error != 0) {
+    OnTcpError(handle, socket->callback(), error);
+    return;
+  }
+  if (ping != 0) {
+    SendTcpControl(handle, socket, kTcpPingPacketFlag, ping);
+  }
+  if (delay >= 0) {
+    ArmTcpCheck(handle, socket, delay);
+  } else {
+    socket->exchange_check_timer(0);
+  }
+}
+
 bool ResManager::OnTcpAccept(TcpAcceptBuffer* buffer) {
   std::shared_ptr<TcpSocket> accept_socket((TcpSocket*)(buffer->accept_socket()));
   auto listen_handle = buffer->handle();
-  auto listen_socket = GetTcpSocket(listen_handle);
+  auto listen_socket = tcp_socket_.Get(listen_handle);
   if (!listen_socket) {
     ReturnTcpAcceptBuffer(buffer);
     return true;
@@ -446,13 +1202,107 @@ bool ResManager::OnTcpAccept(TcpAcceptBuffer* buffer) {
 }
 
 bool ResManager::OnTcpSend(TcpSendBuffer* buffer) {
-  ReturnTcpSendBuffer(buffer);
+  auto send_handle = buffer->handle();
+  long long bytes = 0;
+  long long packets = 0;
+  for (auto packet = buffer; packet != nullptr; packet = packet->next()) {
+    bytes += packet->wire_size();
+    packets += packet->part_count() > 0 ? 1 : 0;
+  }
+  ReturnTcpSendBatch(buffer);
+  NetMetrics::Add(kMetricTcpBytesOut, bytes);
+  NetMetrics::Add(kMetricTcpPacketsOut, packets);
+  auto send_socket = tcp_socket_.Get(send_handle);
+  if (!send_socket) {
+    return true;
+  }
+  send_socket->CountSend(bytes, packets);
+  auto writable = send_socket->OnSendDone(bytes);
+  if (!FlushTcpSend(send_socket)) {
+    OnTcpError(send_handle, send_socket->callback(), 5);
+    return false;
+  }
+  if (writable) {
+    CallbackTimer timer;
+    send_socket->callback()->OnTcpWritable(send_handle);
+  }
+  return true;
+}
+
+bool ResManager::OnTcpFlush(TcpFlushBuffer* buffer) {
+  auto flush_handle = buffer->handle();
+  ReturnTcpFlushBuffer(buffer);
+  auto flush_socket = tcp_socket_.Get(flush_handle);
+  if (!flush_socket) {
+    return true;
+  }
+  if (!FlushTcpSend(flush_socket)) {
+    OnTcpError(flush_handle, flush_socket->callback(), 5);
+    return false;
+  }
+  return true;
+}
+
+// the packets queued while connecting go out once the receive is posted
+bool ResManager::OnTcpConnect(TcpConnectBuffer* buffer) {
+  auto connect_handle = buffer->handle();
+  auto connect_socket = tcp_socket_.Get(connect_handle);
+  auto error = 0;
+  if (!connect_socket || !connect_socket->OnConnect(buffer->ovlp(), error)) {
+    ReturnTcpConnectBuffer(buffer);
+    return true;
+  }
+  ReturnTcpConnectBuffer(buffer);
+  auto callback = connect_socket->callback();
+  if (error != 0) {
+    LOG(kError, "connect tcp handle: %lu failed, error code: %d.", connect_handle, error);
+    NetMetrics::Add(kMetricTcpConnectFailed, 1);
+    {
+      CallbackTimer timer;
+      callback->OnTcpConnected(connect_handle, error);
+    }
+    RemoveTcpSocket(connect_handle);
+    return true;
+  }
+  NetMetrics::Add(kMetricTcpConnected, 1);
+  {
+    CallbackTimer timer;
+    callback->OnTcpConnected(connect_handle, 0);
+  }
+  auto recv_buffer = GetTcpRecvBuffer();
+  if (recv_buffer == nullptr) {
+    OnTcpError(connect_handle, callback, 2);
+    return false;
+  }
+  if (!AsyncTcpRecv(connect_handle, connect_socket, recv_buffer)) {
+    OnTcpError(connect_handle, callback, 4);
+    return false;
+  }
+  if (!FlushTcpSend(connect_socket)) {
+    OnTcpError(connect_handle, callback, 5);
+    return false;
+  }
   return true;
 }
 
+// runs on the socket's io loop through TransferTimerType, releasing the handle closes the socket and aborts the pending connect
+void ResManager::OnTcpConnectTimeout(TcpHandle handle) {
+  auto socket = tcp_socket_.Get(handle);
+  if (!socket || !socket->TimeoutConnect()) {
+    return;
+  }
+  LOG(kError, "connect tcp handle: %lu failed: timed out.", handle);
+  NetMetrics::Add(kMetricTcpConnectFailed, 1);
+  {
+    CallbackTimer timer;
+    socket->callback()->OnTcpConnected(handle, kTcpConnectTimedOut);
+  }
+  RemoveTcpSocket(handle);
+}
+
 bool ResManager::OnTcpRecv(TcpRecvBuffer* buffer, int size) {
   auto recv_handle = buffer->handle();
-  auto recv_socket = GetTcpSocket(recv_handle);
+  auto recv_socket = tcp_socket_.Get(recv_handle);
   if (!recv_socket) {
     ReturnTcpRecvBuffer(buffer);
     return true;
@@ -460,19 +1310,44 @@ bool ResManager::OnTcpRecv(TcpRecvBuffer* buffer, int size) {
   auto callback = recv_socket->callback();
   if (size == 0) {
     ReturnTcpRecvBuffer(buffer);
+    NetMetrics::Add(kMetricTcpDisconnected, 1);
     callback->OnTcpDisconnected(recv_handle);
     RemoveTcpSocket(recv_handle);
     return true;
   }
-  auto recv_buff = buffer->buffer();
-  if (!recv_socket->OnRecv(recv_buff, size)) {
+  if (!recv_socket->OnRecv(buffer, size)) {
     ReturnTcpRecvBuffer(buffer);
     OnTcpError(recv_handle, callback, 3);
     return false;
   }
+  uint32_t pong = 0;
+  if (recv_socket->TakePong(pong)) {
+    SendTcpControl(recv_handle, recv_socket, kTcpPongPacketFlag, pong);
+  }
   const auto& all_packet = recv_socket->all_packets();
-  for (const auto& i : all_packet) {
-    callback->OnTcpReceived(recv_handle, i.packet, i.size);
+  const auto& all_chunk = recv_socket->all_chunks();
+  // a chunked packet counts once, with its last chunk
+  size_t chunked_count = 0;
+  for (const auto& chunk : all_chunk) {
+    chunked_count += chunk.last ? 1 : 0;
+  }
+  NetMetrics::Add(kMetricTcpBytesIn, size);
+  NetMetrics::Add(kMetricTcpPacketsIn, all_packet.size() + chunked_count);
+  recv_socket->CountRecv(size, all_packet.size() + chunked_count);
+  if (!all_packet.empty() || !all_chunk.empty()) {
+    CallbackTimer timer;
+    // the whole packets before each chunk go first, so the callbacks see the stream in order
+    size_t done = 0;
+    for (const auto& chunk : all_chunk) {
+      if (chunk.packet_index > done) {
+        callback->OnTcpReceivedBatch(recv_handle, &all_packet[done], static_cast<int>(chunk.packet_index - done));
+        done = chunk.packet_index;
+      }
+      callback->OnTcpReceivedChunk(recv_handle, chunk.msg_id, chunk.offset, chunk.data, chunk.size, chunk.last);
+    }
+    if (all_packet.size() > done) {
+      callback->OnTcpReceivedBatch(recv_handle, &all_packet[done], static_cast<int>(all_packet.size() - done));
+    }
   }
   recv_socket->OnRecvDone();
   if (!AsyncTcpRecv(recv_handle, recv_socket, buffer)) {
@@ -483,7 +1358,26 @@ bool ResManager::OnTcpRecv(TcpRecvBuffer* buffer, int size) {
 }
 
 bool ResManager::OnUdpSend(UdpSendBuffer* buffer) {
-  ReturnUdpSendBuffer(buffer);
+  auto send_handle = buffer->handle();
+  unsigned long long bytes = 0;
+  unsigned long long datagrams = 0;
+  for (auto datagram = buffer; datagram != nullptr; datagram = datagram->next()) {
+    bytes += datagram->buffer_size();
+    ++datagrams;
+  }
+  NetMetrics::Add(kMetricUdpBytesOut, bytes);
+  NetMetrics::Add(kMetricUdpDatagramsOut, datagrams);
+  ReturnUdpSendBatch(buffer);
+#ifndef _WIN32
+  auto send_socket = udp_socket_.Get(send_handle);
+  if (!send_socket || send_socket->batch_count() <= 1) {
+    return true;
+  }
+  if (!FlushUdpSend(send_socket)) {
+    OnUdpError(send_handle, send_socket->callback(), 2);
+    return false;
+  }
+#endif // _WIN32
   return true;
 }
 
@@ -494,11 +1388,15 @@ bool ResManager::OnUdpRecv(UdpRecvBuffer* buffer, int size) {
     ReturnUdpRecvBuffer(buffer);
     return true;
   }
-  std::string ip;
-  int port = 0;
-  utility::FromSockAddr(*buffer->from_addr(), ip, port);
+  UdpEndpoint from;
+  ToUdpEndpoint(*buffer->from_addr(), from);
+  NetMetrics::Add(kMetricUdpBytesIn, size);
+  NetMetrics::Add(kMetricUdpDatagramsIn, 1);
   auto callback = recv_socket->callback();
-  callback->OnUdpReceived(recv_handle, buffer->buffer(), size, ip, port);
+  {
+    CallbackTimer timer;
+    callback->OnUdpReceivedFrom(recv_handle, buffer->buffer(), size, from);
+  }
   if (!AsyncUdpRecv(recv_handle, recv_socket, buffer)) {
     OnUdpError(recv_handle, callback, 1);
     return false;
@@ -506,8 +1404,49 @@ bool ResManager::OnUdpRecv(UdpRecvBuffer* buffer, int size) {
   return true;
 }
 
+#ifndef _WIN32
+// coalesced datagrams are cut apart again, the callback sees every one on its own
+bool ResManager::OnUdpRecvBatch(UdpRecvBatchBuffer* buffer, int count) {
+  auto recv_handle = buffer->handle();
+  auto recv_socket = GetUdpSocket(recv_handle);
+  if (!recv_socket) {
+    ReturnUdpRecvBatchBuffer(buffer);
+    return true;
+  }
+  auto& all_datagram = t_datagram;
+  all_datagram.clear();
+  for (auto i = 0; i < count; ++i) {
+    UdpDatagramView datagram;
+    ToUdpEndpoint(*buffer->from_addr(i), datagram.from);
+    auto size = buffer->size(i);
+    auto segment = buffer->segment_size(i);
+    if (segment <= 0) {
+      segment = size;
+    }
+    for (auto offset = 0; offset < size; offset += segment) {
+      datagram.packet = buffer->slot(i) + offset;
+      datagram.size = std::min(segment, size - offset);
+      all_datagram.push_back(datagram);
+    }
+    NetMetrics::Add(kMetricUdpBytesIn, size);
+  }
+  NetMetrics::Add(kMetricUdpDatagramsIn, all_datagram.size());
+  auto callback = recv_socket->callback();
+  if (!all_datagram.empty()) {
+    CallbackTimer timer;
+    callback->OnUdpReceivedBatch(recv_handle, &all_datagram[0], static_cast<int>(all_datagram.size()));
+  }
+  if (!AsyncUdpRecvBatch(recv_handle, recv_socket, buffer)) {
+    OnUdpError(recv_handle, callback, 1);
+    return false;
+  }
+  return true;
+}
+#endif // _WIN32
+
 bool ResManager::OnTcpAcceptNew(TcpHandle listen_handle, const std::shared_ptr<TcpSocket>& listen_socket, const std::shared_ptr<TcpSocket>& accept_socket) {
   auto accept_handle = kInvalidTcpHandle;
+  accept_socket->set_options(listen_socket->options());
   if (!NewTcpSocket(accept_handle, accept_socket)) {
     return false;
   }
@@ -515,12 +1454,23 @@ bool ResManager::OnTcpAcceptNew(TcpHandle listen_handle, const std::shared_ptr<T
     RemoveTcpSocket(accept_handle);
     return false;
   }
-  if (!iocp_.BindToIOCP(accept_socket->socket())) {
+  auto loop = 0;
+  if (!iocp_.BindToIOCP(accept_socket->socket(), loop)) {
     RemoveTcpSocket(accept_handle);
     return false;
   }
+  accept_socket->set_loop(loop);
+  accept_socket->set_max_packet_size(options_.max_tcp_packet_size);
+  auto accept_options = accept_socket->options();
+  if (accept_options.idle_timeout > 0 || accept_options.send_timeout > 0 || accept_options.heartbeat_interval > 0) {
+    ArmTcpCheck(accept_handle, accept_socket, 0);
+  }
+  NetMetrics::Add(kMetricTcpAccepted, 1);
   auto callback = accept_socket->callback();
-  callback->OnTcpAccepted(listen_handle, accept_handle);
+  {
+    CallbackTimer timer;
+    callback->OnTcpAccepted(listen_handle, accept_handle);
+  }
   auto recv_buffer = GetTcpRecvBuffer();
   if (recv_buffer == nullptr) {
     OnTcpError(accept_handle, callback, 2);
@@ -534,7 +1484,8 @@ bool ResManager::OnTcpAcceptNew(TcpHandle listen_handle, const std::shared_ptr<T
 }
 
 void ResManager::OnTcpError(TcpHandle handle, NetInterface* callback, int error) {
-  LOG(kError, "tcp handle %u error: %d.", handle, error);
+  LOG(kError, "tcp handle %lu error: %d.", handle, error);
+  NetMetrics::CountTcpError(error);
   if (callback != nullptr) {
     callback->OnTcpError(handle, error);
   }
@@ -542,7 +1493,8 @@ void ResManager::OnTcpError(TcpHandle handle, NetInterface* callback, int error)
 }
 
 void ResManager::OnUdpError(UdpHandle handle, NetInterface* callback, int error) {
-  LOG(kError, "udp handle %u error: %d.", handle, error);
+  LOG(kError, "udp handle %lu error: %d.", handle, error);
+  NetMetrics::CountUdpError(error);
   if (callback != nullptr) {
     callback->OnUdpError(handle, error);
   }
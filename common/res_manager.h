@@ -1,15 +1,19 @@
 #ifndef NET_RES_MANAGER_H_
 #define NET_RES_MANAGER_H_
 
+#include "handle_table.h"
 #include "iocp.h"
 #include "net.h"
 #include "tcp_buffer.h"
+#include "tcp_pool.h"
 #include "tcp_socket.h"
 #include "udp_buffer.h"
 #include "udp_socket.h"
 #include "singleton.h"
 #include "uncopyable.h"
 #include <map>
+#include <mutex>
+#include <vector>
 
 namespace net {
 
@@ -19,23 +23,52 @@ class ResManager : public utility::Uncopyable {
   ~ResManager();
 
   bool StartupNet();
+  bool StartupNet(const NetOptions& options);
   bool CleanupNet();
   bool TcpCreate(NetInterface* callback, const std::string& ip, int port, TcpHandle& new_handle);
   bool TcpDestroy(TcpHandle handle);
   bool TcpListen(TcpHandle handle);
-  bool TcpConnect(TcpHandle handle, const std::string& ip, int port);
+  bool TcpConnect(TcpHandle handle, const std::string& ip, int port, int timeout);
   bool TcpSend(TcpHandle handle, std::unique_ptr<char[]> packet, int size);
+  bool TcpSendv(TcpHandle handle, const NetBuffer* buffers, int count);
+  SharedPacket MakeSharedPacket(std::unique_ptr<char[]> packet, int size);
+  int TcpBroadcast(const TcpHandle* handles, int count, const SharedPacket& packet);
+  int TcpTrySend(TcpHandle handle, std::unique_ptr<char[]>& packet, int size);
   bool TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port);
   bool TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port);
+  bool TcpSetOptions(TcpHandle handle, const TcpOptions& options);
+  bool TcpGetOptions(TcpHandle handle, TcpOptions& options);
+  bool TcpPoolCreate(NetInterface* callback, const std::string& ip, int port, const TcpPoolOptions& options, TcpPoolHandle& new_handle);
+  bool TcpPoolDestroy(TcpPoolHandle handle);
+  bool TcpPoolSend(TcpPoolHandle handle, std::unique_ptr<char[]> packet, int size);
   bool UdpCreate(NetInterface* callback, const std::string& ip, int port, UdpHandle& new_handle);
   bool UdpDestroy(UdpHandle handle);
   bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const std::string& ip, int port);
+  bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const UdpEndpoint& to);
+  bool UdpMakeEndpoint(const std::string& ip, int port, UdpEndpoint& endpoint);
+  void UdpEndpointToAddr(const UdpEndpoint& endpoint, char ip[16], int& port);
+  bool UdpResolvePeer(const std::string& host, int port, UdpPeerHandle& new_handle);
+  bool UdpReleasePeer(UdpPeerHandle handle);
+  bool UdpSendToPeer(UdpHandle handle, std::unique_ptr<char[]> packet, int size, UdpPeerHandle peer);
+  bool UdpConnect(UdpHandle handle, const std::string& ip, int port);
+  bool UdpSend(UdpHandle handle, std::unique_ptr<char[]> packet, int size);
+  bool SetSendOptions(const NetSendOptions& options);
+  bool SetPoolOptions(int pool, const NetPoolOptions& options);
+  bool GetPoolStats(int pool, NetPoolStats& stats);
+  bool GetStats(NetStats& stats);
+  bool TcpGetStats(TcpHandle handle, NetTcpStats& stats);
+  bool ScheduleTimer(NetInterface* callback, int delay, int period, NetTimerHandle& new_handle);
+  bool CancelTimer(NetTimerHandle handle);
+  // used by the tcp pools: the reconnect timer of a connection, -1 bytes for an unknown handle
+  bool SchedulePoolTimer(TcpPoolHandle handle, int index, int delay);
+  long long TcpQueuedBytes(TcpHandle handle);
 
  private:
   bool NewTcpSocket(TcpHandle& new_handle, const std::shared_ptr<TcpSocket>& new_socket);
-  bool NewUdpSocket(TcpHandle& new_handle, const std::shared_ptr<UdpSocket>& new_socket);
+  bool NewUdpSocket(UdpHandle& new_handle, const std::shared_ptr<UdpSocket>& new_socket);
   void RemoveTcpSocket(TcpHandle handle);
   void RemoveUdpSocket(UdpHandle handle);
+  // logs a miss, for user calls. completions race with closes and look up tcp_socket_ directly
   std::shared_ptr<TcpSocket> GetTcpSocket(TcpHandle handle);
   std::shared_ptr<UdpSocket> GetUdpSocket(UdpHandle handle);
 
@@ -44,22 +77,53 @@ class ResManager : public utility::Uncopyable {
   TcpRecvBuffer* GetTcpRecvBuffer();
   UdpSendBuffer* GetUdpSendBuffer();
   UdpRecvBuffer* GetUdpRecvBuffer();
+  TcpFlushBuffer* GetTcpFlushBuffer();
+  TcpConnectBuffer* GetTcpConnectBuffer();
   void ReturnTcpAcceptBuffer(TcpAcceptBuffer* buffer);
   void ReturnTcpSendBuffer(TcpSendBuffer* buffer);
   void ReturnTcpRecvBuffer(TcpRecvBuffer* buffer);
   void ReturnUdpSendBuffer(UdpSendBuffer* buffer);
   void ReturnUdpRecvBuffer(UdpRecvBuffer* buffer);
+  void ReturnTcpFlushBuffer(TcpFlushBuffer* buffer);
+  void ReturnTcpConnectBuffer(TcpConnectBuffer* buffer);
+#ifndef _WIN32
+  UdpRecvBatchBuffer* GetUdpRecvBatchBuffer();
+  void ReturnUdpRecvBatchBuffer(UdpRecvBatchBuffer* buffer);
+#endif // _WIN32
 
   bool AsyncTcpAccept(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpAcceptBuffer* buffer);
   bool AsyncTcpRecv(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpRecvBuffer* buffer);
+  bool StartTcpSend(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket);
+  bool SendTcpControl(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, uint32_t packet_flag, uint32_t sequence);
+  bool FlushTcpSend(const std::shared_ptr<TcpSocket>& socket);
+  void FailTcpSend(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket);
+  void ReturnTcpSendBatch(TcpSendBuffer* batch);
   bool AsyncUdpRecv(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer* buffer);
+  bool StartUdpRecv(UdpHandle new_handle, const std::shared_ptr<UdpSocket>& new_socket);
+  // to_addr nullptr sends to the peer of a connected socket
+  bool SendUdpTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const SOCKADDR_IN* to_addr);
+  void ReturnUdpSendBatch(UdpSendBuffer* batch);
+#ifndef _WIN32
+  int UdpSlotSize();
+  bool AsyncUdpRecvBatch(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBatchBuffer* buffer);
+  bool FlushUdpSend(const std::shared_ptr<UdpSocket>& socket);
+#endif // _WIN32
 
   bool TransferAsyncType(LPOVERLAPPED ovlp, DWORD transfer_size);
+  void TransferTimerType(const TimerEvent& event);
+  void ArmTcpCheck(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, int delay);
+  void OnTcpCheck(TcpHandle handle, unsigned long long id);
   bool OnTcpAccept(TcpAcceptBuffer* buffer);
   bool OnTcpSend(TcpSendBuffer* buffer);
+  bool OnTcpFlush(TcpFlushBuffer* buffer);
+  bool OnTcpConnect(TcpConnectBuffer* buffer);
+  void OnTcpConnectTimeout(TcpHandle handle);
   bool OnTcpRecv(TcpRecvBuffer* buffer, int size);
   bool OnUdpSend(UdpSendBuffer* buffer);
   bool OnUdpRecv(UdpRecvBuffer* buffer, int size);
+#ifndef _WIN32
+  bool OnUdpRecvBatch(UdpRecvBatchBuffer* buffer, int count);
+#endif // _WIN32
 
   bool OnTcpAcceptNew(TcpHandle listen_handle, const std::shared_ptr<TcpSocket>& listen_socket, const std::shared_ptr<TcpSocket>& accept_socket);
   void OnTcpError(TcpHandle handle, NetInterface* callback, int error);
@@ -68,12 +132,16 @@ class ResManager : public utility::Uncopyable {
  private:
   bool net_started_;
   IOCP iocp_;
-  std::mutex tcp_socket_lock_;
-  std::mutex udp_socket_lock_;
-  unsigned long tcp_socket_count_;
-  unsigned long udp_socket_count_;
-  std::map<TcpHandle, std::shared_ptr<TcpSocket>> tcp_socket_;
-  std::map<UdpHandle, std::shared_ptr<UdpSocket>> udp_socket_;
+  NetOptions options_;
+  NetSendOptions send_options_;
+  HandleTable<TcpSocket> tcp_socket_;
+  HandleTable<UdpSocket> udp_socket_;
+  HandleTable<TcpPool> tcp_pool_;
+  HandleTable<SOCKADDR_IN> udp_peer_;
+  std::mutex pool_lock_;
+  std::map<std::string, TcpPoolHandle> pool_key_;
+  // a destroyed pool is kept until cleanup, io threads may still be inside its callbacks
+  std::vector<std::shared_ptr<TcpPool>> closed_pool_;
 };
 
 typedef utility::Singleton<ResManager> SingleResManager;
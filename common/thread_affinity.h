@@ -0,0 +1,82 @@
+#ifndef NET_THREAD_AFFINITY_H_
+#define NET_THREAD_AFFINITY_H_
+
+#include "platform.h"
+#include <string>
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace net {
+
+const int kMaxAffinityProcessor = 64;
+
+// restrict the calling thread to the processors set in mask
+inline bool SetCurrentThreadAffinity(unsigned long long mask) {
+  if (mask == 0) {
+    return false;
+  }
+#ifdef _WIN32
+  return ::SetThreadAffinityMask(::GetCurrentThread(), static_cast<DWORD_PTR>(mask)) != 0;
+#else
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (auto i = 0; i < kMaxAffinityProcessor && i < CPU_SETSIZE; ++i) {
+    if (mask & (1ULL << i)) {
+      CPU_SET(i, &cpu_set);
+    }
+  }
+  return ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#endif
+}
+
+// pin the calling thread to one processor, used by the per core loops
+inline bool PinCurrentThread(int processor) {
+  if (processor < 0 || processor >= kMaxAffinityProcessor) {
+    return false;
+  }
+  return SetCurrentThreadAffinity(1ULL << processor);
+}
+
+// the processor of per core loop index: the index-th processor set in mask, wrapping around.
+// an empty mask stands for every processor
+inline int LoopProcessor(unsigned long long mask, int index) {
+  if (mask == 0) {
+    return index;
+  }
+  auto count = 0;
+  for (auto i = 0; i < kMaxAffinityProcessor; ++i) {
+    count += (mask >> i) & 1;
+  }
+  index %= count;
+  for (auto i = 0; i < kMaxAffinityProcessor; ++i) {
+    if ((mask & (1ULL << i)) && index-- == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// shows up in debuggers and top, linux keeps only the first 15 characters
+inline void SetCurrentThreadName(const std::string& name) {
+#ifdef _WIN32
+  std::wstring wide_name(name.begin(), name.end());
+  ::SetThreadDescription(::GetCurrentThread(), wide_name.c_str());
+#else
+  ::pthread_setname_np(::pthread_self(), name.substr(0, 15).c_str());
+#endif
+}
+
+// names an io thread thread_name-index and applies the affinity asked for
+inline bool InitIoThread(const std::string& name, unsigned long long mask, bool per_core, int index) {
+  SetCurrentThreadName(name + "-" + std::to_string(index));
+  if (per_core) {
+    return PinCurrentThread(LoopProcessor(mask, index));
+  }
+  return mask == 0 || SetCurrentThreadAffinity(mask);
+}
+
+} // namespace net
+
+#endif	// NET_THREAD_AFFINITY_H_
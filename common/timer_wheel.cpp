@@ -0,0 +1,224 @@
+#include "timer_wheel.h"
+#include "log.h"
+
+namespace net {
+
+namespace {
+
+const unsigned int kGenerationMask = 0xFFFF;
+
+// due timers are copied out here so the callbacks run without the wheel lock
+thread_local std::vector<TimerEvent> t_due;
+
+unsigned long long ToTicks(int milliseconds) {
+  return (static_cast<unsigned long long>(milliseconds) + kTimerTick - 1) / kTimerTick;
+}
+
+} // namespace
+
+TimerWheel::TimerWheel(int loop) : loop_(loop), start_(SteadyMilliseconds()), count_(0), current_(0), free_head_(nullptr) {
+  for (auto level = 0; level < kLevelCount; ++level) {
+    for (auto i = 0; i < kSlotCount; ++i) {
+      slot_[level][i].prev = slot_[level][i].next = &slot_[level][i];
+    }
+  }
+  // index 0 is never handed out, so a valid id is never 0
+  chunk_.push_back(new Node[kChunkSize]);
+  for (auto i = kChunkSize - 1; i > 0; --i) {
+    auto node = &chunk_[0][i];
+    node->index = i;
+    node->generation = 0;
+    node->active = false;
+    node->next = free_head_;
+    free_head_ = node;
+  }
+}
+
+TimerWheel::~TimerWheel() {
+  for (const auto& i : chunk_) {
+    delete[] i;
+  }
+}
+
+bool TimerWheel::Add(int type, unsigned long handle, unsigned long long arg, int delay, int period, unsigned long long& id, bool& was_empty) {
+  if (delay < 0 || period < 0) {
+    LOG(kError, "add timer failed: invalid parameter.");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(lock_);
+  auto node = NewNode();
+  if (node == nullptr) {
+    LOG(kError, "add timer failed: reach max timer number.");
+    return false;
+  }
+  was_empty = count_ == 0;
+  if (was_empty) {
+    // nothing is linked, the wheel may skip the ticks nobody advanced
+    current_ = NowTick();
+  }
+  node->event.type = type;
+  node->event.handle = handle;
+  node->event.arg = arg;
+  node->event.id = (static_cast<unsigned long long>(loop_) << 48) | (static_cast<unsigned long long>(node->generation) << 32) | node->index;
+  node->expire = NowTick() + ToTicks(delay);
+  node->period = static_cast<unsigned int>(period > 0 && ToTicks(period) == 0 ? 1 : ToTicks(period));
+  node->active = true;
+  Link(node);
+  ++count_;
+  id = node->event.id;
+  return true;
+}
+
+bool TimerWheel::Cancel(unsigned long long id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto node = FindNode(id);
+  if (node == nullptr) {
+    return false;
+  }
+  Unlink(node);
+  FreeNode(node);
+  --count_;
+  return true;
+}
+
+// only one thread of a loop advances at a time, the others wait one tick and try again
+int TimerWheel::Advance(const std::function<void (const TimerEvent&)>& callback) {
+  if (count_ == 0) {
+    return -1;
+  }
+  auto& due = t_due;
+  unsigned long long next_tick = 0;
+  {
+    std::unique_lock<std::mutex> lock(lock_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return kTimerTick;
+    }
+    auto now = static_cast<unsigned long long>(NowTick());
+    while (current_ <= now && count_ > 0) {
+      auto index = current_ & kSlotMask;
+      for (auto level = 1; index == 0 && level < kLevelCount; ++level) {
+        auto slot = (current_ >> (kSlotBits * level)) & kSlotMask;
+        Cascade(level, slot);
+        if (slot != 0) {
+          break;
+        }
+      }
+      auto& head = slot_[0][index];
+      while (head.next != &head) {
+        auto node = head.next;
+        Unlink(node);
+        due.push_back(node->event);
+        if (node->period != 0) {
+          node->expire = current_ + node->period;
+          Link(node);
+        } else {
+          FreeNode(node);
+          --count_;
+        }
+      }
+      ++current_;
+    }
+    if (count_ == 0) {
+      current_ = now;
+    }
+    next_tick = current_;
+  }
+  for (const auto& i : due) {
+    callback(i);
+  }
+  due.clear();
+  if (count_ == 0) {
+    return -1;
+  }
+  auto wait = start_ + static_cast<long long>(next_tick) * kTimerTick - SteadyMilliseconds();
+  return wait < 1 ? 1 : static_cast<int>(wait);
+}
+
+long long TimerWheel::NowTick() {
+  return (SteadyMilliseconds() - start_) / kTimerTick;
+}
+
+TimerWheel::Node* TimerWheel::NewNode() {
+  if (free_head_ == nullptr) {
+    auto base = static_cast<unsigned long long>(chunk_.size()) * kChunkSize;
+    if (base + kChunkSize > 0xFFFFFFFFULL) {
+      return nullptr;
+    }
+    chunk_.push_back(new Node[kChunkSize]);
+    for (auto i = kChunkSize - 1; i >= 0; --i) {
+      auto node = &chunk_.back()[i];
+      node->index = static_cast<unsigned int>(base + i);
+      node->generation = 0;
+      node->active = false;
+      node->next = free_head_;
+      free_head_ = node;
+    }
+  }
+  auto node = free_head_;
+  free_head_ = node->next;
+  return node;
+}
+
+void TimerWheel::FreeNode(Node* node) {
+  node->active = false;
+  node->generation = (node->generation + 1) & kGenerationMask;
+  node->next = free_head_;
+  free_head_ = node;
+}
+
+TimerWheel::Node* TimerWheel::FindNode(unsigned long long id) {
+  auto index = static_cast<unsigned int>(id & 0xFFFFFFFF);
+  if (LoopOf(id) != loop_ || index == 0 || index / kChunkSize >= chunk_.size()) {
+    return nullptr;
+  }
+  auto node = &chunk_[index / kChunkSize][index % kChunkSize];
+  if (!node->active || node->generation != ((id >> 32) & kGenerationMask)) {
+    return nullptr;
+  }
+  return node;
+}
+
+// a timer already due goes into the slot processed next, one too far away waits in the top level
+void TimerWheel::Link(Node* node) {
+  auto expire = node->expire < current_ ? current_ : node->expire;
+  auto delta = expire - current_;
+  Node* head = nullptr;
+  if (delta < (1ULL << kSlotBits)) {
+    head = &slot_[0][expire & kSlotMask];
+  } else if (delta < (1ULL << (2 * kSlotBits))) {
+    head = &slot_[1][(expire >> kSlotBits) & kSlotMask];
+  } else if (delta < (1ULL << (3 * kSlotBits))) {
+    head = &slot_[2][(expire >> (2 * kSlotBits)) & kSlotMask];
+  } else {
+    if (delta >= (1ULL << (4 * kSlotBits))) {
+      expire = current_ + (1ULL << (4 * kSlotBits)) - 1;
+      node->expire = expire;
+    }
+    head = &slot_[3][(expire >> (3 * kSlotBits)) & kSlotMask];
+  }
+  node->prev = head->prev;
+  node->next = head;
+  head->prev->next = node;
+  head->prev = node;
+}
+
+void TimerWheel::Unlink(Node* node) {
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  node->prev = node->next = nullptr;
+}
+
+// the slot is emptied before relinking, a node may land in it again only when clamped
+void TimerWheel::Cascade(int level, unsigned long long slot) {
+  auto& head = slot_[level][slot];
+  auto node = head.next;
+  head.prev->next = nullptr;
+  head.prev = head.next = &head;
+  while (node != &head && node != nullptr) {
+    auto next = node->next;
+    Link(node);
+    node = next;
+  }
+}
+
+} // namespace net
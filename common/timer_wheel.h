@@ -0,0 +1,90 @@
+#ifndef NET_TIMER_WHEEL_H_
+#define NET_TIMER_WHEEL_H_
+
+#include "uncopyable.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace net {
+
+const int kTimerTick = 10;
+
+const int kTimerTypeTcpConnect = 1;
+const int kTimerTypeTcpCheck = 2;
+const int kTimerTypeTcpPool = 3;
+const int kTimerTypeUser = 4;
+
+// what a due timer hands to the timer callback, type says how to read handle and arg
+struct TimerEvent {
+  int type;
+  unsigned long handle;
+  unsigned long long arg;
+  unsigned long long id;
+};
+
+inline long long SteadyMilliseconds() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// hierarchical timer wheel of one io loop, advanced by the loop's threads before they wait.
+// four levels of 256 slots: level 0 slots are one tick wide, each level above 256 times wider,
+// a slot of an upper level is spread over the levels below when the level below wraps.
+// nodes come from chunks kept on a free list, insert and cancel are a list link and unlink.
+// an id packs loop, node generation and node index, so a fired or cancelled id is rejected
+class TimerWheel : public utility::Uncopyable {
+ public:
+  static const int kSlotBits = 8;
+  static const int kSlotCount = 1 << kSlotBits;
+  static const unsigned long long kSlotMask = kSlotCount - 1;
+  static const int kLevelCount = 4;
+  static const int kChunkSize = 4096;
+
+  explicit TimerWheel(int loop);
+  ~TimerWheel();
+
+  // delay and period in milliseconds, a period of 0 fires once. was_empty tells the caller
+  // the threads of the loop may be waiting without a timeout
+  bool Add(int type, unsigned long handle, unsigned long long arg, int delay, int period, unsigned long long& id, bool& was_empty);
+  bool Cancel(unsigned long long id);
+  // runs the due timers through callback outside the lock, returns how long the caller may
+  // wait for the next tick in milliseconds, -1 when no timer is left
+  int Advance(const std::function<void (const TimerEvent&)>& callback);
+  static int LoopOf(unsigned long long id) { return static_cast<int>(id >> 48); }
+
+ private:
+  struct Node {
+    Node* prev;
+    Node* next;
+    unsigned long long expire;
+    unsigned int period;
+    unsigned int index;
+    unsigned int generation;
+    bool active;
+    TimerEvent event;
+  };
+
+  long long NowTick();
+  Node* NewNode();
+  void FreeNode(Node* node);
+  Node* FindNode(unsigned long long id);
+  void Link(Node* node);
+  static void Unlink(Node* node);
+  void Cascade(int level, unsigned long long slot);
+
+ private:
+  int loop_;
+  long long start_;
+  std::mutex lock_;
+  std::atomic<int> count_;
+  unsigned long long current_;
+  Node slot_[kLevelCount][kSlotCount];
+  std::vector<Node*> chunk_;
+  Node* free_head_;
+};
+
+} // namespace net
+
+#endif	// NET_TIMER_WHEEL_H_
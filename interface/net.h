@@ -7,6 +7,8 @@
 #ifndef NET_INTERFACE_H_
 #define NET_INTERFACE_H_
 
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -14,44 +16,346 @@ namespace net {
 
 typedef unsigned long TcpHandle;
 typedef unsigned long UdpHandle;
+typedef unsigned long TcpPoolHandle;
+typedef unsigned long UdpPeerHandle;
+typedef unsigned long long NetTimerHandle;
+
+// an immutable packet shared by the sends of TcpBroadcast, made by MakeSharedPacket. its memory
+// and encoded header are released with the last reference, the last send to complete say
+struct SharedPacketData;
+typedef std::shared_ptr<const SharedPacketData> SharedPacket;
 
 const TcpHandle kInvalidTcpHandle = 0;
 const UdpHandle kInvalidUdpHandle = 0;
+const TcpPoolHandle kInvalidTcpPoolHandle = 0;
+const UdpPeerHandle kInvalidUdpPeerHandle = 0;
+const NetTimerHandle kInvalidNetTimerHandle = 0;
 
 const int kOneKibibyte = 1024;
 const int kOneMebibyte = 1024 * kOneKibibyte;
+// defaults of NetOptions::max_tcp_packet_size and udp_buffer_size
 const int kMaxTcpPacketSize = 16 * kOneMebibyte;
 const int kMaxUdpPacketSize = 8 * kOneKibibyte;
 
+// OnTcpConnected error when the timeout of TcpConnect passed first, other errors are socket error codes
+const int kTcpConnectTimedOut = -1;
+// OnTcpError errors of the TcpOptions timeouts, the handle is released after the callback
+const int kTcpIdleTimedOut = -2;
+const int kTcpSendTimedOut = -3;
+const int kTcpHeartbeatTimedOut = -4;
+
+// results of TcpTrySend
+const int kTcpSendOk = 0;
+const int kTcpSendWouldBlock = 1;
+const int kTcpSendFailed = -1;
+
+const int kNetPoolTcpAccept = 0;
+const int kNetPoolTcpSend = 1;
+const int kNetPoolTcpRecv = 2;
+const int kNetPoolUdpSend = 3;
+const int kNetPoolUdpRecv = 4;
+const int kNetPoolTcpStitch = 5;      // packets spanning the end of a receive ring
+const int kNetPoolTcpFlush = 6;       // per core mode, writes handed to the owning loop
+const int kNetPoolTcpConnect = 7;
+const int kNetPoolUdpRecvBatch = 8;   // linux only, the default udp receive path there
+const int kNetPoolCount = 9;
+
+// per handle, accepted handles start with the options of their listen handle.
+// timeouts are in milliseconds, 0 turns them off, and are checked on 10 millisecond ticks
+struct TcpOptions {
+  bool checksum;    // carry a crc32c of every packet sent, received packets carrying one are always verified
+  int idle_timeout; // fail a connection that received nothing for this long
+  int send_timeout; // fail a connection whose queued packets made no write progress for this long
+  // ping a peer silent for heartbeat_interval, fail it after heartbeat_miss intervals (0 means 3).
+  // pings and pongs are answered and swallowed by the library, so the peer must run this library too
+  int heartbeat_interval;
+  int heartbeat_miss;
+  // bytes sent but not written yet, headers included. at send_high_watermark TcpTrySend would block
+  // until the level drops below send_low_watermark (0 means half the high one). 0 means no limit
+  int send_high_watermark;
+  int send_low_watermark;
+  // packets larger than this are handed to OnTcpReceivedChunk piece by piece straight from the
+  // receive ring as they arrive, never collected in one buffer. 0 keeps whole packets only
+  int chunk_threshold;
+};
+
+const int kMaxTcpGatherPacket = 512;
+
+// a tcp write gathers queued packets up to both limits, a single packet always goes out
+struct NetSendOptions {
+  int max_gather_packet;
+  int max_gather_bytes;
+};
+
+struct NetPoolOptions {
+  int slab_size;    // buffers allocated at once when a pool runs dry
+  int cache_low;    // a thread cache is trimmed down to cache_low buffers
+  int cache_high;   // once it holds more than cache_high
+};
+
+struct NetPoolStats {
+  unsigned long long get_count;
+  unsigned long long cache_hit;     // served by the calling thread's cache
+  unsigned long long global_hit;    // batches taken back from the shared overflow list
+  unsigned long long slab_count;
+  unsigned long long capacity;      // buffers carved out of all slabs
+  unsigned long long in_use;
+};
+
+// sizes the library to the host, passed to StartupNet. a zero field keeps its default
+struct NetOptions {
+  int thread_count;             // io threads, processor * 2 or one loop per processor in per core mode
+  bool per_core;                // one event loop per processor, each on a thread pinned to it. a connection is
+                                // served by one loop until it is closed, sends from other threads are handed to it
+  unsigned long long cpu_mask;  // processors the io threads may run on, per core loop i is pinned to the i-th one.
+                                // 0 leaves shared threads unpinned and puts per core loops on the first processors
+  std::string thread_name;      // io threads are named thread_name-index, "net" by default
+  int accept_count;             // accepts kept posted on a listen handle, processor * 2
+  int udp_recv_count;           // receives kept posted on a udp handle, processor
+  int tcp_buffer_size;          // receive ring of a connection, a power of two, larger packets get their own buffer
+  int udp_buffer_size;          // largest udp datagram sent or received
+  int udp_batch_count;          // linux: datagrams moved per recvmmsg and sendmmsg, at most 64, 32 by default, 1 turns batching off
+  bool udp_gro;                 // linux: receive coalesced datagrams, every receive slot then takes 64 KiB
+  int max_tcp_packet_size;
+  bool callback_timing;         // fill the latency histograms of NetStats, two clock reads per callback
+};
+
+// errors of OnTcpError and OnUdpError counted by code, codes from 1 up to 7 each have their
+// own slot, slot 0 counts the rest. the tcp timeouts are counted on their own
+const int kNetErrorCodeCount = 8;
+
+// a latency histogram in nanoseconds, percentiles are exact to about 6%
+struct NetLatencyStats {
+  unsigned long long count;
+  unsigned long long total;
+  unsigned long long max;
+  unsigned long long p50;
+  unsigned long long p90;
+  unsigned long long p99;
+  unsigned long long p999;
+};
+
+// totals since the process started, counted per thread without locks and summed by NetGetStats.
+// rates are the difference of two snapshots over the difference of their time
+struct NetStats {
+  long long time;   // steady clock milliseconds
+  unsigned long long tcp_bytes_in;    // headers included
+  unsigned long long tcp_bytes_out;
+  unsigned long long tcp_packets_in;
+  unsigned long long tcp_packets_out;
+  unsigned long long udp_bytes_in;
+  unsigned long long udp_bytes_out;
+  unsigned long long udp_datagrams_in;
+  unsigned long long udp_datagrams_out;
+  unsigned long long tcp_accepted;
+  unsigned long long tcp_connected;
+  unsigned long long tcp_connect_failed;  // timed out connects included
+  unsigned long long tcp_disconnected;    // closed by the peer
+  unsigned long long tcp_idle_timeouts;
+  unsigned long long tcp_send_timeouts;
+  unsigned long long tcp_heartbeat_timeouts;
+  unsigned long long tcp_broadcast_skipped;   // handles gone or failing when TcpBroadcast reached them
+  unsigned long long tcp_error[kNetErrorCodeCount];
+  unsigned long long udp_error[kNetErrorCodeCount];
+  unsigned long long tcp_sends_outstanding;   // send buffers queued or being written, control frames included
+  unsigned long long udp_sends_outstanding;
+  NetPoolStats pool[kNetPoolCount];
+  // both empty unless NetOptions::callback_timing is set
+  NetLatencyStats callback_time;        // time spent inside the callbacks
+  NetLatencyStats completion_latency;   // from the io completion to the start of its callback
+};
+
+// the counters of one connection
+struct NetTcpStats {
+  unsigned long long bytes_in;
+  unsigned long long bytes_out;
+  unsigned long long packets_in;
+  unsigned long long packets_out;
+  unsigned long long unsent_bytes;
+};
+
+// client connections to one ip:port kept open by the library. a lost or failed connection is made
+// again after a backoff doubling from min_backoff up to max_backoff, reset once it connects.
+// a zero backoff keeps its default
+struct TcpPoolOptions {
+  int connection_count;   // connections kept open
+  int connect_timeout;    // milliseconds, 0 leaves it to the system
+  int min_backoff;        // milliseconds, 100 by default
+  int max_backoff;        // milliseconds, 30 seconds by default
+  int max_queued_packet;  // packets held while no connection is up, sends beyond fail
+};
+
+// a part of a TcpSendv packet. release is called with data when the library is done with it,
+// an empty one suits memory that outlives every send, static data say
+struct NetBuffer {
+  const char* data;
+  int size;
+  std::function<void (const char*)> release;
+};
+
+const int kMaxTcpSendvBuffers = 64;
+
+// a received packet, only valid during the callback it is passed to
+struct PacketView {
+  const char* packet;
+  int size;
+};
+
+// a udp peer without strings, cheap to copy, compare and hash. address holds the ipv4 bytes
+// in network order, port is in host order. UdpMakeEndpoint fills one from an ip string
+struct UdpEndpoint {
+  unsigned char address[4];
+  unsigned short port;
+
+  unsigned long long key() const {
+    return (static_cast<unsigned long long>(address[0]) << 40) | (static_cast<unsigned long long>(address[1]) << 32) |
+      (static_cast<unsigned long long>(address[2]) << 24) | (static_cast<unsigned long long>(address[3]) << 16) | port;
+  }
+};
+
+inline bool operator==(const UdpEndpoint& left, const UdpEndpoint& right) { return left.key() == right.key(); }
+inline bool operator!=(const UdpEndpoint& left, const UdpEndpoint& right) { return left.key() != right.key(); }
+inline bool operator<(const UdpEndpoint& left, const UdpEndpoint& right) { return left.key() < right.key(); }
+
+// a received datagram and its sender, only valid during the callback it is passed to
+struct UdpDatagramView {
+  const char* packet;
+  int size;
+  UdpEndpoint from;
+};
+
 class NetInterface {
  public:
   virtual bool OnTcpDisconnected(TcpHandle handle) = 0;
   virtual bool OnTcpAccepted(TcpHandle handle, TcpHandle accept_handle) = 0;
+  // result of TcpConnect, 0 once connected. on an error the handle is already released
+  virtual bool OnTcpConnected(TcpHandle /*handle*/, int /*error*/) { return true; }
   virtual bool OnTcpReceived(TcpHandle handle, const char* packet, int size) = 0;
+  // every packet decoded from one receive completion, override to handle them in one go
+  virtual bool OnTcpReceivedBatch(TcpHandle handle, const PacketView* packets, int count) {
+    for (auto i = 0; i < count; ++i) {
+      OnTcpReceived(handle, packets[i].packet, packets[i].size);
+    }
+    return true;
+  }
+  // a piece of a packet above TcpOptions::chunk_threshold, in order and interleaved with the whole
+  // packets around it. msg_id counts the chunked packets of a connection from 1. a connection
+  // failing, on a checksum mismatch say, ends a packet without its is_last chunk
+  virtual bool OnTcpReceivedChunk(TcpHandle /*handle*/, unsigned long long /*msg_id*/, int /*offset*/, const char* /*data*/, int /*size*/,
+    bool /*is_last*/) { return true; }
   virtual bool OnTcpError(TcpHandle handle, int error) = 0;
   virtual bool OnUdpReceived(UdpHandle handle, const char* packet, int size, const std::string& ip, int port) = 0;
+  // what the library calls for a received datagram, the default formats the sender for OnUdpReceived.
+  // override it to skip the formatting, UdpSendTo takes the endpoint back for a reply
+  virtual bool OnUdpReceivedFrom(UdpHandle handle, const char* packet, int size, const UdpEndpoint& from);
+  // every datagram of one batched receive, override to handle them in one go
+  virtual bool OnUdpReceivedBatch(UdpHandle handle, const UdpDatagramView* datagrams, int count) {
+    for (auto i = 0; i < count; ++i) {
+      OnUdpReceivedFrom(handle, datagrams[i].packet, datagrams[i].size, datagrams[i].from);
+    }
+    return true;
+  }
   virtual bool OnUdpError(UdpHandle handle, int error) = 0;
+  // the send level of a connection dropped below its low watermark after TcpTrySend would block
+  virtual bool OnTcpWritable(TcpHandle /*handle*/) { return true; }
+  // a timer of NetScheduleTimer is due, runs on an io thread
+  virtual bool OnTimer(NetTimerHandle /*handle*/) { return true; }
 };
 
-#ifdef NET_EXPORTS
+#ifndef _WIN32
+#define NET_API __attribute__((visibility("default")))
+#elif defined(NET_EXPORTS)
 #define NET_API _declspec(dllexport)
 #else 
 #define NET_API _declspec(dllimport)
 #endif // NET_EXPORTS
 
 NET_API bool StartupNet();
+NET_API bool StartupNet(const NetOptions& options);
 NET_API bool CleanupNet();
 NET_API bool TcpCreate(NetInterface* callback, const std::string& ip, int port, TcpHandle& new_handle);
 NET_API bool TcpDestroy(TcpHandle handle);
 NET_API bool TcpListen(TcpHandle handle);
+// returns once the connect is under way, OnTcpConnected reports how it ends. packets sent
+// meanwhile go out once connected. timeout is in milliseconds, 0 leaves it to the system
 NET_API bool TcpConnect(TcpHandle handle, const std::string& ip, int port);
+NET_API bool TcpConnect(TcpHandle handle, const std::string& ip, int port, int timeout);
 NET_API bool TcpSend(TcpHandle handle, std::unique_ptr<char[]> packet, int size);
+// the buffers go out back to back as one packet under a single header, in one gather write.
+// each release runs once the write is done, or right away when the send fails
+NET_API bool TcpSendv(TcpHandle handle, const NetBuffer* buffers, int count);
+// an empty SharedPacket when the size is invalid
+NET_API SharedPacket MakeSharedPacket(std::unique_ptr<char[]> packet, int size);
+// queues one packet on every handle without copying it, returns the number of handles it was
+// queued on. a handle that is gone or fails is skipped and counted in tcp_broadcast_skipped,
+// the others still get it
+NET_API int TcpBroadcast(const TcpHandle* handles, int count, const SharedPacket& packet);
+// TcpSend honouring the send watermarks, TcpSend itself always queues. the packet is left
+// to the caller only on kTcpSendWouldBlock, OnTcpWritable follows once the level is low again
+NET_API int TcpTrySend(TcpHandle handle, std::unique_ptr<char[]>& packet, int size);
 NET_API bool TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port);
 NET_API bool TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port);
+NET_API bool TcpSetOptions(TcpHandle handle, const TcpOptions& options);
+NET_API bool TcpGetOptions(TcpHandle handle, TcpOptions& options);
+// one pool per ip:port. the callback sees every pool connection by its own tcp handle,
+// received packets included, which may be answered with TcpSend
+NET_API bool TcpPoolCreate(NetInterface* callback, const std::string& ip, int port, const TcpPoolOptions& options, TcpPoolHandle& new_handle);
+NET_API bool TcpPoolDestroy(TcpPoolHandle handle);
+// goes out on the connection with the fewest bytes waiting to be written
+NET_API bool TcpPoolSend(TcpPoolHandle handle, std::unique_ptr<char[]> packet, int size);
 NET_API bool UdpCreate(NetInterface* callback, const std::string& ip, int port, UdpHandle& new_handle);
 NET_API bool UdpDestroy(UdpHandle handle);
 NET_API bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const std::string& ip, int port);
+NET_API bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]> packet, int size, const UdpEndpoint& to);
+// false on an ip that is not a dotted ipv4 address or a port out of range
+NET_API bool UdpMakeEndpoint(const std::string& ip, int port, UdpEndpoint& endpoint);
+NET_API void UdpEndpointToAddr(const UdpEndpoint& endpoint, char ip[16], int& port);
+// a peer resolved once, host may be a name or an ipv4 address. the handle is not tied to a
+// udp handle, UdpSendToPeer then copies the kept address and parses nothing
+NET_API bool UdpResolvePeer(const std::string& host, int port, UdpPeerHandle& new_handle);
+NET_API bool UdpReleasePeer(UdpPeerHandle handle);
+NET_API bool UdpSendToPeer(UdpHandle handle, std::unique_ptr<char[]> packet, int size, UdpPeerHandle peer);
+// fixes the peer of a udp handle: UdpSend needs no address and the kernel skips the route
+// lookup, datagrams from any other peer are dropped. UdpSendTo still reaches other peers
+NET_API bool UdpConnect(UdpHandle handle, const std::string& ip, int port);
+NET_API bool UdpSend(UdpHandle handle, std::unique_ptr<char[]> packet, int size);
+// callback->OnTimer(handle) after delay milliseconds, then every period milliseconds unless period is 0.
+// timers are kept by the io threads, a timer set on one of them fires on the same thread
+NET_API bool NetScheduleTimer(NetInterface* callback, int delay, int period, NetTimerHandle& new_handle);
+// false when the timer already fired for the last time or was cancelled
+NET_API bool NetCancelTimer(NetTimerHandle handle);
+NET_API bool NetSetSendOptions(const NetSendOptions& options);
+NET_API bool NetSetPoolOptions(int pool, const NetPoolOptions& options);
+NET_API bool NetGetPoolStats(int pool, NetPoolStats& stats);
+NET_API bool NetGetStats(NetStats& stats);
+NET_API bool TcpGetStats(TcpHandle handle, NetTcpStats& stats);
+// the snapshot in the prometheus text format, one net_ prefixed sample per line
+NET_API std::string NetFormatStats(const NetStats& stats);
+// writes the last completions of every io thread to path: type, handle, bytes, tsc and handling
+// time. tools/flight_decode.cpp prints the file
+NET_API bool NetDumpFlightRecorder(const std::string& path);
+// posix only: each time the process gets signal, SIGUSR2 say, the rings are dumped to path.1,
+// path.2 and so on from a thread of the library. 0 gives the signal its default action back
+NET_API bool NetSetFlightRecorderSignal(int signal, const std::string& path);
+
+inline bool NetInterface::OnUdpReceivedFrom(UdpHandle handle, const char* packet, int size, const UdpEndpoint& from) {
+  char ip[16];
+  int port = 0;
+  UdpEndpointToAddr(from, ip, port);
+  return OnUdpReceived(handle, packet, size, ip, port);
+}
 
 } // namespace net
 
+namespace std {
+
+template <>
+struct hash<net::UdpEndpoint> {
+  size_t operator()(const net::UdpEndpoint& endpoint) const {
+    return hash<unsigned long long>()(endpoint.key());
+  }
+};
+
+} // namespace std
+
 #endif	// NET_INTERFACE_H_
\ No newline at end of file
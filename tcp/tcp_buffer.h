@@ -2,14 +2,41 @@
 #define NET_TCP_BUFFER_H_
 
 #include "base_buffer.h"
+#include "buffer_pool.h"
+#include "crc32c.h"
+#include "net.h"
 #include "tcp_header.h"
+#include <algorithm>
 #include <functional>
+#include <mutex>
 
 namespace net {
 
 const int kTcpAcceptBuffSize = 64;
+// default receive ring size, NetOptions::tcp_buffer_size overrides it
 const int kTcpBufferSize = 64 * 1024;
 
+// the payload of a SharedPacket and its header, encoded once for all the sends sharing it.
+// the checksummed header is only worked out when a connection sending with checksums needs it
+struct SharedPacketData {
+  std::unique_ptr<char[]> packet;
+  int size;
+  TcpHeader header;
+  mutable TcpHeader checksum_header;
+  mutable std::once_flag checksum_once;
+
+  SharedPacketData(std::unique_ptr<char[]> packet, int size) : packet(std::move(packet)), size(size) {
+    header.Init(size);
+  }
+  const TcpHeader* Header(bool checksum) const {
+    if (!checksum) {
+      return &header;
+    }
+    std::call_once(checksum_once, [this]() { checksum_header.Init(size, Crc32c(packet.get(), size)); });
+    return &checksum_header;
+  }
+};
+
 class TcpSendBuffer : public BaseBuffer {
  public:
   TcpSendBuffer() {
@@ -17,6 +44,10 @@ class TcpSendBuffer : public BaseBuffer {
     set_async_type(kAsyncTypeTcpSend);
     buffer_ = nullptr;
     deleter_ = nullptr;
+    next_ = nullptr;
+    part_count_ = 1;
+    frame_size_ = 0;
+    shared_header_ = nullptr;
   }
   ~TcpSendBuffer() {
     if (buffer_ != nullptr) {
@@ -33,31 +64,119 @@ class TcpSendBuffer : public BaseBuffer {
     deleter_ = deleter;
     header_.Init(size);
     set_buffer_size(size);
+    frame_size_ = size;
+    return true;
+  }
+  // the first of part_count parts of a TcpSendv frame, its header covers frame_size bytes.
+  // the parts of a frame are linked through next, an empty deleter leaves the memory alone
+  bool InitFrame(const char* buffer, int size, std::function<void (char*)> deleter, int part_count, int frame_size) {
+    if (!InitPart(buffer, size, deleter)) {
+      return false;
+    }
+    part_count_ = part_count;
+    frame_size_ = frame_size;
+    header_.Init(frame_size);
     return true;
   }
-  const TcpHeader* header() { return &header_; }
+  // a later part of a frame, it goes out right behind the one before without a header
+  bool InitPart(const char* buffer, int size, std::function<void (char*)> deleter) {
+    if (buffer == nullptr || size <= 0) {
+      return false;
+    }
+    buffer_ = const_cast<char*>(buffer);
+    deleter_ = deleter;
+    part_count_ = 0;
+    set_buffer_size(size);
+    return true;
+  }
+  // a SharedPacket, the buffer keeps a reference to it until it is returned to the pool
+  void InitShared(const SharedPacket& shared, bool checksum) {
+    shared_ = shared;
+    buffer_ = shared->packet.get();
+    shared_header_ = shared->Header(checksum);
+    set_buffer_size(shared->size);
+    frame_size_ = shared->size;
+  }
+  // a heartbeat frame, only the header goes out
+  void InitControl(uint32_t packet_flag, uint32_t sequence) {
+    header_.InitControl(packet_flag, sequence);
+    set_buffer_size(0);
+  }
+  void SetChecksum(uint32_t checksum) { header_.Init(frame_size_, checksum); }
+  const TcpHeader* header() { return shared_header_ != nullptr ? shared_header_ : &header_; }
   const char* buffer() { return buffer_; }
+  // the parts of the frame this buffer starts, 0 for a later part
+  int part_count() { return part_count_; }
+  // the bytes it puts on the wire, a later part has no header
+  int wire_size() { return (part_count_ > 0 ? kTcpHeaderSize : 0) + buffer_size(); }
+  // links packets waiting in a socket send queue, and the packets of one gather write
+  TcpSendBuffer* next() { return next_; }
+  void set_next(TcpSendBuffer* value) { next_ = value; }
 
  private:
   TcpHeader header_;
   char* buffer_;
   std::function<void (char*)> deleter_;
+  TcpSendBuffer* next_;
+  int part_count_;
+  int frame_size_;
+  SharedPacket shared_;
+  const TcpHeader* shared_header_;
 };
 
+// receive ring of one connection: WSARecv fills the free part, the decoder consumes
+// from the read position. positions only grow, the buffer index is position & mask.
+// the ring itself is the pool tail behind the object, its size a power of two
 class TcpRecvBuffer : public BaseBuffer {
 public:
   TcpRecvBuffer() {
+    buffer_ = BufferPool<TcpRecvBuffer>::tail(this);
+    mask_ = BufferPool<TcpRecvBuffer>::Instance()->tail_size() - 1;
     ResetBuffer();
   }
   void ResetBuffer() {
     BaseBuffer::ResetBuffer();
     set_async_type(kAsyncTypeTcpRecv);
-    set_buffer_size(sizeof(buffer_));
+    set_buffer_size(capacity());
+    read_ = 0;
+    write_ = 0;
   }
   char* buffer() { return buffer_; }
+  int capacity() { return static_cast<int>(mask_ + 1); }
+  int data_size() { return static_cast<int>(write_ - read_); }
+  int free_size() { return capacity() - data_size(); }
+  char* read_pos() { return &buffer_[read_ & mask_]; }
+  char* write_pos() { return &buffer_[write_ & mask_]; }
+  // contiguous bytes from the read or write position up to the end of the buffer
+  int read_contiguous() { return capacity() - static_cast<int>(read_ & mask_); }
+  int write_contiguous() { return capacity() - static_cast<int>(write_ & mask_); }
+  void Produce(int size) { write_ += size; }
+  void Consume(int size) {
+    read_ += size;
+    // an empty ring starts over, the next receive gets the whole buffer in one piece
+    if (read_ == write_) {
+      read_ = 0;
+      write_ = 0;
+    }
+  }
+  void Peek(char* dest, int size) {
+    auto first = std::min(size, read_contiguous());
+    memcpy(dest, read_pos(), first);
+    memcpy(dest + first, buffer_, size - first);
+  }
 
 private:
-  char buffer_[kTcpBufferSize];
+  char* buffer_;
+  unsigned int mask_;
+  unsigned int read_;
+  unsigned int write_;
+};
+
+// a packet wrapping around the end of the receive ring is copied into one of these,
+// its pool tail is as large as the ring
+class TcpStitchBuffer : public utility::Uncopyable {
+public:
+  char* buffer() { return BufferPool<TcpStitchBuffer>::tail(this); }
 };
 
 class TcpAcceptBuffer : public BaseBuffer {
@@ -80,6 +199,23 @@ private:
   void* accept_socket_;
 };
 
+// posted to the loop owning a connection, which then starts the next write of its send queue
+class TcpFlushBuffer : public BaseBuffer {
+public:
+  TcpFlushBuffer() {
+    BaseBuffer::ResetBuffer();
+    set_async_type(kAsyncTypeTcpFlush);
+  }
+};
+
+class TcpConnectBuffer : public BaseBuffer {
+public:
+  TcpConnectBuffer() {
+    BaseBuffer::ResetBuffer();
+    set_async_type(kAsyncTypeTcpConnect);
+  }
+};
+
 } // namespace net
 
 #endif	// NET_TCP_BUFFER_H_
\ No newline at end of file
@@ -1,12 +1,17 @@
 #ifndef NET_TCP_HEADER_H_
 #define NET_TCP_HEADER_H_
 
-#include <WinSock2.h>
+#include "platform.h"
+#include <stdint.h>
 
 namespace net {
 
-const unsigned long kTcpPacketFlag = 0xfdfdfdfd;
-const unsigned long kMaxTcpSendPacketSize = 16 * 1024 * 1024;
+const uint32_t kTcpPacketFlag = 0xfdfdfdfd;
+// same header, checksum_ holds the crc32c of the packet
+const uint32_t kTcpChecksumPacketFlag = 0xfdfdfdfe;
+// heartbeat control frames: a header without packet, checksum_ holds the ping sequence the pong echoes
+const uint32_t kTcpPingPacketFlag = 0xfdfdfdfc;
+const uint32_t kTcpPongPacketFlag = 0xfdfdfdfb;
 
 class TcpHeader {
  public:
@@ -15,12 +20,25 @@ class TcpHeader {
     packet_size_ = 0;
     checksum_ = 0;
   }
-  void Init(unsigned long packet_size) {
+  void Init(uint32_t packet_size) {
     packet_size_ = packet_size;
     packet_flag_ = ::htonl(packet_flag_);
     packet_size_ = ::htonl(packet_size_);
     checksum_ = ::htonl(checksum_);
   }
+  void Init(uint32_t packet_size, uint32_t checksum) {
+    packet_flag_ = kTcpChecksumPacketFlag;
+    packet_size_ = packet_size;
+    checksum_ = checksum;
+    packet_flag_ = ::htonl(packet_flag_);
+    packet_size_ = ::htonl(packet_size_);
+    checksum_ = ::htonl(checksum_);
+  }
+  void InitControl(uint32_t packet_flag, uint32_t sequence) {
+    packet_flag_ = ::htonl(packet_flag);
+    packet_size_ = 0;
+    checksum_ = ::htonl(sequence);
+  }
   bool Init(const char* data, int size) {
     if (data == nullptr || size != sizeof(*this)) {
       return false;
@@ -29,18 +47,25 @@ class TcpHeader {
     packet_flag_ = ::ntohl(packet_flag_);
     packet_size_ = ::ntohl(packet_size_);
     checksum_ = ::ntohl(checksum_);
-    if (packet_flag_ != kTcpPacketFlag || packet_size_ > kMaxTcpSendPacketSize) {
+    if (packet_flag_ != kTcpPacketFlag && packet_flag_ != kTcpChecksumPacketFlag && !is_control()) {
       return false;
     }
     return true;
   }
-  unsigned long packet_size() { return packet_size_; }
+  uint32_t packet_size() { return packet_size_; }
+  bool has_checksum() { return packet_flag_ == kTcpChecksumPacketFlag; }
+  uint32_t checksum() { return checksum_; }
+  bool is_control() { return packet_flag_ == kTcpPingPacketFlag || packet_flag_ == kTcpPongPacketFlag; }
+  bool is_ping() { return packet_flag_ == kTcpPingPacketFlag; }
+  uint32_t sequence() { return checksum_; }
 
  private:
-  unsigned long packet_flag_;
-  unsigned long packet_size_;
-  unsigned long checksum_;
+  uint32_t packet_flag_;
+  uint32_t packet_size_;
+  uint32_t checksum_;
 };
+// the wire format, the same on every platform
+static_assert(sizeof(TcpHeader) == 12, "TcpHeader must be 12 bytes");
 const int kTcpHeaderSize = sizeof(TcpHeader);
 
 } // namespace net
@@ -0,0 +1,249 @@
+#include "tcp_pool.h"
+#include "res_manager.h"
+#include "log.h"
+
+namespace net {
+
+namespace {
+
+const int kDefaultMinBackoff = 100;
+const int kDefaultMaxBackoff = 30 * 1000;
+
+// no wait before the first attempt after a lost connection, then min_backoff doubled per failure
+int BackoffDelay(const TcpPoolOptions& options, int attempt) {
+  if (attempt == 0) {
+    return 0;
+  }
+  auto delay = static_cast<long long>(options.min_backoff) << (attempt - 1 < 30 ? attempt - 1 : 30);
+  return delay < options.max_backoff ? static_cast<int>(delay) : options.max_backoff;
+}
+
+} // namespace
+
+TcpPool::TcpPool(ResManager* manager, NetInterface* callback, const std::string& ip, int port, const TcpPoolOptions& options)
+  : manager_(manager), handle_(kInvalidTcpPoolHandle), callback_(callback), ip_(ip), port_(port), key_(ip + ":" + std::to_string(port)), options_(options), closed_(false), next_(0) {
+  if (options_.min_backoff == 0) {
+    options_.min_backoff = kDefaultMinBackoff;
+  }
+  if (options_.max_backoff == 0) {
+    options_.max_backoff = kDefaultMaxBackoff;
+  }
+  Connection connection = {kInvalidTcpHandle, kTcpPoolConnectionIdle, 0};
+  connection_.assign(options_.connection_count, connection);
+}
+
+TcpPool::~TcpPool() {
+  Stop();
+}
+
+void TcpPool::Start() {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (auto i = 0; i < static_cast<int>(connection_.size()); ++i) {
+    Connect(i);
+  }
+}
+
+void TcpPool::Stop() {
+  std::vector<TcpHandle> all_handle;
+  std::deque<std::pair<std::unique_ptr<char[]>, int>> dropped;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    closed_ = true;
+    for (auto& connection : connection_) {
+      if (connection.handle != kInvalidTcpHandle) {
+        all_handle.push_back(connection.handle);
+      }
+      connection.handle = kInvalidTcpHandle;
+      connection.state = kTcpPoolConnectionIdle;
+    }
+    dropped.swap(queued_);
+  }
+  for (auto handle : all_handle) {
+    manager_->TcpDestroy(handle);
+  }
+}
+
+// queued packets stay in order: they are handed to the first connection up before it is
+// marked up, and a packet only queues while no connection is
+bool TcpPool::Send(std::unique_ptr<char[]> packet, int size) {
+  TcpHandle handle = kInvalidTcpHandle;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (closed_) {
+      return false;
+    }
+    handle = LeastLoaded();
+    if (handle == kInvalidTcpHandle) {
+      if (static_cast<int>(queued_.size()) >= options_.max_queued_packet) {
+        LOG(kError, "send tcp pool %s packet failed: no connection and the queue is full.", key_.c_str());
+        return false;
+      }
+      queued_.push_back(std::make_pair(std::move(packet), size));
+      return true;
+    }
+  }
+  if (manager_->TcpSend(handle, std::move(packet), size)) {
+    return true;
+  }
+  // a connection destroyed by hand reports nothing, the failed send is the only sign of it
+  if (manager_->TcpQueuedBytes(handle) < 0) {
+    OnConnectionLost(handle);
+  }
+  return false;
+}
+
+bool TcpPool::OnTcpDisconnected(TcpHandle handle) {
+  OnConnectionLost(handle);
+  return callback_->OnTcpDisconnected(handle);
+}
+
+bool TcpPool::OnTcpAccepted(TcpHandle handle, TcpHandle accept_handle) {
+  return callback_->OnTcpAccepted(handle, accept_handle);
+}
+
+bool TcpPool::OnTcpConnected(TcpHandle handle, int error) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto index = FindConnection(handle);
+    if (index >= 0) {
+      auto& connection = connection_[index];
+      if (error != 0) {
+        ++connection.attempt;
+        ScheduleConnect(index);
+      } else {
+        connection.attempt = 0;
+        FlushQueue(handle);
+        connection.state = kTcpPoolConnectionUp;
+      }
+    }
+  }
+  return callback_->OnTcpConnected(handle, error);
+}
+
+bool TcpPool::OnTcpReceived(TcpHandle handle, const char* packet, int size) {
+  return callback_->OnTcpReceived(handle, packet, size);
+}
+
+bool TcpPool::OnTcpReceivedBatch(TcpHandle handle, const PacketView* packets, int count) {
+  return callback_->OnTcpReceivedBatch(handle, packets, count);
+}
+
+bool TcpPool::OnTcpReceivedChunk(TcpHandle handle, unsigned long long msg_id, int offset, const char* data, int size, bool is_last) {
+  return callback_->OnTcpReceivedChunk(handle, msg_id, offset, data, size, is_last);
+}
+
+bool TcpPool::OnTcpError(TcpHandle handle, int error) {
+  OnConnectionLost(handle);
+  return callback_->OnTcpError(handle, error);
+}
+
+bool TcpPool::OnTcpWritable(TcpHandle handle) {
+  return callback_->OnTcpWritable(handle);
+}
+
+bool TcpPool::OnUdpReceived(UdpHandle handle, const char* packet, int size, const std::string& ip, int port) {
+  return callback_->OnUdpReceived(handle, packet, size, ip, port);
+}
+
+bool TcpPool::OnUdpReceivedFrom(UdpHandle handle, const char* packet, int size, const UdpEndpoint& from) {
+  return callback_->OnUdpReceivedFrom(handle, packet, size, from);
+}
+
+bool TcpPool::OnUdpReceivedBatch(UdpHandle handle, const UdpDatagramView* datagrams, int count) {
+  return callback_->OnUdpReceivedBatch(handle, datagrams, count);
+}
+
+bool TcpPool::OnUdpError(UdpHandle handle, int error) {
+  return callback_->OnUdpError(handle, error);
+}
+
+void TcpPool::OnConnectTimer(int index) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (closed_ || connection_[index].state != kTcpPoolConnectionIdle) {
+    return;
+  }
+  Connect(index);
+}
+
+// the library releases the handle once the callback reporting the loss returns
+void TcpPool::OnConnectionLost(TcpHandle handle) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto index = FindConnection(handle);
+  if (index < 0) {
+    return;
+  }
+  connection_[index].attempt = 0;
+  ScheduleConnect(index);
+}
+
+void TcpPool::Connect(int index) {
+  auto& connection = connection_[index];
+  TcpHandle handle = kInvalidTcpHandle;
+  if (!manager_->TcpCreate(this, "0.0.0.0", 0, handle)) {
+    ++connection.attempt;
+    ScheduleConnect(index);
+    return;
+  }
+  // recorded first, the result may be reported on an io thread before TcpConnect returns
+  connection.handle = handle;
+  connection.state = kTcpPoolConnectionPending;
+  if (!manager_->TcpConnect(handle, ip_, port_, options_.connect_timeout)) {
+    manager_->TcpDestroy(handle);
+    ++connection.attempt;
+    ScheduleConnect(index);
+  }
+}
+
+void TcpPool::ScheduleConnect(int index) {
+  auto& connection = connection_[index];
+  connection.handle = kInvalidTcpHandle;
+  connection.state = kTcpPoolConnectionIdle;
+  if (closed_) {
+    return;
+  }
+  auto delay = BackoffDelay(options_, connection.attempt);
+  if (!manager_->SchedulePoolTimer(handle_, index, delay)) {
+    LOG(kError, "tcp pool %s reconnect failed: can not schedule it.", key_.c_str());
+  }
+}
+
+int TcpPool::FindConnection(TcpHandle handle) {
+  for (auto i = 0; i < static_cast<int>(connection_.size()); ++i) {
+    if (connection_[i].handle == handle) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// the scan starts one connection further every time, so equally loaded ones take turns
+TcpHandle TcpPool::LeastLoaded() {
+  TcpHandle best_handle = kInvalidTcpHandle;
+  long long best_bytes = 0;
+  auto count = static_cast<unsigned int>(connection_.size());
+  for (unsigned int i = 0; i < count; ++i) {
+    const auto& connection = connection_[(next_ + i) % count];
+    if (connection.state != kTcpPoolConnectionUp) {
+      continue;
+    }
+    auto bytes = manager_->TcpQueuedBytes(connection.handle);
+    if (bytes >= 0 && (best_handle == kInvalidTcpHandle || bytes < best_bytes)) {
+      best_handle = connection.handle;
+      best_bytes = bytes;
+    }
+  }
+  ++next_;
+  return best_handle;
+}
+
+void TcpPool::FlushQueue(TcpHandle handle) {
+  while (!queued_.empty()) {
+    auto& queued = queued_.front();
+    if (!manager_->TcpSend(handle, std::move(queued.first), queued.second)) {
+      LOG(kError, "tcp pool %s dropped a queued packet.", key_.c_str());
+    }
+    queued_.pop_front();
+  }
+}
+
+} // namespace net
@@ -0,0 +1,82 @@
+#ifndef NET_TCP_POOL_H_
+#define NET_TCP_POOL_H_
+
+#include "net.h"
+#include "uncopyable.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace net {
+
+class ResManager;
+
+const int kTcpPoolConnectionIdle = 0;
+const int kTcpPoolConnectionPending = 1;
+const int kTcpPoolConnectionUp = 2;
+
+// the client connections behind a pool handle. the pool is the callback of its connections:
+// it tracks them, then hands every event on to the user callback outside its lock
+class TcpPool : public NetInterface, public utility::Uncopyable {
+ public:
+  TcpPool(ResManager* manager, NetInterface* callback, const std::string& ip, int port, const TcpPoolOptions& options);
+  ~TcpPool();
+
+  void Start();
+  // connections are closed and queued packets dropped, callbacks already running may still reach the pool
+  void Stop();
+  bool Send(std::unique_ptr<char[]> packet, int size);
+  const std::string& key() { return key_; }
+  void set_handle(TcpPoolHandle handle) { handle_ = handle; }
+  // the reconnect timer of a connection is due
+  void OnConnectTimer(int index);
+
+  bool OnTcpDisconnected(TcpHandle handle) override;
+  bool OnTcpAccepted(TcpHandle handle, TcpHandle accept_handle) override;
+  bool OnTcpConnected(TcpHandle handle, int error) override;
+  bool OnTcpReceived(TcpHandle handle, const char* packet, int size) override;
+  bool OnTcpReceivedBatch(TcpHandle handle, const PacketView* packets, int count) override;
+  bool OnTcpReceivedChunk(TcpHandle handle, unsigned long long msg_id, int offset, const char* data, int size, bool is_last) override;
+  bool OnTcpError(TcpHandle handle, int error) override;
+  bool OnTcpWritable(TcpHandle handle) override;
+  bool OnUdpReceived(UdpHandle handle, const char* packet, int size, const std::string& ip, int port) override;
+  bool OnUdpReceivedFrom(UdpHandle handle, const char* packet, int size, const UdpEndpoint& from) override;
+  bool OnUdpReceivedBatch(UdpHandle handle, const UdpDatagramView* datagrams, int count) override;
+  bool OnUdpError(UdpHandle handle, int error) override;
+
+ private:
+  struct Connection {
+    TcpHandle handle;
+    int state;
+    int attempt;    // failed connects in a row, picks the backoff
+  };
+
+  void OnConnectionLost(TcpHandle handle);
+  // the members below run with lock_ held
+  void Connect(int index);
+  void ScheduleConnect(int index);
+  int FindConnection(TcpHandle handle);
+  TcpHandle LeastLoaded();
+  void FlushQueue(TcpHandle handle);
+
+ private:
+  ResManager* manager_;
+  TcpPoolHandle handle_;
+  NetInterface* callback_;
+  std::string ip_;
+  int port_;
+  std::string key_;
+  TcpPoolOptions options_;
+  std::mutex lock_;
+  bool closed_;
+  unsigned int next_;
+  std::vector<Connection> connection_;
+  std::deque<std::pair<std::unique_ptr<char[]>, int>> queued_;
+};
+
+} // namespace net
+
+#endif	// NET_TCP_POOL_H_
@@ -1,13 +1,55 @@
 #include "tcp_socket.h"
+#include "buffer_pool.h"
+#include "crc32c.h"
+#include "tcp_buffer.h"
 #include "tcp_header.h"
+#include "timer_wheel.h"
 #include "log.h"
 #include "utility_net.h"
+#ifdef _WIN32
 #include <MSWSock.h>
 #pragma comment(lib, "Mswsock.lib")
+#endif // _WIN32
 
 namespace net {
 
-TcpSocket::TcpSocket() {
+#ifdef _WIN32
+// ConnectEx is an extension function, its pointer is looked up once through the first socket connecting
+namespace {
+
+LPFN_CONNECTEX LoadConnectEx(SOCKET socket) {
+  LPFN_CONNECTEX connect_ex = NULL;
+  GUID guid = WSAID_CONNECTEX;
+  DWORD bytes = 0;
+  if (::WSAIoctl(socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &connect_ex, sizeof(connect_ex), &bytes, NULL, NULL) != 0) {
+    LOG(kError, "load ConnectEx failed, error code: %d.", ::WSAGetLastError());
+    return NULL;
+  }
+  return connect_ex;
+}
+
+BOOL ConnectEx(SOCKET socket, const SOCKADDR* name, int name_size, PVOID send_buffer, DWORD send_size, LPDWORD sent, LPOVERLAPPED ovlp) {
+  static LPFN_CONNECTEX connect_ex = LoadConnectEx(socket);
+  if (connect_ex == NULL) {
+    ::WSASetLastError(WSAEOPNOTSUPP);
+    return FALSE;
+  }
+  return connect_ex(socket, name, name_size, send_buffer, send_size, sent, ovlp);
+}
+
+} // namespace
+#endif // _WIN32
+
+TcpSocket::TcpSocket() : loop_(0), connect_state_(kTcpConnectIdle), max_packet_size_(kMaxTcpPacketSize), stitch_(nullptr), chunk_threshold_(0), send_stack_(nullptr), send_head_(nullptr), send_tail_(nullptr), sending_(false), queued_bytes_(0),
+  unsent_bytes_(0), writable_wanted_(false), recv_time_(0), send_time_(0), check_timer_(0), bytes_in_(0), bytes_out_(0), packets_in_(0), packets_out_(0), ping_time_(0), ping_sequence_(0) {
+  options_.checksum = false;
+  options_.idle_timeout = 0;
+  options_.send_timeout = 0;
+  options_.heartbeat_interval = 0;
+  options_.heartbeat_miss = 0;
+  options_.send_high_watermark = 0;
+  options_.send_low_watermark = 0;
+  options_.chunk_threshold = 0;
   ResetMember();
 }
 
@@ -21,10 +63,18 @@ void TcpSocket::ResetMember() {
   bind_ = false;
   listen_ = false;
   connect_ = false;
-  current_header_.clear();
-  current_packet_.Clear();
-  current_packet_offset_ = 0;
-  all_packets_.clear();
+  packet_size_ = -1;
+  packet_checksum_ = false;
+  checksum_ = 0;
+  large_packet_.reset();
+  large_packet_offset_ = 0;
+  chunked_ = false;
+  chunk_offset_ = 0;
+  chunk_checksum_ = 0;
+  chunk_msg_id_ = 0;
+  pong_pending_ = false;
+  pong_sequence_ = 0;
+  OnRecvDone();
 }
 
 bool TcpSocket::Create(NetInterface* callback) {
@@ -51,6 +101,29 @@ void TcpSocket::Destroy() {
     ::closesocket(socket_);
     ResetMember();
   }
+  ClearSendQueue();
+}
+
+void TcpSocket::ClearSendQueue() {
+  TakeSendStack();
+  while (send_head_ != nullptr) {
+    auto buffer = send_head_;
+    send_head_ = buffer->next();
+    BufferPool<TcpSendBuffer>::Instance()->Return(buffer);
+  }
+  send_tail_ = nullptr;
+}
+
+TcpOptions TcpSocket::options() {
+  std::lock_guard<std::mutex> lock(options_lock_);
+  return options_;
+}
+
+void TcpSocket::set_options(const TcpOptions& options) {
+  std::lock_guard<std::mutex> lock(options_lock_);
+  options_ = options;
+  // read by the parser on every header, without the lock
+  chunk_threshold_.store(options.chunk_threshold, std::memory_order_relaxed);
 }
 
 bool TcpSocket::Bind(const std::string& ip, int port) {
@@ -99,25 +172,65 @@ bool TcpSocket::Listen(int backlog) {
   return true;
 }
 
-bool TcpSocket::Connect(const std::string& ip, int port) {
+// packets sent while the handshake runs wait in the send queue: the connect holds the
+// sending flag, the completion starts the first write
+bool TcpSocket::AsyncConnect(const std::string& ip, int port, LPOVERLAPPED ovlp) {
   if (socket_ == INVALID_SOCKET || !bind_ || listen_) {
     LOG(kError, "connect tcp socket failed: not created or not bind or is listening.");
     return false;
   }
-  if (connect_) {
-    LOG(kError, "connect tcp socket failed: already connected.");
+  if (connect_ || ovlp == NULL) {
+    LOG(kError, "connect tcp socket failed: already connected or invalid parameter.");
     return false;
   }
+  auto state = kTcpConnectIdle;
+  if (!connect_state_.compare_exchange_strong(state, kTcpConnectPending)) {
+    LOG(kError, "connect tcp socket failed: already connecting.");
+    return false;
+  }
+  sending_ = true;
   SOCKADDR_IN connect_addr = {0};
   utility::ToSockAddr(connect_addr, ip, port);
-  if (::connect(socket_, (SOCKADDR*)&connect_addr, sizeof(connect_addr)) != 0) {
-    LOG(kError, "connect tcp socket failed, error code: %d.", ::WSAGetLastError());
+  if (!ConnectEx(socket_, (SOCKADDR*)&connect_addr, sizeof(connect_addr), NULL, 0, NULL, ovlp)) {
+    if (::WSAGetLastError() != ERROR_IO_PENDING) {
+      LOG(kError, "ConnectEx failed, error code: %d.", ::WSAGetLastError());
+      sending_ = false;
+      connect_state_ = kTcpConnectIdle;
+      return false;
+    }
+  }
+  return true;
+}
+
+// false when the timeout already ended the connect, otherwise error tells how it went
+bool TcpSocket::OnConnect(LPOVERLAPPED ovlp, int& error) {
+  auto state = kTcpConnectPending;
+  if (!connect_state_.compare_exchange_strong(state, kTcpConnectDone)) {
     return false;
   }
+  DWORD transferred = 0;
+  DWORD flags = 0;
+  error = 0;
+  if (!::WSAGetOverlappedResult(socket_, ovlp, &transferred, FALSE, &flags)) {
+    error = ::WSAGetLastError();
+    return true;
+  }
+#ifdef _WIN32
+  if (0 != ::setsockopt(socket_, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, NULL, 0)) {
+    error = ::WSAGetLastError();
+    return true;
+  }
+#endif // _WIN32
   connect_ = true;
+  recv_time_ = send_time_ = SteadyMilliseconds();
   return true;
 }
 
+bool TcpSocket::TimeoutConnect() {
+  auto state = kTcpConnectPending;
+  return connect_state_.compare_exchange_strong(state, kTcpConnectTimeout);
+}
+
 bool TcpSocket::AsyncAccept(SOCKET accept_sock, char* buffer, int size, LPOVERLAPPED ovlp) {
   if (socket_ == INVALID_SOCKET) {
     LOG(kError, "async tcp socket accept buffer failed: not created.");
@@ -138,7 +251,7 @@ bool TcpSocket::AsyncAccept(SOCKET accept_sock, char* buffer, int size, LPOVERLA
   return true;
 }
 
-bool TcpSocket::AsyncSend(const TcpHeader* header, const char* buffer, int size, LPOVERLAPPED ovlp) {
+bool TcpSocket::AsyncSend(TcpSendBuffer* batch) {
   if (socket_ == INVALID_SOCKET) {
     LOG(kError, "async tcp socket send buffer failed: not created.");
     return false;
@@ -147,16 +260,26 @@ bool TcpSocket::AsyncSend(const TcpHeader* header, const char* buffer, int size,
     LOG(kError, "async tcp socket send buffer failed: not connected.");
     return false;
   }
-  if (buffer == nullptr || size == 0 || ovlp == NULL) {
+  if (batch == nullptr) {
     LOG(kError, "async tcp socket send buffer failed: invalid parameter.");
     return false;
   }
-  WSABUF buff[2] = {0};
-  buff[0].buf = (char*)(header);
-  buff[0].len = kTcpHeaderSize;
-  buff[1].buf = const_cast<char*>(buffer);
-  buff[1].len = size;
-  if (::WSASend(socket_, buff, 2, NULL, 0, ovlp, NULL) != 0) {
+  // the write owning send_gather_ is the only one in flight, it stays valid until the completion
+  send_gather_.clear();
+  for (auto buffer = batch; buffer != nullptr; buffer = buffer->next()) {
+    WSABUF buff[2] = {0};
+    buff[0].buf = (char*)(buffer->header());
+    buff[0].len = kTcpHeaderSize;
+    buff[1].buf = const_cast<char*>(buffer->buffer());
+    buff[1].len = buffer->buffer_size();
+    if (buffer->part_count() > 0) {
+      send_gather_.push_back(buff[0]);
+    }
+    if (buff[1].len > 0) {
+      send_gather_.push_back(buff[1]);
+    }
+  }
+  if (::WSASend(socket_, &send_gather_[0], static_cast<DWORD>(send_gather_.size()), NULL, 0, batch->ovlp(), NULL) != 0) {
     if (::WSAGetLastError() != ERROR_IO_PENDING) {
       LOG(kError, "WSASend failed, error code: %d.", ::WSAGetLastError());
       return false;
@@ -165,7 +288,8 @@ bool TcpSocket::AsyncSend(const TcpHeader* header, const char* buffer, int size,
   return true;
 }
 
-bool TcpSocket::AsyncRecv(char* buffer, int size, LPOVERLAPPED ovlp) {
+// the free part of the ring is at most two pieces: up to the end of the buffer, then from its start
+bool TcpSocket::AsyncRecv(TcpRecvBuffer* buffer) {
   if (socket_ == INVALID_SOCKET) {
     LOG(kError, "async tcp socket recv buffer failed: not created.");
     return false;
@@ -174,15 +298,22 @@ bool TcpSocket::AsyncRecv(char* buffer, int size, LPOVERLAPPED ovlp) {
     LOG(kError, "async tcp socket recv buffer failed: not connected.");
     return false;
   }
-  if (buffer == nullptr || size == 0 || ovlp == NULL) {
+  if (buffer == nullptr || buffer->free_size() == 0) {
     LOG(kError, "async tcp socket recv buffer failed: invalid parameter.");
     return false;
   }
-  WSABUF buff = {0};
-  buff.buf = buffer;
-  buff.len = size;
+  WSABUF buff[2] = {0};
+  DWORD buff_count = 1;
+  auto free_size = buffer->free_size();
+  buff[0].buf = buffer->write_pos();
+  buff[0].len = std::min(free_size, buffer->write_contiguous());
+  if (static_cast<int>(buff[0].len) < free_size) {
+    buff[1].buf = buffer->buffer();
+    buff[1].len = free_size - buff[0].len;
+    buff_count = 2;
+  }
   DWORD received_flag = 0;
-  if (::WSARecv(socket_, &buff, 1, NULL, &received_flag, ovlp, NULL) != 0) {
+  if (::WSARecv(socket_, buff, buff_count, NULL, &received_flag, buffer->ovlp(), NULL) != 0) {
     if (::WSAGetLastError() != ERROR_IO_PENDING) {
       LOG(kError, "WSARecv failed, error code: %d.", ::WSAGetLastError());
       return false;
@@ -200,18 +331,22 @@ bool TcpSocket::SetAccepted(SOCKET listen_sock) {
     LOG(kError, "set tcp socket accept context failed: invalid parameter.");
     return false;
   }
+#ifdef _WIN32
   if (0 != ::setsockopt(socket_, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, (char*)&listen_sock, sizeof(listen_sock))) {
     LOG(kError, "set tcp socket accept context failed, error code: %d.", ::WSAGetLastError());
     return false;
   }
+#endif // _WIN32
   bind_ = true;
   connect_ = true;
+  connect_state_ = kTcpConnectDone;
+  recv_time_ = send_time_ = SteadyMilliseconds();
   return true;
 }
 
 bool TcpSocket::GetLocalAddr(std::string& ip, int& port) {
   SOCKADDR_IN addr = {0};
-  int size = sizeof(addr);
+  socklen_t size = sizeof(addr);
   if (::getsockname(socket_, (SOCKADDR*)&addr, &size) != 0) {
     LOG(kError, "getsockname failed, error code: %d.", ::WSAGetLastError());
     return false;
@@ -222,7 +357,7 @@ bool TcpSocket::GetLocalAddr(std::string& ip, int& port) {
 
 bool TcpSocket::GetRemoteAddr(std::string& ip, int& port) {
   SOCKADDR_IN addr = {0};
-  int size = sizeof(addr);
+  socklen_t size = sizeof(addr);
   if (::getpeername(socket_, (SOCKADDR*)&addr, &size) != 0) {
     LOG(kError, "getsockname failed, error code: %d.", ::WSAGetLastError());
     return false;
@@ -231,99 +366,403 @@ bool TcpSocket::GetRemoteAddr(std::string& ip, int& port) {
   return true;
 }
 
-// two steps for looping parse a recv buffer: first header part then packet part
+// producers only push onto the lock free stack, the thread holding the sending flag
+// is the single consumer and moves the stack over to its private fifo.
+// the parts of a frame go on in one step, newest first like the rest of the stack
+bool TcpSocket::PushSend(TcpSendBuffer* frame) {
+  long long bytes = 0;
+  TcpSendBuffer* first = nullptr;
+  auto last = frame;
+  for (auto part = frame; part != nullptr;) {
+    auto next = part->next();
+    bytes += part->wire_size();
+    part->set_next(first);
+    first = part;
+    part = next;
+  }
+  auto top = send_stack_.load(std::memory_order_relaxed);
+  do {
+    last->set_next(top);
+  } while (!send_stack_.compare_exchange_weak(top, first, std::memory_order_release, std::memory_order_relaxed));
+  queued_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  unsent_bytes_.fetch_add(bytes, std::memory_order_seq_cst);
+  // stamped before taking the token, the send timeout must never see a new write with an old time
+  if (!sending_.load(std::memory_order_relaxed)) {
+    send_time_.store(SteadyMilliseconds(), std::memory_order_relaxed);
+  }
+  return !sending_.exchange(true, std::memory_order_acq_rel);
+}
+
+// the flag is raised before the level is looked at again: either the completion dropping
+// the level sees the flag, or the level seen here is low already and the flag is taken back
+bool TcpSocket::WouldBlock() {
+  auto options = this->options();
+  if (options.send_high_watermark <= 0 || unsent_bytes_.load(std::memory_order_seq_cst) < options.send_high_watermark) {
+    return false;
+  }
+  auto low = options.send_low_watermark > 0 ? options.send_low_watermark : options.send_high_watermark / 2;
+  writable_wanted_.store(true, std::memory_order_seq_cst);
+  if (unsent_bytes_.load(std::memory_order_seq_cst) >= low) {
+    return true;
+  }
+  return !writable_wanted_.exchange(false, std::memory_order_acq_rel);
+}
+
+void TcpSocket::CountRecv(unsigned long long bytes, unsigned long long packets) {
+  bytes_in_.store(bytes_in_.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+  packets_in_.store(packets_in_.load(std::memory_order_relaxed) + packets, std::memory_order_relaxed);
+}
+
+void TcpSocket::CountSend(unsigned long long bytes, unsigned long long packets) {
+  bytes_out_.store(bytes_out_.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+  packets_out_.store(packets_out_.load(std::memory_order_relaxed) + packets, std::memory_order_relaxed);
+}
+
+void TcpSocket::GetStats(NetTcpStats& stats) {
+  stats.bytes_in = bytes_in_.load(std::memory_order_relaxed);
+  stats.bytes_out = bytes_out_.load(std::memory_order_relaxed);
+  stats.packets_in = packets_in_.load(std::memory_order_relaxed);
+  stats.packets_out = packets_out_.load(std::memory_order_relaxed);
+  auto unsent = unsent_bytes_.load(std::memory_order_relaxed);
+  stats.unsent_bytes = unsent > 0 ? unsent : 0;
+}
+
+bool TcpSocket::OnSendDone(long long bytes) {
+  auto level = unsent_bytes_.fetch_sub(bytes, std::memory_order_seq_cst) - bytes;
+  if (!writable_wanted_.load(std::memory_order_seq_cst)) {
+    return false;
+  }
+  auto options = this->options();
+  auto low = options.send_low_watermark > 0 ? options.send_low_watermark : options.send_high_watermark / 2;
+  if (level >= low) {
+    return false;
+  }
+  return writable_wanted_.exchange(false, std::memory_order_acq_rel);
+}
+
+// the stack holds the newest packet first, reversed it keeps the send order
+void TcpSocket::TakeSendStack() {
+  auto stack = send_stack_.exchange(nullptr, std::memory_order_acquire);
+  TcpSendBuffer* head = nullptr;
+  auto tail = stack;
+  while (stack != nullptr) {
+    auto next = stack->next();
+    stack->set_next(head);
+    head = stack;
+    stack = next;
+  }
+  if (head == nullptr) {
+    return;
+  }
+  if (send_tail_ == nullptr) {
+    send_head_ = head;
+  } else {
+    send_tail_->set_next(head);
+  }
+  send_tail_ = tail;
+}
+
+// takes at least one packet, nullptr means the queue is empty and no write is in flight any more.
+// a packet pushed after the flag is dropped either starts its own write or is taken here
+TcpSendBuffer* TcpSocket::PopSendBatch(int max_packet, int max_bytes) {
+  send_time_.store(SteadyMilliseconds(), std::memory_order_relaxed);
+  TakeSendStack();
+  if (send_head_ == nullptr) {
+    sending_.store(false, std::memory_order_seq_cst);
+    if (send_stack_.load(std::memory_order_seq_cst) == nullptr || sending_.exchange(true, std::memory_order_acq_rel)) {
+      return nullptr;
+    }
+    TakeSendStack();
+  }
+  // a frame is never cut, the first one goes out whole even beyond the limits
+  auto batch = send_head_;
+  TcpSendBuffer* tail = nullptr;
+  auto part_count = 0;
+  long long bytes = 0;
+  for (auto frame = batch; frame != nullptr;) {
+    auto frame_tail = frame;
+    long long frame_bytes = frame->wire_size();
+    for (auto i = 1; i < frame->part_count(); ++i) {
+      frame_tail = frame_tail->next();
+      frame_bytes += frame_tail->wire_size();
+    }
+    if (tail != nullptr && (part_count + frame->part_count() > max_packet || bytes + frame_bytes > max_bytes)) {
+      break;
+    }
+    tail = frame_tail;
+    part_count += frame->part_count();
+    bytes += frame_bytes;
+    frame = frame_tail->next();
+  }
+  send_head_ = tail->next();
+  if (send_head_ == nullptr) {
+    send_tail_ = nullptr;
+  }
+  tail->set_next(nullptr);
+  queued_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+  return batch;
+}
+
+TcpSendBuffer* TcpSocket::AbortSend(TcpSendBuffer* batch) {
+  TakeSendStack();
+  long long queued = 0;
+  for (auto buffer = send_head_; buffer != nullptr; buffer = buffer->next()) {
+    queued += buffer->wire_size();
+  }
+  queued_bytes_.fetch_sub(queued, std::memory_order_relaxed);
+  long long unsent = queued;
+  auto last = batch;
+  for (auto buffer = batch; buffer != nullptr; buffer = buffer->next()) {
+    unsent += buffer->wire_size();
+    last = buffer;
+  }
+  unsent_bytes_.fetch_sub(unsent, std::memory_order_seq_cst);
+  auto dropped = batch;
+  if (last == nullptr) {
+    dropped = send_head_;
+  } else {
+    last->set_next(send_head_);
+  }
+  send_head_ = nullptr;
+  send_tail_ = nullptr;
+  sending_.store(false, std::memory_order_seq_cst);
+  return dropped;
+}
+
+// a connection not established yet is looked at again after the shortest timeout.
+// once the peer has been silent for a heartbeat interval it is pinged, at most once per interval,
+// heartbeat_miss intervals of silence fail the connection
+int TcpSocket::CheckTimeout(long long now, int& error, uint32_t& ping) {
+  auto options = this->options();
+  error = 0;
+  ping = 0;
+  if (options.idle_timeout <= 0 && options.send_timeout <= 0 && options.heartbeat_interval <= 0) {
+    return -1;
+  }
+  long long next = -1;
+  auto shorten = [&next](long long delay) {
+    if (next < 0 || delay < next) {
+      next = delay;
+    }
+  };
+  if (connect_state_ != kTcpConnectDone) {
+    for (auto timeout : {options.idle_timeout, options.send_timeout, options.heartbeat_interval}) {
+      if (timeout > 0) {
+        shorten(timeout);
+      }
+    }
+    return static_cast<int>(next);
+  }
+  auto silent = now - recv_time_.load(std::memory_order_relaxed);
+  if (options.idle_timeout > 0) {
+    if (silent >= options.idle_timeout) {
+      error = kTcpIdleTimedOut;
+      return -1;
+    }
+    shorten(options.idle_timeout - silent);
+  }
+  if (options.send_timeout > 0) {
+    long long remain = options.send_timeout;
+    if (sending_.load(std::memory_order_acquire)) {
+      auto stalled = now - send_time_.load(std::memory_order_relaxed);
+      if (stalled >= options.send_timeout) {
+        error = kTcpSendTimedOut;
+        return -1;
+      }
+      remain -= stalled;
+    }
+    shorten(remain);
+  }
+  if (options.heartbeat_interval > 0) {
+    auto interval = options.heartbeat_interval;
+    auto dead = static_cast<long long>(interval) * (options.heartbeat_miss > 0 ? options.heartbeat_miss : kTcpDefaultHeartbeatMiss);
+    if (silent >= dead) {
+      error = kTcpHeartbeatTimedOut;
+      return -1;
+    }
+    if (silent < interval) {
+      shorten(interval - silent);
+    } else {
+      if (now - ping_time_ >= interval) {
+        ping_time_ = now;
+        ping = ++ping_sequence_;
+        if (ping == 0) {
+          ping = ++ping_sequence_;
+        }
+      }
+      shorten(std::min(interval - (now - ping_time_), dead - silent));
+    }
+  }
+  return static_cast<int>(next);
+}
+
+// the received bytes extend the ring, then whole packets are taken out of it: header part then packet part.
 // if header flag is invalid or packet length too large, parse header part will fail
-bool TcpSocket::OnRecv(const char* data, int size) {
-  if (data == nullptr || size == 0) {
+bool TcpSocket::OnRecv(TcpRecvBuffer* buffer, int size) {
+  if (buffer == nullptr || size <= 0 || size > buffer->free_size()) {
     return false;
   }
-  auto total_parsed = 0;
-  while (total_parsed < size) {
-    auto current_parsed = 0;
-    if (!ParseTcpHeader(&data[total_parsed], size - total_parsed, current_parsed)) {
+  buffer->Produce(size);
+  recv_time_.store(SteadyMilliseconds(), std::memory_order_relaxed);
+  while (true) {
+    if (packet_size_ < 0) {
+      if (buffer->data_size() < kTcpHeaderSize) {
+        break;
+      }
+      if (!ParseTcpHeader(buffer)) {
+        return false;
+      }
+      if (packet_size_ < 0) {
+        continue;
+      }
+    }
+    auto complete = false;
+    if (!ParseTcpPacket(buffer, complete)) {
       return false;
     }
-    total_parsed += current_parsed;
-    if (total_parsed >= size) {
+    if (!complete) {
       break;
     }
-    current_parsed = ParseTcpPacket(&data[total_parsed], size - total_parsed);
-    total_parsed += current_parsed;
   }
   return true;
 }
 
-bool TcpSocket::CalcPacketSize() {
-  if (!current_header_.empty()) {
-    TcpHeader header;
-    if (!header.Init(&current_header_[0], current_header_.size())) {
+bool TcpSocket::TakePong(uint32_t& sequence) {
+  if (!pong_pending_) {
+    return false;
+  }
+  pong_pending_ = false;
+  sequence = pong_sequence_;
+  return true;
+}
+
+// the callbacks are done with every packet handed out, ring space was already released by the parser
+void TcpSocket::OnRecvDone() {
+  all_packets_.clear();
+  all_chunks_.clear();
+  done_large_packets_.clear();
+  if (stitch_ != nullptr) {
+    BufferPool<TcpStitchBuffer>::Instance()->Return(stitch_);
+    stitch_ = nullptr;
+  }
+}
+
+// a header wrapping around the end of the ring is copied out, it is only a few bytes
+bool TcpSocket::ParseTcpHeader(TcpRecvBuffer* buffer) {
+  char header_data[kTcpHeaderSize];
+  const char* data = buffer->read_pos();
+  if (buffer->read_contiguous() < kTcpHeaderSize) {
+    buffer->Peek(header_data, kTcpHeaderSize);
+    data = header_data;
+  }
+  TcpHeader header;
+  if (!header.Init(data, kTcpHeaderSize) || header.packet_size() > static_cast<uint32_t>(max_packet_size_)) {
+    return false;
+  }
+  buffer->Consume(kTcpHeaderSize);
+  // heartbeat frames never reach the callback, receiving one already refreshed the idle time
+  if (header.is_control()) {
+    if (header.packet_size() != 0) {
+      LOG(kError, "parse tcp header failed: control frame carries a packet.");
       return false;
     }
-    current_packet_.size = header.packet_size();
+    if (header.is_ping()) {
+      pong_pending_ = true;
+      pong_sequence_ = header.sequence();
+    }
+    return true;
+  }
+  packet_size_ = header.packet_size();
+  packet_checksum_ = header.has_checksum();
+  checksum_ = header.checksum();
+  auto chunk_threshold = chunk_threshold_.load(std::memory_order_relaxed);
+  if (chunk_threshold > 0 && packet_size_ > chunk_threshold) {
+    chunked_ = true;
+    chunk_offset_ = 0;
+    chunk_checksum_ = 0;
+    ++chunk_msg_id_;
     return true;
   }
-  return false;
+  // the ring can not hold it, collect it in its own buffer as it arrives
+  if (packet_size_ > buffer->capacity()) {
+    large_packet_.reset(new char[packet_size_]);
+    large_packet_offset_ = 0;
+  }
+  return true;
 }
 
-// parse until current_header_'s size reach to the tcp header size
-// if the header part is successfully parsed, calculate the packet part size, then reset packet part related member
-bool TcpSocket::ParseTcpHeader(const char* data, int size, int& parsed_size) {
-  if (current_header_.size() < kTcpHeaderSize) {
-    int left_header_size = kTcpHeaderSize - current_header_.size();
-    if (left_header_size > size) {
-      for (auto i = 0; i < size; ++i) {
-        current_header_.push_back(data[i]);
-      }
-      parsed_size = size;
+// complete stays false while the current packet is still incomplete.
+// a packet contiguous in the ring is handed out in place, a wrapped one is copied once into the
+// stitch buffer. within one completion the read position passes the end of the ring at most
+// once, so one stitch buffer per completion is enough
+bool TcpSocket::ParseTcpPacket(TcpRecvBuffer* buffer, bool& complete) {
+  if (chunked_) {
+    return ParseTcpChunk(buffer, complete);
+  }
+  PacketView packet = {nullptr, packet_size_};
+  if (large_packet_) {
+    auto size = std::min(buffer->data_size(), packet_size_ - large_packet_offset_);
+    buffer->Peek(&large_packet_[large_packet_offset_], size);
+    buffer->Consume(size);
+    large_packet_offset_ += size;
+    if (large_packet_offset_ < packet_size_) {
+      return true;
+    }
+    packet.packet = large_packet_.get();
+    done_large_packets_.push_back(std::move(large_packet_));
+  } else {
+    if (buffer->data_size() < packet_size_) {
+      return true;
+    }
+    if (buffer->read_contiguous() >= packet_size_) {
+      packet.packet = buffer->read_pos();
     } else {
-      for (auto i = 0; i < left_header_size; ++i) {
-        current_header_.push_back(data[i]);
-      }
-      parsed_size = left_header_size;
-      if (!CalcPacketSize()) {
-        return false;
+      if (stitch_ == nullptr) {
+        stitch_ = BufferPool<TcpStitchBuffer>::Instance()->Get();
+        if (stitch_ == nullptr) {
+          LOG(kError, "parse tcp packet failed: no stitch buffer.");
+          return false;
+        }
       }
-      current_packet_offset_ = 0;
+      buffer->Peek(stitch_->buffer(), packet_size_);
+      packet.packet = stitch_->buffer();
     }
+    buffer->Consume(packet_size_);
   }
+  if (packet_checksum_ && Crc32c(packet.packet, packet.size) != checksum_) {
+    LOG(kError, "parse tcp packet failed: checksum mismatch.");
+    return false;
+  }
+  all_packets_.push_back(packet);
+  packet_size_ = -1;
+  complete = true;
   return true;
 }
 
-int TcpSocket::ParseTcpPacket(const char* data, int size) {
-  if (current_packet_offset_ == 0) {// packet part begin
-    if (current_packet_.size > size) {// packet part size bigger than data size
-      current_packet_.need_clear = true;
-      current_packet_.packet = new char[current_packet_.size];
-      memcpy(current_packet_.packet, data, size);
-      current_packet_offset_ += size;
-      return size;
-    } else {// data is enough for packet part, generate a packet then push to all_packets_ and reset header part member 
-      current_packet_.need_clear = false;
-      current_packet_.packet = const_cast<char*>(data);
-      all_packets_.push_back(current_packet_);
-      current_header_.clear();
-      return current_packet_.size;
-    }
-  } else {// continue with last packet
-    auto left_packet_size = current_packet_.size - current_packet_offset_;
-    if (left_packet_size > 0 && current_packet_.need_clear) {// assert: must be true
-      auto copy_begin = current_packet_.packet + current_packet_offset_;
-      if (left_packet_size > size) {
-        memcpy(copy_begin, data, size);
-        current_packet_offset_ += size;
-        return size;
-      } else {
-        memcpy(copy_begin, data, left_packet_size);
-        all_packets_.push_back(current_packet_);
-        current_packet_.need_clear = false;
-        current_header_.clear();
-        return left_packet_size;
-      }
-    } else {
-      LOG(kError, "parse tcp packet assert error.");
+// every contiguous run of the packet in the ring becomes a chunk, at most two per completion.
+// the checksum is carried along the chunks and checked before the last one is handed out
+bool TcpSocket::ParseTcpChunk(TcpRecvBuffer* buffer, bool& complete) {
+  while (buffer->data_size() > 0 && chunk_offset_ < packet_size_) {
+    auto size = std::min(std::min(buffer->data_size(), buffer->read_contiguous()), packet_size_ - chunk_offset_);
+    TcpChunk chunk = {all_packets_.size(), chunk_msg_id_, chunk_offset_, buffer->read_pos(), size, chunk_offset_ + size == packet_size_};
+    if (packet_checksum_) {
+      chunk_checksum_ = Crc32cExtend(chunk_checksum_, chunk.data, size);
     }
-    return 0;
+    all_chunks_.push_back(chunk);
+    buffer->Consume(size);
+    chunk_offset_ += size;
+  }
+  if (chunk_offset_ < packet_size_) {
+    return true;
   }
+  if (packet_checksum_ && chunk_checksum_ != checksum_) {
+    LOG(kError, "parse tcp chunk failed: checksum mismatch.");
+    return false;
+  }
+  chunked_ = false;
+  packet_size_ = -1;
+  complete = true;
+  return true;
 }
 
 } // namespace net
\ No newline at end of file
@@ -1,32 +1,42 @@
 #ifndef NET_TCP_SOCKET_H_
 #define NET_TCP_SOCKET_H_
 
+#include "net.h"
+#include "platform.h"
 #include "uncopyable.h"
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
-#include <WinSock2.h>
 
 namespace net {
 
-class NetInterface;
 class TcpHeader;
+class TcpRecvBuffer;
+class TcpSendBuffer;
+class TcpStitchBuffer;
+
+const int kTcpConnectIdle = 0;
+const int kTcpConnectPending = 1;
+const int kTcpConnectDone = 2;
+const int kTcpConnectTimeout = 3;
+
+const int kTcpDefaultHeartbeatMiss = 3;
+
+// a piece of a chunked packet, delivered after the first packet_index whole packets of the completion
+struct TcpChunk {
+  size_t packet_index;
+  unsigned long long msg_id;
+  int offset;
+  const char* data;
+  int size;
+  bool last;
+};
 
 class TcpSocket : public utility::Uncopyable {
  public:
-  struct RecvPacket {
-    char* packet;
-    int size;
-    bool need_clear;
-    RecvPacket() : packet(nullptr), size(0), need_clear(false) {}
-    ~RecvPacket() { Clear(); }
-    void Clear() {
-      if (need_clear) delete[] packet;
-      packet = nullptr;
-      size = 0;
-      need_clear = false;
-    }
-  };
-
   TcpSocket();
   ~TcpSocket();
 
@@ -34,36 +44,112 @@ class TcpSocket : public utility::Uncopyable {
   void Destroy();
   bool Bind(const std::string& ip, int port);
   bool Listen(int backlog);
-  bool Connect(const std::string& ip, int port);
+  bool AsyncConnect(const std::string& ip, int port, LPOVERLAPPED ovlp);
+  // the completion and the timeout race for a pending connect, only the winner reports it
+  bool OnConnect(LPOVERLAPPED ovlp, int& error);
+  bool TimeoutConnect();
   bool AsyncAccept(SOCKET accept_sock, char* buffer, int size, LPOVERLAPPED ovlp);
-  bool AsyncSend(const TcpHeader* header, const char* buffer, int size, LPOVERLAPPED ovlp);
-  bool AsyncRecv(char* buffer, int size, LPOVERLAPPED ovlp);
+  bool AsyncSend(TcpSendBuffer* batch);
+  bool AsyncRecv(TcpRecvBuffer* buffer);
   bool SetAccepted(SOCKET listen_sock);
   bool GetLocalAddr(std::string& ip, int& port);
   bool GetRemoteAddr(std::string& ip, int& port);
 
   SOCKET socket() { return socket_; }
   NetInterface* callback() { return callback_; }
-  const std::vector<RecvPacket>& all_packets() { return all_packets_; }
-  bool OnRecv(const char* data, int size);
-  void OnRecvDone() { all_packets_.clear(); }
+  // the io loop the socket is bound to, only that loop writes to it in per core mode
+  int loop() { return loop_; }
+  void set_loop(int loop) { loop_ = loop; }
+  // a received header announcing a larger packet fails the connection
+  void set_max_packet_size(int size) { max_packet_size_ = size; }
+  TcpOptions options();
+  void set_options(const TcpOptions& options);
+  // valid until OnRecvDone, they point into the receive ring or a stitch buffer
+  const std::vector<PacketView>& all_packets() { return all_packets_; }
+  const std::vector<TcpChunk>& all_chunks() { return all_chunks_; }
+  bool OnRecv(TcpRecvBuffer* buffer, int size);
+  void OnRecvDone();
+  // only one write is in flight per socket, packets sent meanwhile wait in the queue
+  // and the next write gathers as many of them as the limits allow.
+  // PushSend is safe from any thread and returns true when the caller has to start that write.
+  // it takes a whole frame, the parts of a TcpSendv linked through next
+  bool PushSend(TcpSendBuffer* frame);
+  TcpSendBuffer* PopSendBatch(int max_packet, int max_bytes);
+  // the write could not be started: the token holder takes back its batch and everything queued,
+  // the bytes are no longer counted and the token is released. returns the buffers to give back
+  TcpSendBuffer* AbortSend(TcpSendBuffer* batch);
+  // bytes pushed but not yet taken by a write, headers included
+  long long queued_bytes() { return queued_bytes_.load(std::memory_order_relaxed); }
+  // true when the send level reached the high watermark, the socket then owes an OnTcpWritable
+  bool WouldBlock();
+  // a write of bytes completed, true when the OnTcpWritable owed is due now
+  bool OnSendDone(long long bytes);
+  // counted by the completions, only one receive and one write are in flight per socket
+  void CountRecv(unsigned long long bytes, unsigned long long packets);
+  void CountSend(unsigned long long bytes, unsigned long long packets);
+  void GetStats(NetTcpStats& stats);
+  // idle and send timeouts are checked lazily against the last receive and the last write
+  // progress, the check timer only runs when a deadline may have passed.
+  // returns the milliseconds until the next check, -1 for none, error is set once one expired.
+  // ping is the non zero sequence of a heartbeat ping to send, the peer has been silent too long
+  int CheckTimeout(long long now, int& error, uint32_t& ping);
+  // a ping received by the last OnRecv waits to be answered, only the latest one is
+  bool TakePong(uint32_t& sequence);
+  unsigned long long check_timer() { return check_timer_.load(); }
+  unsigned long long exchange_check_timer(unsigned long long id) { return check_timer_.exchange(id); }
 
  private:
   void ResetMember();
-  bool CalcPacketSize();
-  bool ParseTcpHeader(const char* data, int size, int& parsed_size);
-  int ParseTcpPacket(const char* data, int size);
+  void ClearSendQueue();
+  void TakeSendStack();
+  bool ParseTcpHeader(TcpRecvBuffer* buffer);
+  bool ParseTcpPacket(TcpRecvBuffer* buffer, bool& complete);
+  bool ParseTcpChunk(TcpRecvBuffer* buffer, bool& complete);
 
  private:
   NetInterface* callback_;
   SOCKET socket_;
+  int loop_;
   bool bind_;
   bool listen_;
   bool connect_;
-  std::vector<char> current_header_;
-  RecvPacket current_packet_;
-  int current_packet_offset_;
-  std::vector<RecvPacket> all_packets_;
+  std::atomic<int> connect_state_;
+  std::mutex options_lock_;
+  TcpOptions options_;
+  int max_packet_size_;
+  int packet_size_;
+  bool packet_checksum_;
+  uint32_t checksum_;
+  std::unique_ptr<char[]> large_packet_;
+  int large_packet_offset_;
+  std::vector<std::unique_ptr<char[]>> done_large_packets_;
+  TcpStitchBuffer* stitch_;
+  std::vector<PacketView> all_packets_;
+  std::atomic<int> chunk_threshold_;
+  bool chunked_;
+  int chunk_offset_;
+  uint32_t chunk_checksum_;
+  unsigned long long chunk_msg_id_;
+  std::vector<TcpChunk> all_chunks_;
+  std::atomic<TcpSendBuffer*> send_stack_;
+  TcpSendBuffer* send_head_;
+  TcpSendBuffer* send_tail_;
+  std::atomic<bool> sending_;
+  std::atomic<long long> queued_bytes_;
+  std::atomic<long long> unsent_bytes_;
+  std::atomic<bool> writable_wanted_;
+  std::atomic<long long> recv_time_;
+  std::atomic<long long> send_time_;
+  std::atomic<unsigned long long> check_timer_;
+  std::atomic<unsigned long long> bytes_in_;
+  std::atomic<unsigned long long> bytes_out_;
+  std::atomic<unsigned long long> packets_in_;
+  std::atomic<unsigned long long> packets_out_;
+  long long ping_time_;
+  uint32_t ping_sequence_;
+  bool pong_pending_;
+  uint32_t pong_sequence_;
+  std::vector<WSABUF> send_gather_;
 };
 
 } // namespace net
@@ -0,0 +1,120 @@
+/************************************************************************/
+/*  Flight recorder decoder                                             */
+/*  prints a NetDumpFlightRecorder file, all threads merged by time     */
+/************************************************************************/
+
+#include "flight_recorder.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace net;
+
+namespace {
+
+struct Row {
+  unsigned int thread;
+  FlightEvent event;
+};
+
+std::string TypeName(unsigned int type) {
+  const char* const kAsyncName[] = {"", "tcp_accept", "tcp_send", "tcp_recv", "udp_send", "udp_recv",
+    "tcp_flush", "tcp_connect", "udp_recv_batch"};
+  const char* const kTimerName[] = {"", "timer_tcp_connect", "timer_tcp_check", "timer_tcp_pool", "timer_user"};
+  if (type > 0 && type < sizeof(kAsyncName) / sizeof(kAsyncName[0])) {
+    return kAsyncName[type];
+  }
+  if (type > kFlightTimerBase && type - kFlightTimerBase < sizeof(kTimerName) / sizeof(kTimerName[0])) {
+    return kTimerName[type - kFlightTimerBase];
+  }
+  return "type_" + std::to_string(type);
+}
+
+bool ReadAll(FILE* file, FlightDumpHeader& header, std::vector<Row>& all_row) {
+  if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, kFlightMagic, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "not a flight recorder dump\n");
+    return false;
+  }
+  if (header.version != kFlightVersion) {
+    fprintf(stderr, "dump version %u, this decoder reads %u\n", header.version, kFlightVersion);
+    return false;
+  }
+  for (unsigned int i = 0; i < header.thread_count; ++i) {
+    FlightThreadHeader thread;
+    if (fread(&thread, sizeof(thread), 1, file) != 1) {
+      fprintf(stderr, "truncated dump\n");
+      return false;
+    }
+    std::vector<FlightEvent> event(thread.event_count);
+    if (!event.empty() && fread(event.data(), sizeof(FlightEvent), event.size(), file) != event.size()) {
+      fprintf(stderr, "truncated dump\n");
+      return false;
+    }
+    for (const auto& j : event) {
+      Row row = {thread.thread, j};
+      all_row.push_back(row);
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto csv = false;
+  auto min_us = 0.0;
+  std::string path;
+  for (auto i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--csv") {
+      csv = true;
+    } else if (arg.compare(0, 9, "--min-us=") == 0) {
+      min_us = atof(arg.c_str() + 9);
+    } else if (path.empty() && arg.compare(0, 2, "--") != 0) {
+      path = arg;
+    } else {
+      path.clear();
+      break;
+    }
+  }
+  if (path.empty()) {
+    fprintf(stderr, "usage: flight_decode [--csv] [--min-us=US] DUMP\n");
+    return 1;
+  }
+  auto file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    fprintf(stderr, "can not open %s\n", path.c_str());
+    return 1;
+  }
+  FlightDumpHeader header;
+  std::vector<Row> all_row;
+  auto ok = ReadAll(file, header, all_row);
+  fclose(file);
+  if (!ok) {
+    return 1;
+  }
+  std::stable_sort(all_row.begin(), all_row.end(), [](const Row& a, const Row& b) { return a.event.tsc < b.event.tsc; });
+  // times are microseconds before the dump, ticks are shown as they are without a tick rate
+  auto us_per_tick = header.tick_hz > 0 ? 1e6 / header.tick_hz : 1.0;
+  if (csv) {
+    printf("us_before_dump,thread,type,handle,bytes,duration_us\n");
+  } else {
+    printf("%14s %6s %-18s %12s %10s %12s\n", "us_before_dump", "thread", "type", "handle", "bytes", "duration_us");
+  }
+  for (const auto& row : all_row) {
+    const auto& event = row.event;
+    auto duration = event.duration * us_per_tick;
+    if (duration < min_us) {
+      continue;
+    }
+    auto before = header.dump_tick >= event.tsc ? (header.dump_tick - event.tsc) * us_per_tick : 0.0;
+    printf(csv ? "%.3f,%u,%s,%llu,%u,%.3f\n" : "%14.3f %6u %-18s %12llu %10u %12.3f\n",
+      before, row.thread, TypeName(event.type).c_str(), event.handle, event.bytes, duration);
+  }
+  fprintf(stderr, "%u threads, %zu events, tick rate %llu Hz, dumped at unix ms %llu\n",
+    header.thread_count, all_row.size(), header.tick_hz, header.dump_unix_ms);
+  return 0;
+}
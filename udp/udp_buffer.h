@@ -2,10 +2,32 @@
 #define NET_UDP_BUFFER_H_
 
 #include "base_buffer.h"
+#include "buffer_pool.h"
+#include <functional>
+#ifndef _WIN32
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif // _WIN32
 
 namespace net {
 
+// default datagram buffer size, NetOptions::udp_buffer_size overrides it
 const int kUdpBufferSize = 8 * 1024;
+const int kMaxUdpDatagramSize = 65507;
+// datagrams per recvmmsg and sendmmsg, NetOptions::udp_batch_count overrides it
+const int kUdpBatchCount = 32;
+const int kMaxUdpBatchCount = 64;
+// a receive slot taking coalesced datagrams has to hold the largest udp payload
+const int kUdpGroBufferSize = 65535;
 
 class UdpSendBuffer : public BaseBuffer {
  public:
@@ -14,6 +36,8 @@ class UdpSendBuffer : public BaseBuffer {
     set_async_type(kAsyncTypeUdpSend);
     buffer_ = nullptr;
     deleter_ = nullptr;
+    memset(&to_addr_, 0, sizeof(to_addr_));
+    next_ = nullptr;
   }
   ~UdpSendBuffer() {
     if (buffer_ != nullptr) {
@@ -32,12 +56,20 @@ class UdpSendBuffer : public BaseBuffer {
     return true;
   }
   const char* buffer() { return buffer_; }
+  // the destination of a datagram waiting in a socket send queue
+  PSOCKADDR_IN to_addr() { return &to_addr_; }
+  // links datagrams waiting in a socket send queue, and the datagrams of one batched send
+  UdpSendBuffer* next() { return next_; }
+  void set_next(UdpSendBuffer* value) { next_ = value; }
 
  private:
    char* buffer_;
    std::function<void(char*)> deleter_;
+   SOCKADDR_IN to_addr_;
+   UdpSendBuffer* next_;
 };
 
+// the datagram buffer is the pool tail behind the object
 class UdpRecvBuffer : public BaseBuffer {
  public:
   UdpRecvBuffer() {
@@ -46,20 +78,72 @@ class UdpRecvBuffer : public BaseBuffer {
   void ResetBuffer() {
     BaseBuffer::ResetBuffer();
     set_async_type(kAsyncTypeUdpRecv);
-    set_buffer_size(sizeof(buffer_));
+    set_buffer_size(BufferPool<UdpRecvBuffer>::Instance()->tail_size());
     memset(&from_addr_, 0, sizeof(from_addr_));
     addr_size_ = sizeof(from_addr_);
   }
-  char* buffer() { return buffer_; }
+  char* buffer() { return BufferPool<UdpRecvBuffer>::tail(this); }
   PSOCKADDR_IN from_addr() { return &from_addr_; }
   PINT addr_size() { return &addr_size_; }
 
  private:
-  char buffer_[kUdpBufferSize];
   SOCKADDR_IN from_addr_;
   INT addr_size_;
 };
 
+#ifndef _WIN32
+// the slots of one recvmmsg, their datagram buffers are the pool tail behind the object.
+// with gro a slot may take several datagrams of one sender, its control data tells their size
+class UdpRecvBatchBuffer : public BaseBuffer {
+ public:
+  UdpRecvBatchBuffer() {
+    BaseBuffer::ResetBuffer();
+    set_async_type(kAsyncTypeUdpRecvBatch);
+    slot_count_ = 0;
+  }
+  // the kernel overwrote the lengths of the last receive, every slot is laid out again
+  void Prepare(int slot_count, int slot_size) {
+    slot_count_ = slot_count;
+    auto data = BufferPool<UdpRecvBatchBuffer>::tail(this);
+    memset(msgs_, 0, sizeof(msgs_[0]) * slot_count);
+    for (auto i = 0; i < slot_count; ++i) {
+      iov_[i].iov_base = data + static_cast<size_t>(i) * slot_size;
+      iov_[i].iov_len = slot_size;
+      msgs_[i].msg_hdr.msg_name = &addr_[i];
+      msgs_[i].msg_hdr.msg_namelen = sizeof(addr_[i]);
+      msgs_[i].msg_hdr.msg_iov = &iov_[i];
+      msgs_[i].msg_hdr.msg_iovlen = 1;
+      msgs_[i].msg_hdr.msg_control = control_[i];
+      msgs_[i].msg_hdr.msg_controllen = sizeof(control_[i]);
+    }
+  }
+  mmsghdr* msgs() { return msgs_; }
+  int slot_count() { return slot_count_; }
+  const char* slot(int index) { return static_cast<const char*>(iov_[index].iov_base); }
+  int size(int index) { return static_cast<int>(msgs_[index].msg_len); }
+  PSOCKADDR_IN from_addr(int index) { return &addr_[index]; }
+  // size of the datagrams coalesced into a slot, only the last may be shorter. 0 for a single one
+  int segment_size(int index) {
+    auto msg = &msgs_[index].msg_hdr;
+    for (auto cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+        int segment = 0;
+        memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+        return segment;
+      }
+    }
+    return 0;
+  }
+
+ private:
+  int slot_count_;
+  mmsghdr msgs_[kMaxUdpBatchCount];
+  iovec iov_[kMaxUdpBatchCount];
+  SOCKADDR_IN addr_[kMaxUdpBatchCount];
+  cmsghdr control_[kMaxUdpBatchCount][(CMSG_SPACE(sizeof(int)) + sizeof(cmsghdr) - 1) / sizeof(cmsghdr)];
+};
+#endif // _WIN32
+
 } // namespace net
 
 #endif	// NET_UDP_BUFFER_H_
\ No newline at end of file
@@ -1,15 +1,40 @@
 #include "udp_socket.h"
 #include "log.h"
 #include "utility_net.h"
+#ifdef _WIN32
 #include <MSWSock.h>
 #pragma comment(lib, "Mswsock.lib")
+#endif // _WIN32
 
 namespace net {
 
+#ifndef _WIN32
+namespace {
+
+// gso hands the kernel one buffer to cut into datagrams, each has to fit the path mtu
+const int kMaxUdpGsoSegmentSize = 1472;
+const int kMaxUdpGsoSegments = 64;
+
+bool SameAddr(const SOCKADDR_IN& left, const SOCKADDR_IN& right) {
+  return left.sin_addr.s_addr == right.sin_addr.s_addr && left.sin_port == right.sin_port;
+}
+
+} // namespace
+#endif // _WIN32
+
 UdpSocket::UdpSocket() {
   callback_ = nullptr;
   socket_ = INVALID_SOCKET;
   bind_ = false;
+  connected_ = false;
+#ifndef _WIN32
+  batch_count_ = 1;
+  gso_ = false;
+  send_stack_ = nullptr;
+  send_head_ = nullptr;
+  send_tail_ = nullptr;
+  sending_ = false;
+#endif // _WIN32
 }
 
 UdpSocket::~UdpSocket() {
@@ -37,6 +62,12 @@ bool UdpSocket::Create(NetInterface* callback) {
     Destroy();
     return false;
   }
+#ifndef _WIN32
+  // a kernel knowing UDP_SEGMENT can cut a run of equal datagrams out of one send
+  int segment = 0;
+  socklen_t segment_size = sizeof(segment);
+  gso_ = ::getsockopt(socket_, SOL_UDP, UDP_SEGMENT, &segment, &segment_size) == 0;
+#endif // _WIN32
   return true;
 }
 
@@ -55,12 +86,14 @@ bool UdpSocket::Bind(const std::string& ip, int port) {
     LOG(kError, "bind udp socket failed, error code: %d.", ::WSAGetLastError());
     return false;
   }
+#ifdef _WIN32
   DWORD return_bytes = 0;
   BOOL reset_ctl = FALSE;
   if (::WSAIoctl(socket_, SIO_UDP_CONNRESET, &reset_ctl, sizeof(reset_ctl), NULL, 0, &return_bytes, NULL, NULL) != 0) {
     LOG(kError, "set udp socket reset control failed, error code: %d.", ::WSAGetLastError());
     return false;
   }
+#endif // _WIN32
   bind_ = true;
   return true;
 }
@@ -71,9 +104,46 @@ void UdpSocket::Destroy() {
     socket_ = INVALID_SOCKET;
     callback_ = nullptr;
   }
+#ifndef _WIN32
+  ClearSendQueue();
+#endif // _WIN32
+}
+
+bool UdpSocket::Connect(const SOCKADDR_IN& addr) {
+  if (socket_ == INVALID_SOCKET) {
+    LOG(kError, "connect udp socket failed: not created.");
+    return false;
+  }
+  if (::connect(socket_, (SOCKADDR*)&addr, sizeof(addr)) != 0) {
+    LOG(kError, "connect udp socket failed, error code: %d.", ::WSAGetLastError());
+    return false;
+  }
+  connected_ = true;
+  return true;
+}
+
+bool UdpSocket::AsyncSend(const char* buffer, int size, LPOVERLAPPED ovlp) {
+  if (socket_ == INVALID_SOCKET) {
+    LOG(kError, "async udp socket send buffer failed: not created.");
+    return false;
+  }
+  if (buffer == nullptr || size == 0 || ovlp == NULL) {
+    LOG(kError, "async udp socket send buffer failed: invalid parameter.");
+    return false;
+  }
+  WSABUF buff = {0};
+  buff.buf = const_cast<char*>(buffer);
+  buff.len = size;
+  if (::WSASend(socket_, &buff, 1, NULL, 0, ovlp, NULL) != 0) {
+    if (::WSAGetLastError() != ERROR_IO_PENDING) {
+      LOG(kError, "WSASend failed, error code: %d.", ::WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
 }
 
-bool UdpSocket::AsyncSendTo(const char* buffer, int size, const std::string& ip, int port, LPOVERLAPPED ovlp) {
+bool UdpSocket::AsyncSendTo(const char* buffer, int size, const SOCKADDR_IN& to_addr, LPOVERLAPPED ovlp) {
   if (socket_ == INVALID_SOCKET) {
     LOG(kError, "async udp socket send buffer failed: not created.");
     return false;
@@ -85,9 +155,7 @@ bool UdpSocket::AsyncSendTo(const char* buffer, int size, const std::string& ip,
   WSABUF buff = {0};
   buff.buf = const_cast<char*>(buffer);
   buff.len = size;
-  SOCKADDR_IN send_to_addr = {0};
-  utility::ToSockAddr(send_to_addr, ip, port);
-  if (::WSASendTo(socket_, &buff, 1, NULL, 0, (PSOCKADDR)&send_to_addr, sizeof(send_to_addr), ovlp, NULL) != 0) {
+  if (::WSASendTo(socket_, &buff, 1, NULL, 0, (PSOCKADDR)&to_addr, sizeof(to_addr), ovlp, NULL) != 0) {
     if (::WSAGetLastError() != ERROR_IO_PENDING) {
       LOG(kError, "WSASendTo failed, error code: %d.", ::WSAGetLastError());
       return false;
@@ -118,4 +186,156 @@ bool UdpSocket::AsyncRecvFrom(char* buffer, int size, LPOVERLAPPED ovlp, PSOCKAD
   return true;
 }
 
-} // namespace net
\ No newline at end of file
+#ifndef _WIN32
+bool UdpSocket::EnableGro() {
+  int gro = 1;
+  if (::setsockopt(socket_, SOL_UDP, UDP_GRO, &gro, sizeof(gro)) != 0) {
+    LOG(kError, "set udp socket gro option failed, error code: %d.", ::WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+bool UdpSocket::AsyncRecvBatch(UdpRecvBatchBuffer* buffer) {
+  if (socket_ == INVALID_SOCKET) {
+    LOG(kError, "async udp socket recv batch failed: not created.");
+    return false;
+  }
+  if (buffer == nullptr || buffer->slot_count() == 0) {
+    LOG(kError, "async udp socket recv batch failed: invalid parameter.");
+    return false;
+  }
+  if (::RecvMsgBatch(socket_, buffer->msgs(), buffer->slot_count(), buffer->ovlp()) != 0) {
+    if (::WSAGetLastError() != ERROR_IO_PENDING) {
+      LOG(kError, "RecvMsgBatch failed, error code: %d.", ::WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
+}
+
+void UdpSocket::ClearSendQueue() {
+  TakeSendStack();
+  while (send_head_ != nullptr) {
+    auto buffer = send_head_;
+    send_head_ = buffer->next();
+    BufferPool<UdpSendBuffer>::Instance()->Return(buffer);
+  }
+  send_tail_ = nullptr;
+}
+
+bool UdpSocket::PushSend(UdpSendBuffer* buffer) {
+  auto top = send_stack_.load(std::memory_order_relaxed);
+  do {
+    buffer->set_next(top);
+  } while (!send_stack_.compare_exchange_weak(top, buffer, std::memory_order_release, std::memory_order_relaxed));
+  return !sending_.exchange(true, std::memory_order_acq_rel);
+}
+
+void UdpSocket::TakeSendStack() {
+  auto stack = send_stack_.exchange(nullptr, std::memory_order_acquire);
+  UdpSendBuffer* head = nullptr;
+  auto tail = stack;
+  while (stack != nullptr) {
+    auto next = stack->next();
+    stack->set_next(head);
+    head = stack;
+    stack = next;
+  }
+  if (head == nullptr) {
+    return;
+  }
+  if (send_tail_ == nullptr) {
+    send_head_ = head;
+  } else {
+    send_tail_->set_next(head);
+  }
+  send_tail_ = tail;
+}
+
+// takes up to batch_count datagrams, nullptr means the queue is empty and no send is in flight any more
+UdpSendBuffer* UdpSocket::PopSendBatch() {
+  TakeSendStack();
+  if (send_head_ == nullptr) {
+    sending_.store(false, std::memory_order_seq_cst);
+    if (send_stack_.load(std::memory_order_seq_cst) == nullptr || sending_.exchange(true, std::memory_order_acq_rel)) {
+      return nullptr;
+    }
+    TakeSendStack();
+  }
+  auto batch = send_head_;
+  auto tail = batch;
+  for (auto count = 1; tail->next() != nullptr && count < batch_count_; ++count) {
+    tail = tail->next();
+  }
+  send_head_ = tail->next();
+  if (send_head_ == nullptr) {
+    send_tail_ = nullptr;
+  }
+  tail->set_next(nullptr);
+  return batch;
+}
+
+// a run of datagrams to one peer sharing one size, only the last may be shorter,
+// becomes a single message the kernel cuts up again when it knows gso
+bool UdpSocket::AsyncSendBatch(UdpSendBuffer* batch) {
+  if (socket_ == INVALID_SOCKET) {
+    LOG(kError, "async udp socket send batch failed: not created.");
+    return false;
+  }
+  if (batch == nullptr) {
+    LOG(kError, "async udp socket send batch failed: invalid parameter.");
+    return false;
+  }
+  unsigned int msg_count = 0;
+  auto iov_count = 0;
+  for (auto buffer = batch; buffer != nullptr; ++msg_count) {
+    auto& msg = send_msgs_[msg_count];
+    memset(&msg, 0, sizeof(msg));
+    // a datagram without an address goes to the peer the socket is connected to
+    if (buffer->to_addr()->sin_family != AF_UNSPEC) {
+      msg.msg_hdr.msg_name = buffer->to_addr();
+      msg.msg_hdr.msg_namelen = sizeof(*buffer->to_addr());
+    }
+    msg.msg_hdr.msg_iov = &send_iov_[iov_count];
+    auto segment = buffer->buffer_size();
+    auto segment_count = 0;
+    auto bytes = 0;
+    auto head = buffer;
+    while (true) {
+      send_iov_[iov_count].iov_base = const_cast<char*>(buffer->buffer());
+      send_iov_[iov_count].iov_len = buffer->buffer_size();
+      ++iov_count;
+      ++segment_count;
+      bytes += buffer->buffer_size();
+      auto last = buffer;
+      buffer = buffer->next();
+      if (!gso_ || buffer == nullptr || last->buffer_size() != segment || segment > kMaxUdpGsoSegmentSize ||
+          segment_count == kMaxUdpGsoSegments || buffer->buffer_size() > segment ||
+          bytes + buffer->buffer_size() > kMaxUdpDatagramSize || !SameAddr(*buffer->to_addr(), *head->to_addr())) {
+        break;
+      }
+    }
+    msg.msg_hdr.msg_iovlen = segment_count;
+    if (segment_count > 1) {
+      msg.msg_hdr.msg_control = send_control_[msg_count];
+      msg.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+      auto cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      auto size = static_cast<uint16_t>(segment);
+      memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+    }
+  }
+  if (::SendMsgBatch(socket_, send_msgs_, msg_count, batch->ovlp()) != 0) {
+    if (::WSAGetLastError() != ERROR_IO_PENDING) {
+      LOG(kError, "SendMsgBatch failed, error code: %d.", ::WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
+}
+#endif // _WIN32
+
+} // namespace net
@@ -1,13 +1,26 @@
 #ifndef NET_UDP_SOCKET_H_
 #define NET_UDP_SOCKET_H_
 
+#include "net.h"
+#include "platform.h"
+#include "udp_buffer.h"
 #include "uncopyable.h"
+#include <atomic>
 #include <string>
-#include <WinSock2.h>
 
 namespace net {
 
-class NetInterface;
+inline void ToUdpEndpoint(const SOCKADDR_IN& addr, UdpEndpoint& endpoint) {
+  memcpy(endpoint.address, &addr.sin_addr, sizeof(endpoint.address));
+  endpoint.port = ntohs(addr.sin_port);
+}
+
+inline void ToSockAddr(SOCKADDR_IN& addr, const UdpEndpoint& endpoint) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  memcpy(&addr.sin_addr, endpoint.address, sizeof(endpoint.address));
+  addr.sin_port = htons(endpoint.port);
+}
 
 class UdpSocket : public utility::Uncopyable {
  public:
@@ -17,16 +30,52 @@ class UdpSocket : public utility::Uncopyable {
   bool Create(NetInterface* callback);
   bool Bind(const std::string& ip, int port);
   void Destroy();
-  bool AsyncSendTo(const char* buffer, int size, const std::string& ip, int port, LPOVERLAPPED ovlp);
+  // the kernel keeps the peer of a connected socket: sends carry no address and skip the route
+  // lookup, datagrams from other peers are dropped
+  bool Connect(const SOCKADDR_IN& addr);
+  bool connected() { return connected_; }
+  bool AsyncSend(const char* buffer, int size, LPOVERLAPPED ovlp);
+  bool AsyncSendTo(const char* buffer, int size, const SOCKADDR_IN& to_addr, LPOVERLAPPED ovlp);
   bool AsyncRecvFrom(char* buffer, int size, LPOVERLAPPED ovlp, PSOCKADDR_IN addr, PINT addr_size);
+#ifndef _WIN32
+  // datagrams moved per batched receive and send, 1 keeps one datagram per operation
+  int batch_count() { return batch_count_; }
+  void set_batch_count(int count) { batch_count_ = count; }
+  bool EnableGro();
+  bool AsyncRecvBatch(UdpRecvBatchBuffer* buffer);
+  // the tcp send queue again: PushSend is safe from any thread and returns true when the
+  // caller has to start the batched send, only one is in flight per socket
+  bool PushSend(UdpSendBuffer* buffer);
+  UdpSendBuffer* PopSendBatch();
+  bool AsyncSendBatch(UdpSendBuffer* batch);
+#endif // _WIN32
 
   SOCKET socket() { return socket_; }
   NetInterface* callback() { return callback_; }
 
+ private:
+#ifndef _WIN32
+  void ClearSendQueue();
+  void TakeSendStack();
+#endif // _WIN32
+
  private:
   NetInterface* callback_;
   SOCKET socket_;
   bool bind_;
+  std::atomic<bool> connected_;
+#ifndef _WIN32
+  int batch_count_;
+  bool gso_;
+  std::atomic<UdpSendBuffer*> send_stack_;
+  UdpSendBuffer* send_head_;
+  UdpSendBuffer* send_tail_;
+  std::atomic<bool> sending_;
+  // owned by the batched send in flight
+  mmsghdr send_msgs_[kMaxUdpBatchCount];
+  iovec send_iov_[kMaxUdpBatchCount];
+  cmsghdr send_control_[kMaxUdpBatchCount][(CMSG_SPACE(sizeof(uint16_t)) + sizeof(cmsghdr) - 1) / sizeof(cmsghdr)];
+#endif // _WIN32
 };
 
 } // namespace net